@@ -0,0 +1,180 @@
+// Binary deltas between versions of file content
+#include "contentDelta.h"
+#include <algorithm>    // For standard algorithms
+#include <cstdint>      // For fixed-width integers
+#include <cstring>      // For memcmp
+#include <unordered_map> // For the block index of the base
+
+// Length of the blocks of the base that matches are searched for
+static const size_t kDeltaBlockBytes = 16;
+
+// Multiplier of the polynomial rolling hash over a block
+static const uint64_t kRollingBase = 0x100000001b3ULL;
+
+/**
+ * Appends an unsigned value in LEB128 form
+ */
+static void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+/**
+ * Reads an unsigned value in LEB128 form
+ * @return False if the input ends inside the value or it overflows
+ */
+static bool getVarint(std::string_view in, size_t& position, uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (position >= in.size()) {
+            return false;
+        }
+        uint8_t byte = static_cast<uint8_t>(in[position++]);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Appends a copy of base[offset, offset + length); the low bit of the
+ * length word tells copies (1) from inserts (0)
+ */
+static void putCopy(std::string& out, uint64_t offset, uint64_t length) {
+    if (length != 0) {
+        putVarint(out, length << 1 | 1);
+        putVarint(out, offset);
+    }
+}
+
+/**
+ * Appends an insert of literal bytes
+ */
+static void putInsert(std::string& out, std::string_view bytes) {
+    if (!bytes.empty()) {
+        putVarint(out, static_cast<uint64_t>(bytes.size()) << 1);
+        out.append(bytes.data(), bytes.size());
+    }
+}
+
+/**
+ * Hashes one block
+ */
+static uint64_t hashBlock(const char* data) {
+    uint64_t hash = 0;
+    for (size_t i = 0; i < kDeltaBlockBytes; ++i) {
+        hash = hash * kRollingBase + static_cast<uint8_t>(data[i]);
+    }
+    return hash;
+}
+
+std::string encodeDelta(std::string_view base, std::string_view target) {
+    size_t prefix = 0;
+    size_t limit = std::min(base.size(), target.size());
+    while (prefix < limit && base[prefix] == target[prefix]) {
+        prefix++;
+    }
+    size_t suffix = 0;
+    limit -= prefix;
+    while (suffix < limit && base[base.size() - 1 - suffix] == target[target.size() - 1 - suffix]) {
+        suffix++;
+    }
+
+    std::string delta;
+    putCopy(delta, 0, prefix);
+
+    // Only the changed middle of the base is indexed, so the work and the
+    // memory spent stay proportional to the edit
+    std::string_view baseMiddle = base.substr(prefix, base.size() - prefix - suffix);
+    std::string_view targetMiddle = target.substr(prefix, target.size() - prefix - suffix);
+    std::unordered_map<uint64_t, size_t> blocks;
+    if (baseMiddle.size() >= kDeltaBlockBytes && targetMiddle.size() >= kDeltaBlockBytes) {
+        blocks.reserve(baseMiddle.size() / kDeltaBlockBytes);
+        for (size_t offset = 0; offset + kDeltaBlockBytes <= baseMiddle.size(); offset += kDeltaBlockBytes) {
+            blocks.emplace(hashBlock(baseMiddle.data() + offset), offset);
+        }
+    }
+
+    uint64_t outgoingWeight = 1;
+    for (size_t i = 0; i < kDeltaBlockBytes; ++i) {
+        outgoingWeight *= kRollingBase;
+    }
+
+    size_t literalStart = 0;
+    size_t position = 0;
+    uint64_t hash = 0;
+    bool hashValid = false;
+    while (!blocks.empty() && position + kDeltaBlockBytes <= targetMiddle.size()) {
+        if (!hashValid) {
+            hash = hashBlock(targetMiddle.data() + position);
+            hashValid = true;
+        }
+
+        auto block = blocks.find(hash);
+        if (block != blocks.end() &&
+            std::memcmp(baseMiddle.data() + block->second, targetMiddle.data() + position, kDeltaBlockBytes) == 0) {
+            // Grow the match both ways, backwards only into pending literals
+            size_t baseBegin = block->second;
+            size_t targetBegin = position;
+            while (baseBegin > 0 && targetBegin > literalStart &&
+                   baseMiddle[baseBegin - 1] == targetMiddle[targetBegin - 1]) {
+                baseBegin--;
+                targetBegin--;
+            }
+            size_t length = position - targetBegin + kDeltaBlockBytes;
+            while (baseBegin + length < baseMiddle.size() && targetBegin + length < targetMiddle.size() &&
+                   baseMiddle[baseBegin + length] == targetMiddle[targetBegin + length]) {
+                length++;
+            }
+
+            putInsert(delta, targetMiddle.substr(literalStart, targetBegin - literalStart));
+            putCopy(delta, prefix + baseBegin, length);
+            position = targetBegin + length;
+            literalStart = position;
+            hashValid = false;
+            continue;
+        }
+
+        // Slide the window by one byte
+        if (position + kDeltaBlockBytes < targetMiddle.size()) {
+            hash = hash * kRollingBase + static_cast<uint8_t>(targetMiddle[position + kDeltaBlockBytes]) -
+                   outgoingWeight * static_cast<uint8_t>(targetMiddle[position]);
+        }
+        position++;
+    }
+
+    putInsert(delta, targetMiddle.substr(literalStart));
+    putCopy(delta, base.size() - suffix, suffix);
+    return delta;
+}
+
+bool applyDelta(std::string_view base, std::string_view delta, std::string& target) {
+    target.clear();
+    size_t position = 0;
+    while (position < delta.size()) {
+        uint64_t word;
+        if (!getVarint(delta, position, word)) {
+            return false;
+        }
+        uint64_t length = word >> 1;
+        if (word & 1) {
+            uint64_t offset;
+            if (!getVarint(delta, position, offset) || offset > base.size() || length > base.size() - offset) {
+                return false;
+            }
+            target.append(base.data() + offset, length);
+        } else {
+            if (length > delta.size() - position) {
+                return false;
+            }
+            target.append(delta.data() + position, length);
+            position += length;
+        }
+    }
+    return true;
+}
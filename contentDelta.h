@@ -0,0 +1,36 @@
+#ifndef CONTENT_DELTA_H
+#define CONTENT_DELTA_H
+
+#include <string>       // For string manipulation
+#include <string_view>  // For non-owning views of the inputs
+
+/**
+ * Binary deltas between two versions of a file.
+ *
+ * A delta rebuilds a target from a base as a sequence of instructions:
+ * copy a range of the base, or insert literal bytes carried in the delta.
+ * Lengths and offsets are varint encoded, so a delta costs a few bytes per
+ * instruction plus the bytes that are new in the target, and a small edit
+ * of a large file gives a small delta.
+ */
+
+/**
+ * Encodes the delta that turns base into target. The common prefix and
+ * suffix become single copies; in between, blocks of the base that reappear
+ * in the target are found with a rolling hash.
+ * @param base The version the delta is applied to
+ * @param target The version the delta rebuilds
+ * @return The encoded delta
+ */
+std::string encodeDelta(std::string_view base, std::string_view target);
+
+/**
+ * Rebuilds a target from its base and a delta
+ * @param base The version the delta was encoded against
+ * @param delta The delta from encodeDelta
+ * @param target Set to the rebuilt version
+ * @return False if the delta is malformed or does not fit the base
+ */
+bool applyDelta(std::string_view base, std::string_view delta, std::string& target);
+
+#endif // CONTENT_DELTA_H
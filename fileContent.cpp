@@ -0,0 +1,455 @@
+// Hole-aware, copy-on-write file content for the memory file system
+#include "fileContent.h"
+#include <algorithm>    // For standard algorithms
+#include <atomic>       // For the memfd threshold
+#include <cstring>      // For memcpy
+#include <functional>   // For hashing content blocks
+#include <string_view>  // For hashing content blocks in place
+#include <unordered_set> // For counting distinct buffers
+#include <vector>       // For gathering output vectors
+#include <cerrno>       // For errno
+#include <climits>      // For IOV_MAX
+#include <fcntl.h>      // For file sealing
+#include <sys/mman.h>   // For memfd_create and mmap
+#include <sys/sendfile.h> // For sending memfd pages without copies
+#include <sys/uio.h>    // For writev
+#include <unistd.h>     // For ftruncate, pwrite and close
+
+// Buffers at least this large go to sealed memfds; 0 keeps everything on the heap
+static std::atomic<size_t> memfdThresholdBytes(0);
+
+// Size of the logical blocks content hashes are computed over
+static const size_t kHashBlockBytes = 64 << 10;
+
+/**
+ * Creates an empty memfd that can be sealed
+ * @param length Size of the memfd; unwritten ranges stay unallocated
+ * @return The file descriptor, or -1 on failure
+ */
+static int createMemfd(size_t length) {
+    int fd = memfd_create("memfs", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd >= 0 && ftruncate(fd, static_cast<off_t>(length)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Writes bytes into a memfd at an offset, retrying short writes
+ * @return True if every byte was written
+ */
+static bool writeMemfd(int fd, uint64_t offset, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = pwrite(fd, data, length, static_cast<off_t>(offset));
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        offset += written;
+        length -= written;
+    }
+    return true;
+}
+
+/**
+ * Seals a filled memfd read-only and wraps it in a buffer; takes ownership of the fd
+ * @param fd The memfd
+ * @param length Size of the memfd
+ * @return The buffer, or null on failure (the fd is closed)
+ */
+static std::shared_ptr<const ContentBuffer> wrapMemfd(int fd, size_t length) {
+    void* mapping = MAP_FAILED;
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == 0) {
+        mapping = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    if (mapping == MAP_FAILED) {
+        close(fd);
+        return nullptr;
+    }
+
+    auto buffer = std::make_shared<ContentBuffer>(std::string());
+    buffer->memfd = fd;
+    buffer->mapping = static_cast<const char*>(mapping);
+    buffer->mappedLength = length;
+    return buffer;
+}
+
+ContentBuffer::~ContentBuffer() {
+    if (mapping) {
+        munmap(const_cast<char*>(mapping), mappedLength);
+    }
+    if (memfd >= 0) {
+        close(memfd);
+    }
+}
+
+std::shared_ptr<const ContentBuffer> ContentBuffer::mapFile(int fd, size_t length) {
+    // Private so the page cache copy is never written, even by mistake
+    void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+
+    auto buffer = std::make_shared<ContentBuffer>(std::string());
+    buffer->mapping = static_cast<const char*>(mapping);
+    buffer->mappedLength = length;
+    return buffer;
+}
+
+std::shared_ptr<const ContentBuffer> ContentBuffer::createSealed(const char* data, size_t length) {
+    int fd = createMemfd(length);
+    if (fd < 0) {
+        return nullptr;
+    }
+    if (!writeMemfd(fd, 0, data, length)) {
+        close(fd);
+        return nullptr;
+    }
+    return wrapMemfd(fd, length);
+}
+
+void FileContent::setMemfdThreshold(size_t bytes) {
+    memfdThresholdBytes.store(bytes, std::memory_order_relaxed);
+}
+
+size_t FileContent::memfdThreshold() {
+    return memfdThresholdBytes.load(std::memory_order_relaxed);
+}
+
+std::shared_ptr<const ContentBuffer> FileContent::createBuffer(const char* data, size_t length) {
+    size_t threshold = memfdThreshold();
+    if (threshold != 0 && length >= threshold) {
+        auto buffer = ContentBuffer::createSealed(data, length);
+        if (buffer) {
+            return buffer;
+        }
+    }
+    return std::make_shared<const ContentBuffer>(std::string(data, length));
+}
+
+void FileContent::assign(std::string bytes) {
+    hashValid = false;
+    extents.clear();
+    logicalSize = 0;
+    append(std::move(bytes));
+}
+
+void FileContent::append(std::string bytes) {
+    if (bytes.empty()) {
+        return;
+    }
+    hashValid = false;
+    size_t length = bytes.size();
+    size_t threshold = memfdThreshold();
+    std::shared_ptr<const ContentBuffer> buffer;
+    if (threshold != 0 && length >= threshold) {
+        buffer = ContentBuffer::createSealed(bytes.data(), length);
+    }
+    if (!buffer) {
+        buffer = std::make_shared<const ContentBuffer>(std::move(bytes));
+    }
+    extents[logicalSize] = ContentExtent{std::move(buffer), 0, length};
+    logicalSize += length;
+}
+
+void FileContent::assign(std::shared_ptr<const ContentBuffer> buffer) {
+    size_t length = buffer->size();
+    assign(std::move(buffer), 0, length);
+}
+
+void FileContent::assign(std::shared_ptr<const ContentBuffer> buffer, size_t offset, size_t length) {
+    hashValid = false;
+    extents.clear();
+    logicalSize = length;
+    if (length != 0) {
+        extents[0] = ContentExtent{std::move(buffer), offset, length};
+    }
+}
+
+void FileContent::punch(uint64_t begin, uint64_t end) {
+    // Start at the last extent beginning at or before 'begin', it may overlap
+    auto it = extents.upper_bound(begin);
+    if (it != extents.begin()) {
+        --it;
+    }
+
+    while (it != extents.end() && it->first < end) {
+        uint64_t extentBegin = it->first;
+        uint64_t extentEnd = extentBegin + it->second.length;
+        if (extentEnd <= begin) {
+            ++it;
+            continue;
+        }
+
+        ContentExtent old = it->second;
+        it = extents.erase(it);
+
+        // Keep the parts of the old extent on either side of the range
+        if (extentBegin < begin) {
+            extents[extentBegin] = ContentExtent{old.buffer, old.bufferOffset,
+                                                 static_cast<size_t>(begin - extentBegin)};
+        }
+        if (extentEnd > end) {
+            extents[end] = ContentExtent{old.buffer, old.bufferOffset + static_cast<size_t>(end - extentBegin),
+                                         static_cast<size_t>(extentEnd - end)};
+        }
+    }
+}
+
+bool FileContent::write(uint64_t offset, const char* data, size_t length) {
+    if (length > UINT64_MAX - offset) {
+        return false;
+    }
+    if (length == 0) {
+        return true;
+    }
+
+    hashValid = false;
+    uint64_t end = offset + length;
+    punch(offset, end);
+    extents[offset] = ContentExtent{createBuffer(data, length), 0, length};
+    logicalSize = std::max(logicalSize, end);
+    return true;
+}
+
+void FileContent::truncate(uint64_t newSize) {
+    hashValid = false;
+    if (newSize < logicalSize) {
+        punch(newSize, logicalSize);
+    }
+    logicalSize = newSize;
+}
+
+std::string FileContent::read(uint64_t offset, uint64_t length) const {
+    if (offset >= logicalSize) {
+        return std::string();
+    }
+    uint64_t end = offset + std::min(length, logicalSize - offset);
+    std::string result(static_cast<size_t>(end - offset), '\0');
+
+    auto it = extents.upper_bound(offset);
+    if (it != extents.begin()) {
+        --it;
+    }
+    for (; it != extents.end() && it->first < end; ++it) {
+        uint64_t extentBegin = it->first;
+        uint64_t extentEnd = extentBegin + it->second.length;
+        uint64_t copyBegin = std::max(offset, extentBegin);
+        uint64_t copyEnd = std::min(end, extentEnd);
+        if (copyBegin < copyEnd) {
+            std::memcpy(&result[copyBegin - offset], it->second.data() + (copyBegin - extentBegin),
+                        static_cast<size_t>(copyEnd - copyBegin));
+        }
+    }
+    return result;
+}
+
+/**
+ * Writes gathered vectors to a descriptor, IOV_MAX at a time, retrying short writes
+ * @return True if every byte was written; the vectors are consumed either way
+ */
+static bool writeVectors(int fd, std::vector<iovec>& vectors) {
+    size_t first = 0;
+    bool ok = true;
+    while (ok && first < vectors.size()) {
+        int count = static_cast<int>(std::min<size_t>(vectors.size() - first, IOV_MAX));
+        ssize_t written = writev(fd, &vectors[first], count);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        ok = written > 0;
+        for (size_t remaining = ok ? static_cast<size_t>(written) : 0; remaining > 0;) {
+            size_t consumed = std::min(remaining, vectors[first].iov_len);
+            vectors[first].iov_base = static_cast<char*>(vectors[first].iov_base) + consumed;
+            vectors[first].iov_len -= consumed;
+            remaining -= consumed;
+            first += vectors[first].iov_len == 0;
+        }
+    }
+    vectors.clear();
+    return ok;
+}
+
+/**
+ * Sends a range of a memfd to a descriptor through the page cache
+ * @return 1 if sent, 0 if the descriptor does not accept sendfile, -1 on error
+ */
+static int sendMemfd(int fd, int memfd, uint64_t offset, size_t length) {
+    off_t position = static_cast<off_t>(offset);
+    bool started = false;
+    while (length > 0) {
+        ssize_t sent = sendfile(fd, memfd, &position, length);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return !started && (errno == EINVAL || errno == ENOSYS) ? 0 : -1;
+        }
+        started = true;
+        length -= static_cast<size_t>(sent);
+    }
+    return 1;
+}
+
+bool FileContent::writeTo(int fd, uint64_t offset, uint64_t length) const {
+    static const char zeroPage[1 << 16] = {};
+    if (offset >= logicalSize) {
+        return true;
+    }
+    uint64_t end = std::min(logicalSize, offset + length);
+    std::vector<iovec> vectors;
+    auto gather = [&](const char* data, uint64_t runLength) {
+        while (runLength > 0) {
+            size_t chunk = static_cast<size_t>(std::min<uint64_t>(runLength, data ? SSIZE_MAX : sizeof(zeroPage)));
+            vectors.push_back(iovec{const_cast<char*>(data ? data : zeroPage), chunk});
+            data = data ? data + chunk : nullptr;
+            runLength -= chunk;
+        }
+    };
+
+    auto it = extents.upper_bound(offset);
+    if (it != extents.begin()) {
+        --it;
+    }
+    uint64_t position = offset;
+    bool useSendfile = true;
+    for (; position < end; ++it) {
+        uint64_t extentBegin = it != extents.end() ? it->first : end;
+        if (extentBegin > position) {
+            gather(nullptr, std::min(extentBegin, end) - position);
+            position = std::min(extentBegin, end);
+            if (position == end) {
+                break;
+            }
+        }
+        uint64_t runEnd = std::min(end, extentBegin + it->second.length);
+        if (runEnd <= position) {
+            continue;
+        }
+
+        const ContentExtent& extent = it->second;
+        uint64_t skip = position - extentBegin;
+        size_t runLength = static_cast<size_t>(runEnd - position);
+        if (useSendfile && extent.buffer->sealed()) {
+            if (!writeVectors(fd, vectors)) {
+                return false;
+            }
+            int sent = sendMemfd(fd, extent.buffer->memfd, extent.bufferOffset + skip, runLength);
+            if (sent < 0) {
+                return false;
+            }
+            useSendfile = sent > 0;
+            if (sent == 0) {
+                gather(extent.data() + skip, runLength);
+            }
+        } else {
+            gather(extent.data() + skip, runLength);
+        }
+        position = runEnd;
+    }
+    return writeVectors(fd, vectors);
+}
+
+/**
+ * Hashes one block of content
+ */
+static uint64_t hashBlock(const char* data, size_t length) {
+    return std::hash<std::string_view>()(std::string_view(data, length));
+}
+
+uint64_t FileContent::contentHash() const {
+    if (hashValid) {
+        return cachedHash;
+    }
+    static const std::string zeroBlock(kHashBlockBytes, '\0');
+    static const uint64_t zeroBlockHash = hashBlock(zeroBlock.data(), zeroBlock.size());
+
+    // Whole blocks inside one run are hashed in place, holes without reading
+    // anything; only blocks that straddle runs are staged
+    uint64_t hash = mixHash(logicalSize);
+    std::string staging;
+    forEachRun([&](uint64_t, const char* data, uint64_t length) {
+        while (length > 0) {
+            size_t take;
+            if (staging.empty() && length >= kHashBlockBytes) {
+                take = kHashBlockBytes;
+                hash = mixHash(hash ^ (data ? hashBlock(data, take) : zeroBlockHash));
+            } else {
+                take = static_cast<size_t>(std::min<uint64_t>(length, kHashBlockBytes - staging.size()));
+                if (data) {
+                    staging.append(data, take);
+                } else {
+                    staging.append(take, '\0');
+                }
+                if (staging.size() == kHashBlockBytes) {
+                    hash = mixHash(hash ^ hashBlock(staging.data(), staging.size()));
+                    staging.clear();
+                }
+            }
+            data = data ? data + take : nullptr;
+            length -= take;
+        }
+    });
+    if (!staging.empty()) {
+        hash = mixHash(hash ^ hashBlock(staging.data(), staging.size()));
+    }
+
+    cachedHash = hash;
+    hashValid = true;
+    return hash;
+}
+
+uint64_t FileContent::allocatedBytes() const {
+    std::unordered_set<const ContentBuffer*> seen;
+    uint64_t total = 0;
+    for (const auto& entry : extents) {
+        if (seen.insert(entry.second.buffer.get()).second) {
+            total += entry.second.buffer->size();
+        }
+    }
+    return total;
+}
+
+bool FileContent::hasHoles() const {
+    uint64_t position = 0;
+    for (const auto& entry : extents) {
+        if (entry.first != position) {
+            return true;
+        }
+        position = entry.first + entry.second.length;
+    }
+    return position != logicalSize;
+}
+
+std::shared_ptr<const ContentBuffer> FileContent::sealedBuffer() {
+    if (logicalSize == 0) {
+        return nullptr;
+    }
+
+    // Already one sealed buffer that is exactly the file
+    if (extents.size() == 1) {
+        const ContentExtent& only = extents.begin()->second;
+        if (extents.begin()->first == 0 && only.bufferOffset == 0 && only.length == logicalSize &&
+            only.buffer->sealed() && only.buffer->size() == logicalSize) {
+            return only.buffer;
+        }
+    }
+
+    int fd = createMemfd(static_cast<size_t>(logicalSize));
+    if (fd < 0) {
+        return nullptr;
+    }
+    for (const auto& entry : extents) {
+        if (!writeMemfd(fd, entry.first, entry.second.data(), entry.second.length)) {
+            close(fd);
+            return nullptr;
+        }
+    }
+    auto buffer = wrapMemfd(fd, static_cast<size_t>(logicalSize));
+    if (buffer) {
+        extents.clear();
+        extents[0] = ContentExtent{buffer, 0, static_cast<size_t>(logicalSize)};
+    }
+    return buffer;
+}
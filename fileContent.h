@@ -0,0 +1,252 @@
+#ifndef FILE_CONTENT_H
+#define FILE_CONTENT_H
+
+#include <cstdint>      // For fixed-width integers
+#include <map>          // For the ordered extent index
+#include <memory>       // For shared buffers
+#include <string>       // For string manipulation
+
+/**
+ * Scrambles a 64-bit value (the splitmix64 finalizer), used to chain and
+ * combine content and tree hashes
+ */
+inline uint64_t mixHash(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+/**
+ * Immutable block of file bytes. Buffers are shared between extents (and,
+ * through copies of FileContent, between files) and never modified once
+ * created, so sharing one is always safe.
+ *
+ * A buffer lives on the heap, in a memfd sealed against writes, shrinking
+ * and growing, or in a read-only mapping of a host file. A sealed memfd can
+ * be handed to other processes, which map it and read the bytes without
+ * copies; the seals guarantee they can't change them. A host file mapping
+ * keeps the bytes in the page cache; the file must not change while mapped.
+ */
+struct ContentBuffer {
+    std::string bytes;              // Heap storage, empty for mapped buffers
+    int memfd;                      // Sealed memfd holding the bytes, -1 otherwise
+    const char* mapping;            // Read-only mapping of the memfd or host file, null for heap buffers
+    size_t mappedLength;            // Length of the mapping
+
+    explicit ContentBuffer(std::string value)
+        : bytes(std::move(value)), memfd(-1), mapping(nullptr), mappedLength(0) {}
+    ~ContentBuffer();
+
+    ContentBuffer(const ContentBuffer&) = delete;
+    ContentBuffer& operator=(const ContentBuffer&) = delete;
+
+    /**
+     * Creates a buffer in a new sealed memfd
+     * @param data The bytes to store
+     * @param length Number of bytes, must not be 0
+     * @return The buffer, or null if the memfd could not be created
+     */
+    static std::shared_ptr<const ContentBuffer> createSealed(const char* data, size_t length);
+
+    /**
+     * Creates a buffer that maps a host file read-only
+     * @param fd Open descriptor of the file; the mapping outlives it
+     * @param length Size of the file, must not be 0
+     * @return The buffer, or null with errno set if the file could not be mapped
+     */
+    static std::shared_ptr<const ContentBuffer> mapFile(int fd, size_t length);
+
+    const char* data() const { return mapping ? mapping : bytes.data(); }
+    size_t size() const { return mapping ? mappedLength : bytes.size(); }
+    bool sealed() const { return memfd >= 0; }
+    bool hostMapped() const { return mapping && memfd < 0; }
+};
+
+/**
+ * A run of file bytes backed by a slice of a buffer
+ */
+struct ContentExtent {
+    std::shared_ptr<const ContentBuffer> buffer;
+    size_t bufferOffset;            // Start of the slice within the buffer
+    size_t length;                  // Length of the slice
+
+    const char* data() const { return buffer->data() + bufferOffset; }
+};
+
+/**
+ * Hole-aware file content.
+ *
+ * The file is a logical size plus a set of non-overlapping extents keyed by
+ * their offset. Ranges not covered by an extent are holes: they take no
+ * memory and read as zeros, so a file can be truncated to gigabytes and
+ * written sparsely. Writes never modify an existing buffer; they trim the
+ * extents they overlap and add a new one, which makes copies of a
+ * FileContent cheap copy-on-write snapshots.
+ */
+class FileContent {
+public:
+    FileContent() : logicalSize(0), cachedHash(0), hashValid(false) {}
+    explicit FileContent(std::string bytes) : FileContent() { assign(std::move(bytes)); }
+
+    /**
+     * Replaces the whole content with the given bytes
+     * @param bytes The new content, moved into the file's storage
+     */
+    void assign(std::string bytes);
+
+    /**
+     * Replaces the whole content with an existing buffer, without copying
+     * @param buffer The buffer, which becomes the file's only extent
+     */
+    void assign(std::shared_ptr<const ContentBuffer> buffer);
+
+    /**
+     * Replaces the whole content with a slice of an existing buffer, without copying
+     * @param buffer The buffer holding the slice
+     * @param offset Start of the slice within the buffer
+     * @param length Length of the slice, which becomes the file size
+     */
+    void assign(std::shared_ptr<const ContentBuffer> buffer, size_t offset, size_t length);
+
+    /**
+     * Adds bytes at the end of the file as a new extent
+     * @param bytes The bytes, moved into the file's storage
+     */
+    void append(std::string bytes);
+
+    /**
+     * Writes bytes at an offset, extending the file if needed
+     * @param offset Logical offset of the first byte
+     * @param data The bytes to write
+     * @param length Number of bytes to write
+     * @return False if the range ends past the largest offset, in which case nothing is written
+     */
+    bool write(uint64_t offset, const char* data, size_t length);
+
+    /**
+     * Changes the logical size; growing adds a hole, shrinking drops data
+     * @param newSize The new logical size in bytes
+     */
+    void truncate(uint64_t newSize);
+
+    /**
+     * Reads a range of the file, filling holes with zeros
+     * @param offset Logical offset of the first byte
+     * @param length Maximum number of bytes to read
+     * @return The bytes read, shorter than length at end of file
+     */
+    std::string read(uint64_t offset, uint64_t length) const;
+
+    /**
+     * Returns the whole content as one string, holes as zeros
+     */
+    std::string toString() const { return read(0, logicalSize); }
+
+    /**
+     * Writes a range of the file to a descriptor without staging it in a
+     * buffer: runs in sealed memfds are sent with sendfile, the rest with
+     * writev straight from the extents, holes from a shared zero page
+     * @param fd The descriptor to write to (file, pipe or socket)
+     * @param offset Logical offset of the first byte
+     * @param length Maximum number of bytes to write
+     * @return True if every byte of the range was written
+     */
+    bool writeTo(int fd, uint64_t offset, uint64_t length) const;
+
+    /**
+     * Visits the file in order as data runs and holes covering [0, size())
+     * @param visit Called as visit(offset, data, length); data is null for holes
+     */
+    template <typename Visitor>
+    void forEachRun(Visitor visit) const {
+        uint64_t position = 0;
+        for (const auto& entry : extents) {
+            if (entry.first > position) {
+                visit(position, static_cast<const char*>(nullptr), entry.first - position);
+            }
+            visit(entry.first, entry.second.data(), static_cast<uint64_t>(entry.second.length));
+            position = entry.first + entry.second.length;
+        }
+        if (position < logicalSize) {
+            visit(position, static_cast<const char*>(nullptr), logicalSize - position);
+        }
+    }
+
+    /**
+     * Visits each distinct buffer referenced by the file
+     * @param visit Called once per buffer with a const ContentBuffer&
+     */
+    template <typename Visitor>
+    void forEachBuffer(Visitor visit) const {
+        const ContentBuffer* previous = nullptr;
+        for (const auto& entry : extents) {
+            // Extents of one buffer are usually adjacent; skip repeats cheaply
+            if (entry.second.buffer.get() != previous) {
+                previous = entry.second.buffer.get();
+                visit(*previous);
+            }
+        }
+    }
+
+    uint64_t size() const { return logicalSize; }
+    bool empty() const { return logicalSize == 0; }
+    size_t extentCount() const { return extents.size(); }
+
+    /**
+     * Returns a hash of the bytes of the file. It is computed over fixed
+     * logical blocks, so it depends only on the content, not on how it is
+     * split into extents or whether zeros are stored or holes. The result
+     * is cached until the next modification and carried by copies.
+     */
+    uint64_t contentHash() const;
+
+    /**
+     * Returns the bytes of buffer memory the file references
+     */
+    uint64_t allocatedBytes() const;
+
+    /**
+     * Returns true if any part of the file is a hole
+     */
+    bool hasHoles() const;
+
+    /**
+     * Returns a sealed memfd buffer holding exactly the whole file. If the
+     * file is stored any other way its content is first moved into one, with
+     * holes left unallocated in the memfd.
+     * @return The buffer, or null if the file is empty or no memfd could be created
+     */
+    std::shared_ptr<const ContentBuffer> sealedBuffer();
+
+    /**
+     * Sets the size from which new buffers are stored in sealed memfds
+     * instead of on the heap, for all files
+     * @param bytes Minimum buffer size, 0 to keep all buffers on the heap
+     */
+    static void setMemfdThreshold(size_t bytes);
+
+    /**
+     * Returns the current memfd threshold, 0 when memfd storage is off
+     */
+    static size_t memfdThreshold();
+
+private:
+    /**
+     * Removes extent coverage of [begin, end), keeping the parts outside it
+     */
+    void punch(uint64_t begin, uint64_t end);
+
+    /**
+     * Creates a buffer for new bytes, in a memfd when they reach the threshold
+     */
+    static std::shared_ptr<const ContentBuffer> createBuffer(const char* data, size_t length);
+
+    std::map<uint64_t, ContentExtent> extents;   // Keyed by logical offset
+    uint64_t logicalSize;
+    mutable uint64_t cachedHash;                 // Result of contentHash(), valid if hashValid
+    mutable bool hashValid;
+};
+
+#endif // FILE_CONTENT_H
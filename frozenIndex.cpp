@@ -0,0 +1,175 @@
+// Compact, perfect-hashed name index for frozen subtrees
+#include "frozenIndex.h"
+#include "fileContent.h"
+#include <algorithm>    // For standard algorithms
+#include <functional>   // For hashing names
+#include <numeric>      // For iota
+
+// Names per front-coding block; the first name of a block is stored in full
+static const size_t kNamesPerBlock = 16;
+
+// Average number of names per hash bucket
+static const size_t kNamesPerBucket = 2;
+
+// Seeds tried per name before the build gives up; a bucket placed when
+// only one slot is left needs about as many tries as there are names
+static const uint64_t kSeedsPerName = 64;
+
+/**
+ * Appends an unsigned value in LEB128 form
+ */
+static void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+/**
+ * Reads an unsigned value in LEB128 form; the input was written by putVarint
+ */
+static uint64_t getVarint(const std::string& in, size_t& position) {
+    uint64_t value = 0;
+    for (unsigned shift = 0;; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(in[position++]);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+}
+
+/**
+ * Returns two independent hashes of a name; names that only differ in
+ * one of them still get distinct slots for some seed
+ */
+static void hashName(std::string_view name, uint64_t& primary, uint64_t& secondary) {
+    primary = mixHash(std::hash<std::string_view>()(name));
+    uint64_t fnv = 0xcbf29ce484222325ULL;
+    for (char c : name) {
+        fnv = (fnv ^ static_cast<uint8_t>(c)) * 0x100000001b3ULL;
+    }
+    secondary = mixHash(fnv) | 1;
+}
+
+size_t FrozenNameIndex::slotOf(uint64_t primary, uint64_t secondary, uint32_t seed) const {
+    return static_cast<size_t>(mixHash(primary + seed * secondary) % count);
+}
+
+bool FrozenNameIndex::build(const std::vector<std::string_view>& names) {
+    count = names.size();
+    encodedNames.clear();
+    blockOffsets.clear();
+    seeds.clear();
+    slotPositions.clear();
+    if (count == 0) {
+        return true;
+    }
+
+    std::string_view previous;
+    for (size_t position = 0; position < count; ++position) {
+        std::string_view name = names[position];
+        size_t shared = 0;
+        if (position % kNamesPerBlock == 0) {
+            blockOffsets.push_back(encodedNames.size());
+        } else {
+            size_t limit = std::min(previous.size(), name.size());
+            while (shared < limit && previous[shared] == name[shared]) {
+                shared++;
+            }
+        }
+        putVarint(encodedNames, shared);
+        putVarint(encodedNames, name.size() - shared);
+        encodedNames.append(name.data() + shared, name.size() - shared);
+        previous = name;
+    }
+    encodedNames.shrink_to_fit();
+
+    // Hash every name into a bucket, then place the largest buckets first,
+    // each with the first seed that sends all its names to free slots
+    std::vector<uint64_t> primaries(count), secondaries(count);
+    size_t bucketCount = (count + kNamesPerBucket - 1) / kNamesPerBucket;
+    std::vector<std::vector<uint32_t>> buckets(bucketCount);
+    for (size_t position = 0; position < count; ++position) {
+        hashName(names[position], primaries[position], secondaries[position]);
+        buckets[primaries[position] % bucketCount].push_back(static_cast<uint32_t>(position));
+    }
+    std::vector<uint32_t> order(bucketCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    uint64_t maxSeed = std::min<uint64_t>(UINT32_MAX, count * kSeedsPerName + 1024);
+    seeds.assign(bucketCount, 0);
+    slotPositions.assign(count, UINT32_MAX);
+    std::vector<size_t> slots;
+    for (uint32_t bucket : order) {
+        const auto& members = buckets[bucket];
+        if (members.empty()) {
+            break;
+        }
+
+        uint32_t seed = 0;
+        for (;; ++seed) {
+            if (seed == maxSeed) {
+                return false;
+            }
+            slots.clear();
+            bool placed = true;
+            for (uint32_t position : members) {
+                size_t slot = slotOf(primaries[position], secondaries[position], seed);
+                if (slotPositions[slot] != UINT32_MAX || std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+                    placed = false;
+                    break;
+                }
+                slots.push_back(slot);
+            }
+            if (placed) {
+                break;
+            }
+        }
+        seeds[bucket] = seed;
+        for (size_t i = 0; i < members.size(); ++i) {
+            slotPositions[slots[i]] = members[i];
+        }
+    }
+    return true;
+}
+
+void FrozenNameIndex::decode(size_t position, std::string& name) const {
+    size_t offset = static_cast<size_t>(blockOffsets[position / kNamesPerBlock]);
+    for (size_t current = position - position % kNamesPerBlock; current <= position; ++current) {
+        size_t shared = static_cast<size_t>(getVarint(encodedNames, offset));
+        size_t suffix = static_cast<size_t>(getVarint(encodedNames, offset));
+        name.resize(shared);
+        name.append(encodedNames, offset, suffix);
+        offset += suffix;
+    }
+}
+
+size_t FrozenNameIndex::find(std::string_view name) const {
+    if (count == 0) {
+        return npos;
+    }
+    uint64_t primary, secondary;
+    hashName(name, primary, secondary);
+    size_t position = slotPositions[slotOf(primary, secondary, seeds[primary % seeds.size()])];
+
+    // Names not in the set land on some slot too; compare to be sure
+    thread_local std::string candidate;
+    decode(position, candidate);
+    return candidate == name ? position : npos;
+}
+
+std::string FrozenNameIndex::name(size_t position) const {
+    std::string result;
+    decode(position, result);
+    return result;
+}
+
+size_t FrozenNameIndex::memoryUsage() const {
+    return encodedNames.capacity() + blockOffsets.capacity() * sizeof(uint64_t) +
+           seeds.capacity() * sizeof(uint32_t) + slotPositions.capacity() * sizeof(uint32_t);
+}
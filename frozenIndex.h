@@ -0,0 +1,72 @@
+#ifndef FROZEN_INDEX_H
+#define FROZEN_INDEX_H
+
+#include <cstddef>      // For size_t
+#include <cstdint>      // For fixed-width integers
+#include <string>       // For string manipulation
+#include <string_view>  // For non-owning views of names
+#include <vector>       // For dynamic arrays
+
+/**
+ * Immutable, compact set of names with constant-time lookup.
+ *
+ * Names keep the order they were given in and are front coded: each name
+ * stores only the bytes that differ from the previous one, and every 16th
+ * name is stored in full so any name can be decoded from its block. A
+ * minimal perfect hash (hash and displace: one seed per bucket of about
+ * two names) maps each name to a distinct slot, and the slot to its
+ * position, so a lookup costs two hashes and decoding part of one block.
+ * Nothing is modified after build, so any number of threads can look up
+ * names without locks.
+ */
+class FrozenNameIndex {
+public:
+    static const size_t npos = SIZE_MAX;
+
+    /**
+     * Builds the index; sorted names share the longest prefixes
+     * @param names The names, which must be distinct
+     * @return False if no perfect hash was found, e.g. for duplicate names
+     */
+    bool build(const std::vector<std::string_view>& names);
+
+    /**
+     * Finds a name
+     * @param name The name to look up
+     * @return Its position in the order given to build, or npos
+     */
+    size_t find(std::string_view name) const;
+
+    /**
+     * Decodes the name at a position
+     * @param position Position in the order given to build
+     * @return The name
+     */
+    std::string name(size_t position) const;
+
+    size_t size() const { return count; }
+
+    /**
+     * Returns the heap bytes held by the index
+     */
+    size_t memoryUsage() const;
+
+private:
+    /**
+     * Decodes the name at a position into a buffer, reusing its capacity
+     */
+    void decode(size_t position, std::string& name) const;
+
+    /**
+     * Returns the slot of a name for a bucket seed
+     */
+    size_t slotOf(uint64_t primary, uint64_t secondary, uint32_t seed) const;
+
+    std::string encodedNames;               // Front-coded names: shared length, suffix length, suffix
+    std::vector<uint64_t> blockOffsets;     // Offset of every 16th name within encodedNames
+    std::vector<uint32_t> seeds;            // Displacement seed of every hash bucket
+    std::vector<uint32_t> slotPositions;    // Position of the name in every slot
+    size_t count = 0;
+};
+
+#endif // FROZEN_INDEX_H
@@ -0,0 +1,167 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>       // For lock-free counters
+#include <cstdint>      // For fixed-width integers
+#include <cstddef>      // For size_t
+
+/**
+ * Log-linear latency histogram in the style of HdrHistogram.
+ *
+ * Values below 64 get an exact bucket each; above that, every power of two
+ * is split into 32 linear sub-buckets, so any recorded value is reported
+ * within ~3% of its true value. Counters are relaxed atomics, so one thread
+ * can record while another reads a consistent-enough view for reporting.
+ */
+class LatencyHistogram {
+public:
+    static const int kSubBucketBits = 5;
+    static const uint64_t kSubBucketCount = 1ULL << kSubBucketBits;
+    static const int kMaxValueBits = 44;  // ~4.9 hours in nanoseconds
+    // One extra bucket at the end collects values beyond kMaxValueBits
+    static const size_t kBucketCount = (kMaxValueBits - kSubBucketBits + 1) * kSubBucketCount + 1;
+
+    LatencyHistogram() {
+        reset();
+    }
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    /**
+     * Records a single value
+     * @param value The value to record, typically nanoseconds
+     */
+    void record(uint64_t value) {
+        counts[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+        uint64_t currentMax = maximum.load(std::memory_order_relaxed);
+        while (value > currentMax &&
+               !maximum.compare_exchange_weak(currentMax, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    /**
+     * Adds all counts from another histogram into this one
+     * @param other The histogram to merge
+     */
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            uint64_t c = other.counts[i].load(std::memory_order_relaxed);
+            if (c != 0) {
+                counts[i].fetch_add(c, std::memory_order_relaxed);
+            }
+        }
+        total.fetch_add(other.count(), std::memory_order_relaxed);
+        sum.fetch_add(other.sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        uint64_t otherMax = other.max();
+        uint64_t currentMax = maximum.load(std::memory_order_relaxed);
+        while (otherMax > currentMax &&
+               !maximum.compare_exchange_weak(currentMax, otherMax, std::memory_order_relaxed)) {
+        }
+    }
+
+    /**
+     * Clears all recorded values
+     */
+    void reset() {
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            counts[i].store(0, std::memory_order_relaxed);
+        }
+        total.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+        maximum.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t max() const { return maximum.load(std::memory_order_relaxed); }
+    uint64_t sumOfValues() const { return sum.load(std::memory_order_relaxed); }
+
+    double mean() const {
+        uint64_t n = count();
+        return n == 0 ? 0.0 : static_cast<double>(sum.load(std::memory_order_relaxed)) / n;
+    }
+
+    /**
+     * Returns the value at the given percentile
+     * @param percentile Percentile in the range [0, 100]
+     * @return Upper bound of the bucket holding that percentile
+     */
+    uint64_t percentile(double percentile) const {
+        uint64_t n = count();
+        if (n == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * n + 0.5);
+        if (rank == 0) {
+            rank = 1;
+        }
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                uint64_t upper = bucketUpperBound(i);
+                return upper < max() ? upper : max();
+            }
+        }
+        return max();
+    }
+
+    /**
+     * Returns the number of values recorded in a bucket
+     * @param index The bucket index
+     */
+    uint64_t bucketCount(size_t index) const {
+        return counts[index].load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Maps a value to its bucket index
+     * @param value The value to map
+     * @return Index in the range [0, kBucketCount)
+     */
+    static size_t bucketIndex(uint64_t value) {
+        if (value < 2 * kSubBucketCount) {
+            return static_cast<size_t>(value);
+        }
+        int msb = 63 - __builtin_clzll(value);
+        if (msb >= kMaxValueBits) {
+            return kBucketCount - 1;
+        }
+        int shift = msb - kSubBucketBits;
+        return static_cast<size_t>(shift) * kSubBucketCount + static_cast<size_t>(value >> shift);
+    }
+
+    /**
+     * Returns the smallest value that maps to a bucket
+     * @param index The bucket index
+     */
+    static uint64_t bucketLowerBound(size_t index) {
+        if (index < 2 * kSubBucketCount) {
+            return index;
+        }
+        uint64_t shift = index / kSubBucketCount - 1;
+        uint64_t top = index % kSubBucketCount + kSubBucketCount;
+        return top << shift;
+    }
+
+    /**
+     * Returns the largest value that maps to a bucket
+     * @param index The bucket index
+     */
+    static uint64_t bucketUpperBound(size_t index) {
+        if (index + 1 >= kBucketCount) {
+            return UINT64_MAX;
+        }
+        return bucketLowerBound(index + 1) - 1;
+    }
+
+private:
+    std::atomic<uint64_t> counts[kBucketCount];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> maximum;
+};
+
+#endif // LATENCY_HISTOGRAM_H
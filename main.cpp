@@ -0,0 +1,42 @@
+#include "memFS.h"
+#include "server.h"
+#include <iostream>     // For input/output operations
+#include <string>       // For string manipulation
+
+/**
+ * Main function to run the memory file system
+ */
+int main(int argc, char** argv) {
+    std::string command;
+    
+    // Initialize the file system with root directory
+    initializeFileSystem();
+    
+    // Serve local clients instead of running the interactive shell
+    if (argc == 3 && std::string(argv[1]) == "--serve") {
+        return runServer(argv[2]);
+    }
+    if (argc != 1) {
+        std::cerr << "Usage: " << argv[0] << " [--serve <socket_path>]\n";
+        return 1;
+    }
+    
+    std::cout << "Memory File System v1.0\n";
+    std::cout << "Type 'help' for available commands, 'exit' to quit.\n";
+    
+    while (true) {
+        std::cout << currentSession().currentDirectory << "> ";
+        
+        // Stop at end of input so piped sessions terminate
+        if (!std::getline(std::cin, command)) {
+            break;
+        }
+        
+        if (!executeCommand(command)) {
+            break;
+        }
+    }
+    
+    std::cout << "Exiting Memory File System. Goodbye!\n";
+    return 0;
+}
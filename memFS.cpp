@@ -1,6 +1,8 @@
 // Include necessary standard libraries
+#include "memFS.h"
 #include <iostream>     // For input/output operations
 #include <string>       // For string manipulation
+#include <string_view>  // For non-owning token views
 #include <unordered_map> // For hash map implementation
 #include <vector>       // For dynamic arrays
 #include <sstream>      // For string stream processing
@@ -8,60 +10,484 @@
 #include <iomanip>      // For input/output manipulation
 #include <thread>       // For multi-threading support
 #include <mutex>        // For thread synchronization
+#include <condition_variable> // For waking the reclaimer and copy threads
+#include <functional>   // For the tasks of the copy threads
+#include <deque>        // For the reclamation queue
+#include <map>          // For pairing directory entries by name
 #include <fstream>      // For file operations
 #include <ctime>        // For C-style time functions
 #include <algorithm>    // For standard algorithms
+#include <unordered_set> // For deduplicating shared buffers
+#include <cctype>       // For character classification
 #include <filesystem>   // For path manipulation
+#include <atomic>       // For lock-free flags
+#include <malloc.h>     // For heap introspection (glibc)
+#include <unistd.h>     // For sysconf and getpid
+#include <fcntl.h>      // For duplicating shared memfds and opening host files
+#include <sys/stat.h>   // For sizing attached host files
+#include <cstring>      // For strerror
+#include <cerrno>       // For errno
+#include "traceFormat.h"
+#include "metrics.h"
+#include "tracing.h"
+#include "fileContent.h"
+#include "contentDelta.h"
+#include "frozenIndex.h"
 
 /**
  * Enum representing the type of entry in the file system
  */
 enum class EntryType {
     FILE,
-    DIRECTORY
+    DIRECTORY,
+    SYMLINK
+};
+
+// Extended attributes of an inode as (key, value) pairs sorted by key
+typedef std::vector<std::pair<std::string, std::string>> XattrList;
+
+/**
+ * An earlier version of a file, stored as a delta that rebuilds it from
+ * the next newer version
+ */
+struct FileVersion {
+    std::string delta;             // Delta from the next newer version to this one
+    uint64_t size;                 // Size of this version in bytes
+    std::string modificationDate;  // Date this version was written
+};
+
+/**
+ * Version history of a file, kept only for files it was enabled on. The
+ * newest content is kept as a copy-on-write copy that shares its buffers
+ * with the file, so only the deltas to older versions cost memory.
+ */
+struct FileHistory {
+    size_t limit;                  // Maximum number of earlier versions kept
+    FileContent latest;            // Content the newest delta is relative to
+    std::string latestDate;        // Date the latest content was written
+    std::deque<FileVersion> versions;  // Earlier versions, newest first
 };
 
 /**
- * Structure representing an entry in the memory file system
+ * Structure representing an inode in the memory file system. Every path in
+ * the index points to one; hard links are several paths sharing the same
+ * FSEntry, so writes through any name are visible through all of them.
  */
 struct FSEntry {
-    std::string data;              // Content of the file (empty for directories)
+    FileContent data;              // Content of the file, may contain holes (empty for directories)
     size_t sizeInBytes;            // Size of the file in bytes (0 for directories)
     std::string creationDate;      // Date when the entry was created
     std::string modificationDate;  // Date when the entry was last modified
-    EntryType type;                // Type of entry (file or directory)
+    EntryType type;                // Type of entry (file, directory or symbolic link)
+    std::string symlinkTarget;     // Path a symbolic link points to, stored as given (empty otherwise)
+    std::unique_ptr<XattrList> xattrs;  // Extended attributes, allocated on first use
+    std::unique_ptr<FileHistory> history;  // Earlier versions, allocated when history is enabled
+    uint64_t inodeNumber;          // Unique identifier of the inode
+    size_t linkCount;              // Number of paths referring to this inode
+    mutable uint64_t treeHash;     // Merkle hash of the entry and everything below it, valid if hashValid
+    mutable bool hashValid;        // Cleared along the path to the root whenever the subtree changes
 };
 
 // Global variables
-std::unordered_map<std::string, FSEntry> memoryFileSystem;  // Main data structure to store files and directories
-std::string currentDirectory = "/";                         // Current working directory
+std::unordered_map<std::string, std::shared_ptr<FSEntry>> memoryFileSystem;  // Path index: maps every path to its inode
 std::mutex fileSystemMutex;                                 // Mutex for thread-safe operations
+uint64_t nextInodeNumber = 1;                               // Next inode number to hand out (guarded by fileSystemMutex)
+size_t symlinkCount = 0;                                    // Symbolic links in the index (guarded by fileSystemMutex)
+size_t frozenSymlinkCount = 0;                              // Symbolic links in frozen subtrees (guarded by fileSystemMutex)
+uint64_t symlinkGeneration = 0;                             // Bumped whenever symlink resolution may change (guarded by fileSystemMutex)
+
+// Inverted index from "key=value" to the paths carrying that attribute, kept
+// only while enabled with xattrindex on (guarded by fileSystemMutex)
+bool xattrIndexEnabled = false;
+std::unordered_map<std::string, std::unordered_set<std::string>> xattrIndex;
+
+// Maximum number of symbolic links followed while resolving one path
+const size_t kMaxSymlinkHops = 40;
+
+// Resolved paths cached per thread; bounded so long-running threads don't grow without limit
+const size_t kResolutionCacheCapacity = 4096;
+
+/**
+ * Per-thread cache of symlink resolution results, discarded as a whole
+ * when its generation falls behind symlinkGeneration
+ */
+struct ResolutionCache {
+    uint64_t generation = 0;
+    std::unordered_map<std::string, std::string> followFinal;    // Final component followed
+    std::unordered_map<std::string, std::string> keepFinal;      // Final component kept as is
+};
+
+typedef std::unordered_map<std::string, std::shared_ptr<FSEntry>>::node_type DetachedNode;
+
+/**
+ * Frees detached index nodes on a background thread, so that removing a
+ * large subtree only relinks nodes under fileSystemMutex and the keys,
+ * inodes and payloads are released later without holding any lock
+ */
+class Reclaimer {
+public:
+    ~Reclaimer() {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        wakeup.notify_one();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    
+    /**
+     * Queues detached nodes for reclamation
+     * @param nodes The nodes, already removed from the index
+     * @param bytes Estimated heap bytes the nodes will release
+     */
+    void enqueue(std::vector<DetachedNode> nodes, size_t bytes) {
+        if (nodes.empty()) {
+            return;
+        }
+        pending.fetch_add(bytes, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            queue.push_back({std::move(nodes), bytes});
+            if (!worker.joinable()) {
+                worker = std::thread(&Reclaimer::run, this);
+            }
+        }
+        wakeup.notify_one();
+    }
+    
+    /**
+     * @return Estimated heap bytes still waiting to be freed
+     */
+    size_t pendingBytes() const {
+        return pending.load(std::memory_order_relaxed);
+    }
+    
+private:
+    // Nodes freed between checks of the queue, so long reclamations yield regularly
+    static const size_t kReclaimChunk = 1024;
+    
+    struct Batch {
+        std::vector<DetachedNode> nodes;
+        size_t bytes;
+    };
+    
+    void run() {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        for (;;) {
+            wakeup.wait(lock, [this]() { return stopping || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            Batch batch = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+            
+            // Free from the back in chunks; progress is reported pro rata by node count
+            size_t total = batch.nodes.size();
+            size_t released = 0;
+            while (!batch.nodes.empty()) {
+                batch.nodes.resize(batch.nodes.size() - std::min(kReclaimChunk, batch.nodes.size()));
+                size_t done = total - batch.nodes.size();
+                size_t target = batch.nodes.empty() ? batch.bytes :
+                                static_cast<size_t>(static_cast<double>(batch.bytes) * done / total);
+                pending.fetch_sub(target - released, std::memory_order_relaxed);
+                released = target;
+                std::this_thread::yield();
+            }
+            
+            lock.lock();
+        }
+    }
+    
+    std::mutex queueMutex;
+    std::condition_variable wakeup;
+    std::deque<Batch> queue;
+    std::thread worker;
+    std::atomic<size_t> pending{0};
+    bool stopping = false;
+};
+
+Reclaimer reclaimer;
+
+/**
+ * Named read-only view of a directory tree as it was when the snapshot was
+ * taken. Entries are shared with the live tree until they change: before a
+ * path below the root changes for the first time, its old entry (null if it
+ * did not exist) and those of its ancestors are preserved in the snapshot.
+ */
+struct Snapshot {
+    std::string root;                     // Live directory the snapshot shows
+    std::string viewPath;                 // Where the snapshot appears, below /.snapshots
+    std::string creationDate;             // Date the snapshot was taken
+    std::unordered_map<std::string, std::shared_ptr<FSEntry>> preserved;  // Live path to entry at snapshot time
+};
+
+// Snapshots by name and the directory they appear in (guarded by fileSystemMutex)
+const std::string kSnapshotsDirectory = "/.snapshots";
+std::map<std::string, Snapshot> snapshots;
+std::shared_ptr<FSEntry> snapshotsDirectoryEntry;
+
+/**
+ * Metadata of one entry of a frozen subtree
+ */
+struct FrozenEntry {
+    uint64_t payloadOffset;     // Content or symlink target within the payload
+    uint64_t size;              // Size in bytes
+    uint64_t inodeNumber;       // Inode number the entry had when it was frozen
+    uint32_t subtreeEnd;        // Position past the last descendant, for directories
+    uint32_t creationDate;      // Index into the date table
+    uint32_t modificationDate;  // Index into the date table
+    EntryType type;
+};
+
+/**
+ * Immutable, compact form of a directory tree made by freeze. Paths below
+ * the root are kept in a FrozenNameIndex, sorted so that every directory is
+ * directly followed by its descendants; each entry has fixed-size metadata
+ * and all content lives in one contiguous payload buffer. Nothing changes
+ * once the tree is built, so it is read without locks.
+ */
+struct FrozenTree {
+    std::string root;                               // Live directory the tree was frozen at
+    FrozenNameIndex names;                          // Paths relative to the root
+    std::vector<FrozenEntry> entries;               // Metadata, in name order
+    std::vector<std::string> dates;                 // Distinct dates of the entries
+    std::shared_ptr<const ContentBuffer> payload;   // Content of all files and symlink targets
+    std::unordered_map<uint32_t, XattrList> xattrs; // Attributes of the entries that have any
+    
+    /**
+     * Returns the content of a file as a slice of the payload; nothing is copied
+     */
+    FileContent content(size_t position) const {
+        FileContent result;
+        if (entries[position].size != 0) {
+            result.assign(payload, entries[position].payloadOffset, entries[position].size);
+        }
+        return result;
+    }
+    
+    /**
+     * Returns the target of a symlink
+     */
+    std::string symlinkTarget(size_t position) const {
+        const FrozenEntry& entry = entries[position];
+        return entry.size == 0 ? std::string() : std::string(payload->data() + entry.payloadOffset, entry.size);
+    }
+    
+    /**
+     * Visits the positions of the direct children of a directory, skipping
+     * over the descendants of subdirectories
+     * @param position The directory, FrozenNameIndex::npos for the root
+     * @param visit Called with the position of every child
+     */
+    template <typename Visitor>
+    void forEachChild(size_t position, Visitor visit) const {
+        size_t end = position == FrozenNameIndex::npos ? entries.size() : entries[position].subtreeEnd;
+        size_t child = position == FrozenNameIndex::npos ? 0 : position + 1;
+        while (child < end) {
+            visit(child);
+            child = entries[child].type == EntryType::DIRECTORY ? entries[child].subtreeEnd : child + 1;
+        }
+    }
+    
+    /**
+     * Returns the heap bytes of everything but the payload
+     */
+    size_t indexBytes() const {
+        size_t bytes = sizeof(FrozenTree) + names.memoryUsage() + entries.capacity() * sizeof(FrozenEntry) +
+                       dates.capacity() * sizeof(std::string);
+        for (const auto& date : dates) {
+            bytes += date.capacity();
+        }
+        for (const auto& attributes : xattrs) {
+            bytes += sizeof(attributes) + attributes.second.capacity() * sizeof(XattrList::value_type);
+            for (const auto& attribute : attributes.second) {
+                bytes += attribute.first.capacity() + attribute.second.capacity();
+            }
+        }
+        return bytes;
+    }
+};
+
+// Frozen subtrees. Freeze and unfreeze replace the whole list under
+// fileSystemMutex with an atomic store; readers take it with an atomic
+// load, so looking up frozen paths needs no lock.
+typedef std::vector<std::shared_ptr<const FrozenTree>> FrozenTreeList;
+std::shared_ptr<const FrozenTreeList> frozenTrees = std::make_shared<const FrozenTreeList>();
+
+/**
+ * A path found in a frozen subtree; holding it keeps the tree alive
+ */
+struct FrozenRef {
+    std::shared_ptr<const FrozenTree> tree;
+    size_t position;            // Entry position, FrozenNameIndex::npos for the root directory
+    
+    bool isRoot() const { return position == FrozenNameIndex::npos; }
+    EntryType type() const { return isRoot() ? EntryType::DIRECTORY : tree->entries[position].type; }
+};
+
+// Workload trace recording state
+std::atomic<bool> traceRecording(false);                    // Whether commands are being recorded
+std::mutex traceMutex;                                      // Serializes writes to the trace file
+std::ofstream traceFile;                                    // Open trace file while recording
+std::string traceFilename;                                  // Path of the open trace file
+std::chrono::steady_clock::time_point lastTraceTime;        // Timestamp of the previous record
+size_t tracedCommandCount = 0;                              // Records written to the open trace
+
+// Session of the interactive shell and of threads that run commands without their own
+Session shellSession;
+
+// Session the calling thread runs commands for
+thread_local Session* activeSession = &shellSession;
+
+SessionScope::SessionScope(Session& session) : previous(activeSession) {
+    activeSession = &session;
+}
+
+SessionScope::~SessionScope() {
+    activeSession = previous;
+}
+
+Session& currentSession() {
+    return *activeSession;
+}
+
+/**
+ * Returns the stream the running command prints its output to
+ */
+std::ostream& sessionOutput() {
+    return *activeSession->output;
+}
+
+/**
+ * Returns the stream the running command prints errors to
+ */
+std::ostream& sessionErrors() {
+    return *activeSession->errors;
+}
 
 /**
  * Gets the current date as a formatted string
  * @return String representation of the current date in DD/MM/YYYY format
  */
 std::string getCurrentDateString() {
-    auto now = std::chrono::system_clock::now();
-    std::time_t time = std::chrono::system_clock::to_time_t(now);
-    std::tm* tm = std::localtime(&time);
-    std::stringstream dateStream;
-    dateStream << std::put_time(tm, "%d/%m/%Y");
-    return dateStream.str();
+    // Formatting costs far more than reading the clock, so each thread
+    // reformats only when the second changes
+    thread_local std::time_t cachedTime = -1;
+    thread_local std::string cachedDate;
+    
+    std::time_t time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    if (time != cachedTime) {
+        std::tm localTime;
+        localtime_r(&time, &localTime);
+        char buffer[16];
+        std::strftime(buffer, sizeof(buffer), "%d/%m/%Y", &localTime);
+        cachedDate = buffer;
+        cachedTime = time;
+    }
+    return cachedDate;
 }
 
 /**
- * Splits a string into tokens based on a delimiter
- * @param input The string to tokenize
+ * Gets the display name of an entry type
+ * @param type The entry type
+ * @return "File", "Directory" or "Symlink"
+ */
+const char* entryTypeName(EntryType type) {
+    switch (type) {
+        case EntryType::FILE:
+            return "File";
+        case EntryType::DIRECTORY:
+            return "Directory";
+        case EntryType::SYMLINK:
+            return "Symlink";
+    }
+    return "Unknown";
+}
+
+/**
+ * Creates a new inode with a single link and current timestamps
+ * (caller must hold fileSystemMutex)
+ * @param type Whether the inode is a file or a directory
+ * @return The new inode, not yet linked into the index
+ */
+std::shared_ptr<FSEntry> createEntry(EntryType type) {
+    auto entry = std::make_shared<FSEntry>();
+    entry->sizeInBytes = 0;
+    entry->creationDate = getCurrentDateString();
+    entry->modificationDate = entry->creationDate;
+    entry->type = type;
+    entry->inodeNumber = nextInodeNumber++;
+    entry->linkCount = 1;
+    entry->treeHash = 0;
+    entry->hashValid = false;
+    
+    // A new symlink may change how existing paths resolve
+    if (type == EntryType::SYMLINK) {
+        symlinkCount++;
+        symlinkGeneration++;
+    }
+    return entry;
+}
+
+/**
+ * Creates a new inode holding a copy of another one's content and
+ * attributes, with a single link and current timestamps (caller must hold
+ * fileSystemMutex). File buffers are shared copy-on-write, so the copy
+ * itself is cheap, and the Merkle hash of a file or symlink carries over.
+ * @param source The inode to copy
+ * @return The new inode, not yet linked into the index
+ */
+std::shared_ptr<FSEntry> copyEntry(const FSEntry& source) {
+    auto entry = createEntry(source.type);
+    entry->data = source.data;
+    entry->sizeInBytes = source.sizeInBytes;
+    entry->symlinkTarget = source.symlinkTarget;
+    if (source.xattrs) {
+        entry->xattrs.reset(new XattrList(*source.xattrs));
+    }
+    if (source.type != EntryType::DIRECTORY) {
+        entry->treeHash = source.treeHash;
+        entry->hashValid = source.hashValid;
+    }
+    return entry;
+}
+
+/**
+ * Creates an inode for a subtree under construction. Unlike createEntry it
+ * touches no shared state; the inode number is assigned on publication.
+ * @param type Whether the inode is a file, a directory or a symbolic link
+ * @param date Creation and modification date
+ * @return The new inode
+ */
+std::shared_ptr<FSEntry> createSubtreeEntry(EntryType type, const std::string& date) {
+    auto entry = std::make_shared<FSEntry>();
+    entry->sizeInBytes = 0;
+    entry->creationDate = date;
+    entry->modificationDate = date;
+    entry->type = type;
+    entry->inodeNumber = 0;
+    entry->linkCount = 1;
+    entry->treeHash = 0;
+    entry->hashValid = false;
+    return entry;
+}
+
+/**
+ * Splits a string into views of its tokens without copying them
+ * @param input The string to tokenize; the views point into it
  * @param delimiter The character to use as delimiter (default: space)
- * @return Vector of tokens
+ * @return Vector of token views
  */
-std::vector<std::string> tokenize(const std::string& input, char delimiter = ' ') {
-    std::vector<std::string> tokens;
+std::vector<std::string_view> tokenizeView(std::string_view input, char delimiter = ' ') {
+    TraceSpan span("parse");
+    std::vector<std::string_view> tokens;
     size_t begin = 0, end = 0;
     
     // Find each token separated by the delimiter
-    while ((end = input.find(delimiter, begin)) != std::string::npos) {
+    while ((end = input.find(delimiter, begin)) != std::string_view::npos) {
         if (end != begin) {
             tokens.push_back(input.substr(begin, end - begin));
         }
@@ -76,18 +502,33 @@ std::vector<std::string> tokenize(const std::string& input, char delimiter = ' '
     return tokens;
 }
 
+/**
+ * Splits a string into tokens based on a delimiter
+ * @param input The string to tokenize
+ * @param delimiter The character to use as delimiter (default: space)
+ * @return Vector of tokens
+ */
+std::vector<std::string> tokenize(const std::string& input, char delimiter) {
+    std::vector<std::string> tokens;
+    for (std::string_view token : tokenizeView(input, delimiter)) {
+        tokens.emplace_back(token);
+    }
+    return tokens;
+}
+
 /**
  * Normalizes a path by handling relative paths and ensuring proper formatting
  * @param path The path to normalize
  * @return Normalized absolute path
  */
 std::string normalizePath(const std::string& path) {
+    TraceSpan span("normalize");
     std::string normalizedPath;
     
     // Handle absolute vs relative path
     if (path.empty() || path[0] != '/') {
         // Relative path - prepend current directory
-        normalizedPath = currentDirectory;
+        normalizedPath = activeSession->currentDirectory;
         if (normalizedPath != "/" && path[0] != '/') {
             normalizedPath += "/";
         }
@@ -131,6 +572,131 @@ std::string normalizePath(const std::string& path) {
     return normalizedPath;
 }
 
+/**
+ * Checks whether a path is a directory or below it
+ * @param path Normalized path
+ * @param directory Normalized directory path
+ * @return True if path is directory itself or inside it
+ */
+bool isWithin(const std::string& path, const std::string& directory) {
+    if (directory == "/") {
+        return true;
+    }
+    return path.compare(0, directory.size(), directory) == 0 &&
+           (path.size() == directory.size() || path[directory.size()] == '/');
+}
+
+/**
+ * Finds a path in the frozen subtrees. Takes no lock: frozen trees never
+ * change and the list of them is replaced atomically.
+ * @param path Normalized path
+ * @param found Set to the tree and the position of the path in it
+ * @return True if the path is a frozen entry or the root of a frozen tree
+ */
+bool findFrozen(const std::string& path, FrozenRef& found) {
+    auto trees = std::atomic_load(&frozenTrees);
+    for (const auto& tree : *trees) {
+        if (!isWithin(path, tree->root)) {
+            continue;
+        }
+        found.tree = tree;
+        if (path == tree->root) {
+            found.position = FrozenNameIndex::npos;
+            return true;
+        }
+        size_t relativeBegin = tree->root == "/" ? 1 : tree->root.size() + 1;
+        found.position = tree->names.find(std::string_view(path).substr(relativeBegin));
+        return found.position != FrozenNameIndex::npos;
+    }
+    return false;
+}
+
+/**
+ * Resolves symbolic links in a normalized path (caller must hold
+ * fileSystemMutex). Links in intermediate components are always followed;
+ * relative targets resolve against the directory holding the link and ".."
+ * applies to the resolved path. Results are cached per thread until the
+ * next change to the set of symlinks.
+ * @param path Normalized absolute path
+ * @param followFinal Whether a symlink in the last component is followed too
+ * @param resolved Receives the path with all symlinks resolved
+ * @return False if resolution followed more than kMaxSymlinkHops links
+ */
+bool resolvePath(const std::string& path, bool followFinal, std::string& resolved) {
+    // Trees without symlinks skip resolution entirely
+    if (symlinkCount == 0 && frozenSymlinkCount == 0) {
+        resolved = path;
+        return true;
+    }
+    
+    thread_local ResolutionCache cache;
+    if (cache.generation != symlinkGeneration) {
+        cache.followFinal.clear();
+        cache.keepFinal.clear();
+        cache.generation = symlinkGeneration;
+    }
+    auto& cached = followFinal ? cache.followFinal : cache.keepFinal;
+    auto hit = cached.find(path);
+    if (hit != cached.end()) {
+        resolved = hit->second;
+        return true;
+    }
+    
+    TraceSpan span("resolve");
+    
+    // Components still to walk, in reverse order so the next one is at the back
+    std::vector<std::string> pending = tokenize(path, '/');
+    std::reverse(pending.begin(), pending.end());
+    std::string current = "/";
+    size_t hops = 0;
+    
+    while (!pending.empty()) {
+        std::string component = pending.back();
+        pending.pop_back();
+        
+        if (component.empty() || component == ".") {
+            continue;
+        }
+        if (component == "..") {
+            size_t lastSlash = current.find_last_of('/');
+            current = lastSlash == 0 ? "/" : current.substr(0, lastSlash);
+            continue;
+        }
+        
+        std::string next = current == "/" ? "/" + component : current + "/" + component;
+        auto entryIter = memoryFileSystem.find(next);
+        FrozenRef frozen;
+        bool isSymlink = entryIter != memoryFileSystem.end() ? entryIter->second->type == EntryType::SYMLINK
+                                                             : frozenSymlinkCount != 0 && findFrozen(next, frozen) &&
+                                                               frozen.type() == EntryType::SYMLINK;
+        if (!isSymlink || (pending.empty() && !followFinal)) {
+            current = next;
+            continue;
+        }
+        
+        if (++hops > kMaxSymlinkHops) {
+            sessionErrors() << "Error: Too many levels of symbolic links: " << path << "\n";
+            return false;
+        }
+        
+        // Splice the target in front of the remaining components
+        std::string target = entryIter != memoryFileSystem.end() ? entryIter->second->symlinkTarget
+                                                                 : frozen.tree->symlinkTarget(frozen.position);
+        if (!target.empty() && target[0] == '/') {
+            current = "/";
+        }
+        std::vector<std::string> targetComponents = tokenize(target, '/');
+        pending.insert(pending.end(), targetComponents.rbegin(), targetComponents.rend());
+    }
+    
+    if (cached.size() >= kResolutionCacheCapacity) {
+        cached.clear();
+    }
+    cached.emplace(path, current);
+    resolved = current;
+    return true;
+}
+
 /**
  * Extracts the directory part from a path
  * @param path The full path
@@ -138,7 +704,7 @@ std::string normalizePath(const std::string& path) {
  */
 std::string getDirectoryFromPath(const std::string& path) {
     size_t lastSlash = path.find_last_of('/');
-    if (lastSlash == std::string::npos) {
+    if (lastSlash == std::string::npos || lastSlash == 0) {
         return "/";
     }
     return path.substr(0, lastSlash);
@@ -163,8 +729,9 @@ std::string getFilenameFromPath(const std::string& path) {
  * @return True if the directory exists, false otherwise
  */
 bool directoryExists(const std::string& path) {
+    TraceSpan span("index lookup");
     auto dirIter = memoryFileSystem.find(path);
-    return dirIter != memoryFileSystem.end() && dirIter->second.type == EntryType::DIRECTORY;
+    return dirIter != memoryFileSystem.end() && dirIter->second->type == EntryType::DIRECTORY;
 }
 
 /**
@@ -173,540 +740,926 @@ bool directoryExists(const std::string& path) {
  * @return True if the file exists, false otherwise
  */
 bool fileExists(const std::string& path) {
+    TraceSpan span("index lookup");
     auto fileIter = memoryFileSystem.find(path);
-    return fileIter != memoryFileSystem.end() && fileIter->second.type == EntryType::FILE;
+    return fileIter != memoryFileSystem.end() && fileIter->second->type == EntryType::FILE;
 }
 
 /**
- * Ensures that all parent directories exist for a given path
- * @param path The path to check
- * @return True if all parent directories exist or were created, false otherwise
+ * Finds every path referring to an inode (caller must hold fileSystemMutex).
+ * Only hard-linked inodes need the scan; others have just the given path.
+ * @param path One path of the inode
+ * @param entry The inode
+ * @return All paths of the inode
  */
-bool ensureParentDirectoriesExist(const std::string& path) {
-    std::string dirPath = getDirectoryFromPath(path);
-    
-    // If the directory is root, it always exists
-    if (dirPath == "/") {
-        return true;
+std::vector<std::string> pathsOfInode(const std::string& path, const FSEntry& entry) {
+    if (entry.linkCount <= 1) {
+        return {path};
     }
     
-    // Check if the parent directory exists, if not create it recursively
-    if (!directoryExists(dirPath)) {
-        // Create parent directories recursively
-        if (!ensureParentDirectoriesExist(dirPath)) {
-            return false;
+    TraceSpan span("index scan");
+    std::vector<std::string> paths;
+    for (const auto& other : memoryFileSystem) {
+        if (other.second.get() == &entry) {
+            paths.push_back(other.first);
         }
-        
-        // Create the immediate parent directory
-        FSEntry dirEntry;
-        dirEntry.data = "";
-        dirEntry.sizeInBytes = 0;
-        dirEntry.creationDate = getCurrentDateString();
-        dirEntry.modificationDate = getCurrentDateString();
-        dirEntry.type = EntryType::DIRECTORY;
-        
-        memoryFileSystem[dirPath] = dirEntry;
     }
-    
-    return true;
+    return paths;
 }
 
 /**
- * Updates the content of an existing file
- * @param path The path of the file to update
- * @param content The new content to write
- * @return True if successful, false otherwise
+ * Marks the cached Merkle hashes of a path and of its ancestors stale
+ * (caller must hold fileSystemMutex). A stale directory always has stale
+ * ancestors, so the walk stops at the first one that already is.
+ * @param path Normalized path that changed; it may no longer exist
  */
-bool updateFileContent(const std::string& path, const std::string& content) {
-    auto fileIterator = memoryFileSystem.find(path);
-    if (fileIterator == memoryFileSystem.end() || fileIterator->second.type != EntryType::FILE) {
-        std::cerr << "Error: " << path << " does not exist or is not a file\n";
-        return false;
+void invalidateHashes(const std::string& path) {
+    auto entryIterator = memoryFileSystem.find(path);
+    if (entryIterator != memoryFileSystem.end()) {
+        entryIterator->second->hashValid = false;
+    }
+    for (std::string current = path; current != "/";) {
+        current = getDirectoryFromPath(current);
+        auto parentIterator = memoryFileSystem.find(current);
+        if (parentIterator == memoryFileSystem.end() || !parentIterator->second->hashValid) {
+            break;
+        }
+        parentIterator->second->hashValid = false;
     }
-    
-    // Update file metadata
-    fileIterator->second.data = content;
-    fileIterator->second.sizeInBytes = content.size();
-    fileIterator->second.modificationDate = getCurrentDateString();
-    return true;
 }
 
 /**
- * Writes content to a file with thread safety
- * @param path The path of the file to write to
- * @param content The content to write
- * @return True if successful, false otherwise
+ * Marks the hashes along every path of a modified inode stale
+ * (caller must hold fileSystemMutex)
+ * @param path The path the inode was modified through
+ * @param entry The inode
  */
-bool writeContentToFile(const std::string& path, const std::string& content) {
-    std::lock_guard<std::mutex> lock(fileSystemMutex);  // Thread-safe lock
-    
-    std::string normalizedPath = normalizePath(path);
-    
-    // Ensure parent directories exist
-    if (!ensureParentDirectoriesExist(normalizedPath)) {
-        std::cerr << "Error: Failed to create parent directories for " << normalizedPath << "\n";
-        return false;
+void invalidateInodeHashes(const std::string& path, const FSEntry& entry) {
+    for (const auto& linkPath : pathsOfInode(path, entry)) {
+        invalidateHashes(linkPath);
     }
-    
-    bool success = false;
-    if (fileExists(normalizedPath)) {
-        success = updateFileContent(normalizedPath, content);
-    } else {
-        // Create a new file if it doesn't exist
-        FSEntry newFile;
-        newFile.data = content;
-        newFile.sizeInBytes = content.size();
-        newFile.creationDate = getCurrentDateString();
-        newFile.modificationDate = getCurrentDateString();
-        newFile.type = EntryType::FILE;
-        
-        memoryFileSystem[normalizedPath] = newFile;
-        success = true;
+}
+
+/**
+ * Copies an entry's state for a snapshot; file buffers are shared
+ * copy-on-write, so only metadata is copied
+ * @param source The entry as it is now
+ * @return The copy, which is never linked into the live index
+ */
+std::shared_ptr<FSEntry> preserveEntry(const FSEntry& source) {
+    auto entry = std::make_shared<FSEntry>();
+    entry->data = source.data;
+    entry->sizeInBytes = source.sizeInBytes;
+    entry->creationDate = source.creationDate;
+    entry->modificationDate = source.modificationDate;
+    entry->type = source.type;
+    entry->symlinkTarget = source.symlinkTarget;
+    if (source.xattrs) {
+        entry->xattrs.reset(new XattrList(*source.xattrs));
     }
-    
-    if (success) {
-        std::cout << "Successfully written to " << normalizedPath << "\n";
+    if (source.history) {
+        entry->history.reset(new FileHistory(*source.history));
     }
-    return success;
+    entry->inodeNumber = source.inodeNumber;
+    entry->linkCount = source.linkCount;
+    entry->treeHash = source.treeHash;
+    entry->hashValid = source.hashValid;
+    return entry;
 }
 
 /**
- * Lists all entries in a directory
- * @param path The directory path to list
- * @param detailed Whether to show detailed information
+ * Preserves the current state of a path in every snapshot that covers it
+ * and has not preserved it yet; called before the path changes (caller must
+ * hold fileSystemMutex). Ancestors up to the snapshot root are preserved
+ * with it, so a directory a snapshot still shares is unchanged below. All
+ * paths of a hard-linked inode change together, so all are preserved.
+ * @param path Normalized live path about to change
  */
-void listDirectory(const std::string& path, bool detailed) {
-    std::lock_guard<std::mutex> lock(fileSystemMutex);
-    
-    std::string normalizedPath = normalizePath(path);
-    
-    // Check if the directory exists
-    if (!directoryExists(normalizedPath)) {
-        std::cerr << "Error: Directory does not exist: " << normalizedPath << "\n";
+void preserveForSnapshots(const std::string& path) {
+    if (snapshots.empty()) {
         return;
     }
     
-    // Collect all entries in the directory
-    std::vector<std::pair<std::string, FSEntry>> entries;
-    std::string prefix = normalizedPath == "/" ? "/" : normalizedPath + "/";
-    
-    for (const auto& entry : memoryFileSystem) {
-        // Skip entries not in this directory
-        if (entry.first == normalizedPath) {
-            continue; // Skip the directory itself
-        }
-        
-        // Check if entry is directly under the directory
-        if (entry.first.find(prefix) == 0) {
-            std::string relativePath = entry.first.substr(prefix.length());
-            if (relativePath.find('/') == std::string::npos) {
-                entries.emplace_back(relativePath, entry.second);
+    auto entryIterator = memoryFileSystem.find(path);
+    std::vector<std::string> paths = entryIterator == memoryFileSystem.end()
+                                     ? std::vector<std::string>{path} : pathsOfInode(path, *entryIterator->second);
+    for (auto& named : snapshots) {
+        Snapshot& snapshot = named.second;
+        for (const auto& changed : paths) {
+            // A preserved path already has its ancestors preserved
+            for (std::string current = changed; isWithin(current, snapshot.root);
+                 current = getDirectoryFromPath(current)) {
+                if (snapshot.preserved.count(current) != 0) {
+                    break;
+                }
+                auto currentIterator = memoryFileSystem.find(current);
+                snapshot.preserved.emplace(current, currentIterator == memoryFileSystem.end()
+                                                    ? nullptr : preserveEntry(*currentIterator->second));
+                if (current == snapshot.root) {
+                    break;
+                }
             }
         }
     }
+}
+
+/**
+ * Finds the snapshot a path below /.snapshots/<name> shows
+ * @param path Normalized path
+ * @param livePath Set to the live path shown at that position
+ * @return The snapshot, or null if the path is not inside one
+ */
+const Snapshot* snapshotOfPath(const std::string& path, std::string& livePath) {
+    if (snapshots.empty() || path == kSnapshotsDirectory || !isWithin(path, kSnapshotsDirectory)) {
+        return nullptr;
+    }
+    size_t nameBegin = kSnapshotsDirectory.size() + 1;
+    size_t nameEnd = path.find('/', nameBegin);
+    auto snapshotIterator = snapshots.find(path.substr(nameBegin, nameEnd - nameBegin));
+    if (snapshotIterator == snapshots.end()) {
+        return nullptr;
+    }
     
-    // Display the entries
-    if (entries.empty()) {
-        std::cout << "No entries in directory: " << normalizedPath << "\n";
+    const std::string& root = snapshotIterator->second.root;
+    if (nameEnd == std::string::npos) {
+        livePath = root;
     } else {
-        if (detailed) {
-            // Detailed listing
-            std::cout << "Type\tSize\tCreated\t\tLast Modified\tName\n";
-            for (const auto& entry : entries) {
-                std::string typeStr = entry.second.type == EntryType::FILE ? "FILE" : "DIR";
-                std::cout << typeStr << "\t" 
-                         << entry.second.sizeInBytes << "\t"
-                         << entry.second.creationDate << "\t"
-                         << entry.second.modificationDate << "\t"
-                         << entry.first << "\n";
-            }
-        } else {
-            // Simple listing
-            for (const auto& entry : entries) {
-                std::string suffix = entry.second.type == EntryType::DIRECTORY ? "/" : "";
-                std::cout << entry.first << suffix << "\n";
-            }
-        }
+        livePath = (root == "/" ? "" : root) + path.substr(nameEnd);
     }
+    return &snapshotIterator->second;
 }
 
 /**
- * Displays a detailed list of all files and directories in the current directory
+ * Finds the entry at a path in the live tree or inside a snapshot
+ * (caller must hold fileSystemMutex)
+ * @param path Normalized path
+ * @return The entry, or null if nothing exists at the path
  */
-void displayFileListDetailed() {
-    listDirectory(currentDirectory, true);
+const FSEntry* findEntry(const std::string& path) {
+    std::string livePath;
+    const Snapshot* snapshot = snapshotOfPath(path, livePath);
+    if (snapshot) {
+        auto preservedIterator = snapshot->preserved.find(livePath);
+        if (preservedIterator != snapshot->preserved.end()) {
+            return preservedIterator->second.get();
+        }
+    } else if (path == kSnapshotsDirectory && snapshotsDirectoryEntry) {
+        return snapshotsDirectoryEntry.get();
+    }
+    
+    auto entryIterator = memoryFileSystem.find(snapshot ? livePath : path);
+    return entryIterator == memoryFileSystem.end() ? nullptr : entryIterator->second.get();
 }
 
 /**
- * Displays a simple list of all filenames in the current directory
+ * Gets the content of a frozen file without taking the lock
+ * @param path Normalized path
+ * @param content Set to the content, a slice of the frozen payload
+ * @return True if the path is a frozen file
  */
-void displayFileList() {
-    listDirectory(currentDirectory, false);
-}
+bool frozenFileContent(const std::string& path, FileContent& content) {
+    FrozenRef found;
+    if (!findFrozen(path, found) || found.type() != EntryType::FILE) {
+        return false;
+    }
+    content = found.tree->content(found.position);
+    return true;
+}
 
 /**
- * Writes to multiple files in parallel using threads
- * @param paths Vector of file paths to write to
- * @param contents Vector of contents to write
+ * Checks that changing a path leaves frozen subtrees alone, printing an
+ * error if it does not (caller must hold fileSystemMutex)
+ * @param path Normalized path about to be created, removed or moved
+ * @return True if the path is in a frozen subtree or contains one
  */
-void writeToFileBatch(const std::vector<std::string>& paths,
-                      const std::vector<std::string>& contents) {
-    std::vector<std::thread> threads;
-    
-    // Create a thread for each file write operation
-    for (size_t i = 0; i < paths.size(); ++i) {
-        threads.emplace_back([&, i]() {
-            writeContentToFile(paths[i], contents[i]);
-        });
+bool touchesFrozenTree(const std::string& path) {
+    for (const auto& tree : *frozenTrees) {
+        if (isWithin(path, tree->root) || isWithin(tree->root, path)) {
+            sessionErrors() << "Error: " << path << " overlaps frozen subtree " << tree->root
+                            << ", unfreeze it first\n";
+            return true;
+        }
     }
-    
-    // Wait for all threads to complete
-    for (auto& thread: threads) {
-        thread.join();
+    return false;
+}
+
+/**
+ * Checks that a path can be created or changed, printing an error if it is
+ * in a snapshot or overlaps a frozen subtree (caller must hold fileSystemMutex).
+ * Commands check it before creating parents, so the error is the only one.
+ * @param path Normalized path about to be created or changed
+ * @return True if the path is read-only
+ */
+bool isReadOnlyPath(const std::string& path) {
+    // Nothing can be created in snapshots
+    if (isWithin(path, kSnapshotsDirectory)) {
+        sessionErrors() << "Error: Snapshots are read-only: " << path << "\n";
+        return true;
     }
+    return touchesFrozenTree(path);
 }
 
 /**
- * Parses and executes the write command
- * @param command The full command string to parse
+ * Ensures that all parent directories exist for a given path
+ * @param path The path to check
+ * @return True if all parent directories exist or were created, false otherwise
  */
-void parseWriteCommand(const std::string& command) {
-    auto args = tokenize(command);
-    if (args.size() < 3) {
-        std::cerr << "Usage: write [-n <count>] <filename> <\"text to write\">\n";
-        return;
+bool ensureParentDirectoriesExist(const std::string& path) {
+    if (isReadOnlyPath(path)) {
+        return false;
     }
     
-    size_t fileCount = 1;
-    size_t startIndex = 1;
+    std::string dirPath = getDirectoryFromPath(path);
     
-    // Check if multiple files are specified with -n flag
-    if (args[1] == "-n") {
-        fileCount = std::stoi(args[2]);
-        startIndex = 3;
+    // If the directory is root, it always exists
+    if (dirPath == "/") {
+        return true;
     }
     
-    // Validate arguments for single file write
-    if (fileCount == 1 && args.size() != startIndex + 2) {
-        std::cerr << "Error: Invalid arguments for write command\n";
-        return;
+    // Check if the parent directory exists, if not create it recursively
+    if (!directoryExists(dirPath)) {
+        // Create parent directories recursively
+        if (!ensureParentDirectoriesExist(dirPath)) {
+            return false;
+        }
+        
+        // Create the immediate parent directory
+        preserveForSnapshots(dirPath);
+        memoryFileSystem[dirPath] = createEntry(EntryType::DIRECTORY);
+        invalidateHashes(dirPath);
     }
     
-    // Validate arguments for multiple file write
-    if (fileCount > 1 && ((args.size() - startIndex) % 2 != 0 || (args.size() - startIndex) / 2 != fileCount)) {
-        std::cerr << "Error: Invalid arguments for write command\n";
+    return true;
+}
+
+// Largest file that keeps history; versions are diffed as whole strings under the lock
+const uint64_t kMaxHistoryFileBytes = 64 << 20;
+
+/**
+ * Tells why a file cannot keep history. Versions are diffed in memory, so
+ * sparse files, whose holes would be materialized, and large files are refused.
+ * @param file The file
+ * @return The reason, or null if the file can keep history
+ */
+const char* historyRefusal(const FSEntry& file) {
+    if (file.data.size() > kMaxHistoryFileBytes) {
+        return "it is larger than 64 MiB";
+    }
+    if (file.data.hasHoles()) {
+        return "it is sparse";
+    }
+    return nullptr;
+}
+
+/**
+ * Records the content a file had before its last change as a new version,
+ * if the file keeps history (caller must hold fileSystemMutex). The old
+ * content is stored as a delta against the new one, so a version costs
+ * about the size of the edit; versions beyond the limit are dropped. A
+ * change that makes the file unable to keep history drops it instead.
+ * @param path The path the file was changed through
+ * @param file The file, already changed
+ */
+void recordVersion(const std::string& path, FSEntry& file) {
+    if (!file.history) {
         return;
     }
-    
-    // Prepare filenames and contents for batch processing
-    std::vector<std::string> paths;
-    std::vector<std::string> contents;
-    for (size_t i = startIndex; i < args.size(); i += 2) {
-        paths.push_back(args[i]);
-        contents.push_back(args[i + 1]);
+    if (const char* reason = historyRefusal(file)) {
+        file.history.reset();
+        sessionErrors() << "Warning: History of " << path << " dropped because " << reason << "\n";
+        return;
     }
     
-    writeToFileBatch(paths, contents);
+    TraceSpan span("delta");
+    FileHistory& history = *file.history;
+    std::string newer = file.data.toString();
+    std::string older = history.latest.toString();
+    if (newer != older) {
+        history.versions.push_front(FileVersion{encodeDelta(newer, older), older.size(), history.latestDate});
+        history.versions.front().delta.shrink_to_fit();
+        if (history.versions.size() > history.limit) {
+            history.versions.pop_back();
+        }
+    }
+    history.latest = file.data;
+    history.latestDate = file.modificationDate;
 }
 
 /**
- * Reads and displays the content of a file
- * @param path The path of the file to read
+ * Rebuilds an earlier version of a file from its history
+ * (caller must hold fileSystemMutex)
+ * @param file The file
+ * @param version How many versions back, 0 being the current content
+ * @param content Set to the content of that version
+ * @return False if the file keeps no such version
  */
-void readContentFromFile(const std::string& path) {
-    std::lock_guard<std::mutex> lock(fileSystemMutex);
-    
-    std::string normalizedPath = normalizePath(path);
-    auto fileIterator = memoryFileSystem.find(normalizedPath);
+bool reconstructVersion(const FSEntry& file, size_t version, std::string& content) {
+    if (version == 0) {
+        content = file.data.toString();
+        return true;
+    }
+    if (!file.history || version > file.history->versions.size()) {
+        return false;
+    }
     
-    if (fileIterator == memoryFileSystem.end() || fileIterator->second.type != EntryType::FILE) {
-        std::cerr << "Error: " << normalizedPath << " does not exist or is not a file\n";
-    } else {
-        std::cout << "Content of " << normalizedPath << ": " << fileIterator->second.data << "\n";
+    // Walk back from the newest content one delta at a time
+    TraceSpan span("delta");
+    content = file.history->latest.toString();
+    std::string older;
+    for (size_t i = 0; i < version; ++i) {
+        if (!applyDelta(content, file.history->versions[i].delta, older)) {
+            return false;
+        }
+        content.swap(older);
     }
+    return true;
 }
 
 /**
- * Adds a new file or directory to the system (internal implementation without mutex)
- * @param path The path of the file or directory to create
- * @param isDirectory Whether to create a directory or a file
- * @return True if successful, false otherwise
+ * Finds or creates the file whose whole content is about to be replaced,
+ * creating missing parent directories (caller must hold fileSystemMutex)
+ * @param path The path of the file
+ * @param normalizedPath Set to the resolved path
+ * @return The file's inode with its modification date updated, or null after printing an error
  */
-bool addNewEntryInternal(const std::string& path, bool isDirectory) {
-    std::string normalizedPath = normalizePath(path);
+FSEntry* openFileForReplace(const std::string& path, std::string& normalizedPath) {
+    if (!resolvePath(normalizePath(path), true, normalizedPath)) {
+        return nullptr;
+    }
     
-    // Check if the entry already exists
-    if (memoryFileSystem.find(normalizedPath) != memoryFileSystem.end()) {
-        std::cerr << "Error: Entry with the same path already exists: " << normalizedPath << "\n";
-        return false;
+    if (isReadOnlyPath(normalizedPath)) {
+        return nullptr;
     }
     
     // Ensure parent directories exist
     if (!ensureParentDirectoriesExist(normalizedPath)) {
-        std::cerr << "Error: Failed to create parent directories for " << normalizedPath << "\n";
-        return false;
+        sessionErrors() << "Error: Failed to create parent directories for " << normalizedPath << "\n";
+        return nullptr;
     }
     
-    // Create a new entry
-    FSEntry newEntry;
-    newEntry.data = "";
-    newEntry.sizeInBytes = 0;
-    newEntry.creationDate = getCurrentDateString();
-    newEntry.modificationDate = getCurrentDateString();
-    newEntry.type = isDirectory ? EntryType::DIRECTORY : EntryType::FILE;
-    
-    // Add the new entry to the memoryFileSystem
-    memoryFileSystem[normalizedPath] = newEntry;
-    
-    std::string entryType = isDirectory ? "Directory" : "File";
-    std::cout << entryType << " created successfully: " << normalizedPath << "\n";
-    return true;
+    // One lookup both finds an existing file and reserves the slot for a new one
+    preserveForSnapshots(normalizedPath);
+    auto inserted = memoryFileSystem.try_emplace(normalizedPath);
+    std::shared_ptr<FSEntry>& file = inserted.first->second;
+    if (inserted.second) {
+        file = createEntry(EntryType::FILE);
+    } else if (file->type != EntryType::FILE) {
+        sessionErrors() << "Error: " << normalizedPath << " is a directory\n";
+        return nullptr;
+    } else {
+        file->modificationDate = getCurrentDateString();
+    }
+    invalidateInodeHashes(normalizedPath, *file);
+    return file.get();
 }
 
 /**
- * Thread-safe wrapper for adding a new file
- * @param path The path of the file to create
+ * Writes content to a file (internal implementation without mutex). The
+ * content is copied once, straight into the buffer that becomes the file's storage.
+ * @param path The path of the file to write to
+ * @param content The content to write
  * @return True if successful, false otherwise
  */
-bool addNewFile(const std::string& path) {
-    std::lock_guard<std::mutex> lock(fileSystemMutex);
-    return addNewEntryInternal(path, false);
+bool writeContentToFileInternal(const std::string& path, std::string_view content) {
+    std::string normalizedPath;
+    FSEntry* file = openFileForReplace(path, normalizedPath);
+    if (!file) {
+        return false;
+    }
+    
+    {
+        TraceSpan span("data copy");
+        file->data.assign(std::string(content));
+    }
+    file->sizeInBytes = content.size();
+    recordVersion(normalizedPath, *file);
+    
+    sessionOutput() << "Successfully written to " << normalizedPath << "\n";
+    return true;
 }
 
 /**
- * Thread-safe wrapper for adding a new directory
- * @param path The path of the directory to create
+ * Writes content to a file with thread safety
+ * @param path The path of the file to write to
+ * @param content The content to write
  * @return True if successful, false otherwise
  */
-bool addNewDirectory(const std::string& path) {
-    std::lock_guard<std::mutex> lock(fileSystemMutex);
-    return addNewEntryInternal(path, true);
+bool writeContentToFile(const std::string& path, std::string_view content) {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::WRITE_CONTENT_TO_FILE);  // Thread-safe lock
+    return writeContentToFileInternal(path, content);
 }
 
 /**
- * Creates multiple files in parallel using threads
- * @param paths Vector of file paths to create
+ * Parses a byte count with an optional binary suffix (K, M, G, T)
+ * @param text The text to parse, e.g. "4096" or "10G"
+ * @param value Receives the parsed number of bytes
+ * @return True if the text is a valid byte count, false otherwise
  */
-void createMultipleFiles(const std::vector<std::string>& paths) {
-    std::vector<std::thread> threads;
+bool parseByteCount(std::string_view text, uint64_t& value) {
+    if (text.empty() || !std::isdigit(static_cast<unsigned char>(text[0]))) {
+        return false;
+    }
     
-    // Create a thread for each file creation
-    for (const auto& path : paths) {
-        threads.emplace_back([path]() {
-            addNewFile(path);
-        });
+    size_t consumed = 0;
+    try {
+        value = std::stoull(std::string(text), &consumed);
+    } catch (const std::exception&) {
+        return false;
+    }
+    
+    std::string_view suffix = text.substr(consumed);
+    if (suffix.empty()) {
+        return true;
+    }
+    if (suffix.size() != 1) {
+        return false;
     }
     
-    // Wait for all threads to complete
-    for (auto& thread : threads) {
-        thread.join();
+    const std::string units = "KMGT";
+    size_t unit = units.find(std::toupper(static_cast<unsigned char>(suffix[0])));
+    if (unit == std::string::npos) {
+        return false;
+    }
+    unsigned shift = static_cast<unsigned>(10 * (unit + 1));
+    if (value > (UINT64_MAX >> shift)) {
+        return false;
     }
+    value <<= shift;
+    return true;
 }
 
 /**
- * Parses and executes the create command
- * @param command The full command string to parse
+ * Writes content at an offset within a file with thread safety, creating
+ * the file if needed. Skipped ranges become holes.
+ * @param path The path of the file to write to
+ * @param offset Byte offset at which to write
+ * @param content The content to write
+ * @return True if successful, false otherwise
  */
-void parseCreateCommand(const std::string& command) {
-    auto args = tokenize(command);
-    if (args.size() < 2) {
-        std::cerr << "Usage: create [-n <count>] <filename1> [<filename2> ...]\n";
-        return;
+bool writeContentAtOffset(const std::string& path, uint64_t offset, std::string_view content) {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::WRITE_CONTENT_AT_OFFSET);
+    
+    std::string normalizedPath;
+    if (!resolvePath(normalizePath(path), true, normalizedPath)) {
+        return false;
     }
     
-    size_t fileCount = 1;
-    size_t startIndex = 1;
+    if (directoryExists(normalizedPath)) {
+        sessionErrors() << "Error: " << normalizedPath << " is a directory\n";
+        return false;
+    }
     
-    // Check if multiple files are specified with -n flag
-    if (args[1] == "-n") {
-        fileCount = std::stoi(args[2]);
-        startIndex = 3;
+    if (isReadOnlyPath(normalizedPath)) {
+        return false;
     }
     
-    // Validate argument count
-    if (args.size() - startIndex != fileCount) {
-        std::cerr << "Error: Number of filenames doesn't match specified count\n";
-        return;
+    // Ensure parent directories exist
+    if (!ensureParentDirectoriesExist(normalizedPath)) {
+        sessionErrors() << "Error: Failed to create parent directories for " << normalizedPath << "\n";
+        return false;
     }
     
-    std::vector<std::string> paths(args.begin() + startIndex, args.end());
-    createMultipleFiles(paths);
+    preserveForSnapshots(normalizedPath);
+    auto fileIterator = memoryFileSystem.find(normalizedPath);
+    if (fileIterator == memoryFileSystem.end()) {
+        fileIterator = memoryFileSystem.emplace(normalizedPath, createEntry(EntryType::FILE)).first;
+    }
+    
+    {
+        TraceSpan span("data copy");
+        if (!fileIterator->second->data.write(offset, content.data(), content.size())) {
+            sessionErrors() << "Error: Offset " << offset << " leaves no room for " << content.size() << " bytes\n";
+            return false;
+        }
+    }
+    fileIterator->second->sizeInBytes = fileIterator->second->data.size();
+    fileIterator->second->modificationDate = getCurrentDateString();
+    invalidateInodeHashes(normalizedPath, *fileIterator->second);
+    recordVersion(normalizedPath, *fileIterator->second);
+    
+    sessionOutput() << "Successfully written " << content.size() << " bytes at offset " << offset
+                    << " to " << normalizedPath << "\n";
+    return true;
 }
 
 /**
- * Creates a new directory
- * @param command The full command string to parse
+ * Sets the size of a file, creating it if needed. Growing a file adds a
+ * hole that takes no memory; shrinking discards the data beyond the end.
+ * @param path The path of the file to truncate
+ * @param size The new size in bytes
+ * @return True if successful, false otherwise
  */
-void parseMkdirCommand(const std::string& command) {
-    auto args = tokenize(command);
-    if (args.size() != 2) {
-        std::cerr << "Usage: mkdir <directory_path>\n";
-        return;
+bool truncateFile(const std::string& path, uint64_t size) {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::TRUNCATE_FILE);
+    
+    std::string normalizedPath;
+    if (!resolvePath(normalizePath(path), true, normalizedPath)) {
+        return false;
     }
     
-    addNewDirectory(args[1]);
+    if (directoryExists(normalizedPath)) {
+        sessionErrors() << "Error: " << normalizedPath << " is a directory\n";
+        return false;
+    }
+    
+    if (isReadOnlyPath(normalizedPath)) {
+        return false;
+    }
+    
+    if (!ensureParentDirectoriesExist(normalizedPath)) {
+        sessionErrors() << "Error: Failed to create parent directories for " << normalizedPath << "\n";
+        return false;
+    }
+    
+    preserveForSnapshots(normalizedPath);
+    auto fileIterator = memoryFileSystem.find(normalizedPath);
+    if (fileIterator == memoryFileSystem.end()) {
+        fileIterator = memoryFileSystem.emplace(normalizedPath, createEntry(EntryType::FILE)).first;
+    }
+    
+    fileIterator->second->data.truncate(size);
+    fileIterator->second->sizeInBytes = size;
+    fileIterator->second->modificationDate = getCurrentDateString();
+    invalidateInodeHashes(normalizedPath, *fileIterator->second);
+    recordVersion(normalizedPath, *fileIterator->second);
+    
+    sessionOutput() << "Truncated " << normalizedPath << " to " << size << " bytes\n";
+    return true;
 }
 
 /**
- * Changes the current working directory
+ * Parses and executes the truncate command
  * @param command The full command string to parse
  */
-void parseCdCommand(const std::string& command) {
+void parseTruncateCommand(const std::string& command) {
     auto args = tokenize(command);
-    if (args.size() != 2) {
-        std::cerr << "Usage: cd <directory_path>\n";
+    uint64_t size = 0;
+    if (args.size() != 3 || !parseByteCount(args[2], size)) {
+        sessionErrors() << "Usage: truncate <filename> <size>[K|M|G|T]\n";
         return;
     }
     
-    std::string targetDir = normalizePath(args[1]);
+    truncateFile(args[1], size);
+}
+
+/**
+ * Lightweight reference to one directory entry. The name is a slice of the
+ * path key in the index and the metadata is read through the inode, so
+ * nothing is copied. Valid only while fileSystemMutex is held and the
+ * index is not modified.
+ */
+struct DirectoryEntryRef {
+    const std::string* path;    // Full path key in the index
+    size_t nameOffset;          // Offset of the entry name within the path
+    const FSEntry* entry;       // Inode holding the metadata
     
-    std::lock_guard<std::mutex> lock(fileSystemMutex);
+    const char* name() const { return path->c_str() + nameOffset; }
+};
+
+/**
+ * Visits the direct children of a live directory (caller must hold fileSystemMutex)
+ * @param directory Normalized path of the directory
+ * @param visit Called with a DirectoryEntryRef for each child, in index order
+ */
+template <typename Visitor>
+void forEachLiveDirectoryEntry(const std::string& directory, Visitor visit) {
+    TraceSpan span("index scan");
+    std::string prefix = directory == "/" ? "/" : directory + "/";
     
-    // Handle special case for root directory
-    if (targetDir == "/") {
-        currentDirectory = "/";
-        std::cout << "Changed directory to: " << currentDirectory << "\n";
+    for (const auto& entry : memoryFileSystem) {
+        // Direct children start with the prefix and have no further slash
+        if (entry.first.size() <= prefix.size() || entry.first.compare(0, prefix.size(), prefix) != 0 ||
+            entry.first.find('/', prefix.size()) != std::string::npos) {
+            continue;
+        }
+        visit(DirectoryEntryRef{&entry.first, prefix.size(), entry.second.get()});
+    }
+}
+
+/**
+ * Visits the direct children of a directory, live or inside a snapshot
+ * (caller must hold fileSystemMutex)
+ * @param directory Normalized path of the directory
+ * @param visit Called with a DirectoryEntryRef for each child
+ */
+template <typename Visitor>
+void forEachDirectoryEntry(const std::string& directory, Visitor visit) {
+    std::string liveDirectory;
+    const Snapshot* snapshot = snapshotOfPath(directory, liveDirectory);
+    if (directory == kSnapshotsDirectory) {
+        for (const auto& named : snapshots) {
+            const FSEntry* root = findEntry(named.second.viewPath);
+            if (root) {
+                visit(DirectoryEntryRef{&named.second.viewPath, kSnapshotsDirectory.size() + 1, root});
+            }
+        }
         return;
     }
-    
-    // Check if the directory exists
-    if (!directoryExists(targetDir)) {
-        std::cerr << "Error: Directory does not exist: " << targetDir << "\n";
+    if (!snapshot) {
+        forEachLiveDirectoryEntry(directory, visit);
         return;
     }
     
-    // Change current directory
-    currentDirectory = targetDir;
-    std::cout << "Changed directory to: " << currentDirectory << "\n";
+    // A directory the snapshot still shares is unchanged below; a preserved
+    // one shows its live children that did not change and the saved ones
+    if (snapshot->preserved.count(liveDirectory) == 0) {
+        forEachLiveDirectoryEntry(liveDirectory, visit);
+        return;
+    }
+    forEachLiveDirectoryEntry(liveDirectory, [&](const DirectoryEntryRef& child) {
+        if (snapshot->preserved.count(*child.path) == 0) {
+            visit(child);
+        }
+    });
+    for (const auto& saved : snapshot->preserved) {
+        size_t slash = saved.first.find_last_of('/');
+        if (saved.second && saved.first != liveDirectory &&
+            std::string_view(saved.first.data(), slash == 0 ? 1 : slash) == liveDirectory) {
+            visit(DirectoryEntryRef{&saved.first, slash + 1, saved.second.get()});
+        }
+    }
 }
 
 /**
- * Prints the current working directory
+ * Lists the entries of a frozen directory, in name order
+ * @param path Normalized path of the directory
+ * @param directory The directory in its frozen tree
+ * @param detailed Whether to show type, size and dates
  */
-void printWorkingDirectory() {
-    std::cout << "Current directory: " << currentDirectory << "\n";
+void listFrozenDirectory(const std::string& path, const FrozenRef& directory, bool detailed) {
+    TraceSpan span("output");
+    const FrozenTree& tree = *directory.tree;
+    size_t childCount = 0;
+    tree.forEachChild(directory.position, [&](size_t child) {
+        if (childCount++ == 0 && detailed) {
+            sessionOutput() << "Type\tSize\tCreated\t\tLast Modified\tName\n";
+        }
+        const FrozenEntry& entry = tree.entries[child];
+        std::string relative = tree.names.name(child);
+        std::string name = relative.substr(relative.find_last_of('/') + 1);
+        if (detailed) {
+            std::string typeStr = entry.type == EntryType::FILE ? "FILE" :
+                                  entry.type == EntryType::DIRECTORY ? "DIR" : "LINK";
+            sessionOutput() << typeStr << "\t" << entry.size << "\t" << tree.dates[entry.creationDate] << "\t"
+                            << tree.dates[entry.modificationDate] << "\t" << name;
+            if (entry.type == EntryType::SYMLINK) {
+                sessionOutput() << " -> " << tree.symlinkTarget(child);
+            }
+            sessionOutput() << "\n";
+        } else {
+            const char* suffix = entry.type == EntryType::DIRECTORY ? "/" :
+                                 entry.type == EntryType::SYMLINK ? "@" : "";
+            sessionOutput() << name << suffix << "\n";
+        }
+    });
+    if (childCount == 0) {
+        sessionOutput() << "No entries in directory: " << path << "\n";
+    }
 }
 
 /**
- * Removes a file or directory from the system (internal implementation without mutex)
- * @param path The path of the entry to remove
- * @param recursive Whether to remove directories recursively
- * @return True if successful, false otherwise
+ * Lists all entries in a directory
+ * @param path The directory path to list
+ * @param detailed Whether to show detailed information
  */
-bool removeEntryInternal(const std::string& path, bool recursive) {
-    std::string normalizedPath = normalizePath(path);
+void listDirectory(const std::string& path, bool detailed) {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::LIST_DIRECTORY);
     
-    auto entryIterator = memoryFileSystem.find(normalizedPath);
-    if (entryIterator == memoryFileSystem.end()) {
-        std::cerr << "Error: " << normalizedPath << " does not exist\n";
-        return false;
+    std::string normalizedPath;
+    if (!resolvePath(normalizePath(path), true, normalizedPath)) {
+        return;
     }
     
-    if (entryIterator->second.type == EntryType::DIRECTORY) {
-        // Check for contents in the directory
-        std::string prefix = normalizedPath == "/" ? "/" : normalizedPath + "/";
-        bool hasContents = false;
-        
-        for (const auto& entry : memoryFileSystem) {
-            if (entry.first != normalizedPath && entry.first.find(prefix) == 0) {
-                hasContents = true;
-                break;
-            }
-        }
-        
-        if (hasContents && !recursive) {
-            std::cerr << "Error: Directory not empty, use 'rmdir -r' for recursive deletion\n";
-            return false;
-        }
-        
-        if (recursive) {
-            // Remove all entries inside the directory
-            std::vector<std::string> pathsToRemove;
-            
-            for (const auto& entry : memoryFileSystem) {
-                if (entry.first != normalizedPath && entry.first.find(prefix) == 0) {
-                    pathsToRemove.push_back(entry.first);
+    FrozenRef frozen;
+    if (findFrozen(normalizedPath, frozen) && frozen.type() == EntryType::DIRECTORY) {
+        listFrozenDirectory(normalizedPath, frozen, detailed);
+        return;
+    }
+    
+    // Check if the directory exists, live or in a snapshot
+    const FSEntry* directory = findEntry(normalizedPath);
+    if (!directory || directory->type != EntryType::DIRECTORY) {
+        sessionErrors() << "Error: Directory does not exist: " << normalizedPath << "\n";
+        return;
+    }
+    
+    // Collect references to the entries; nothing is copied
+    std::vector<DirectoryEntryRef> entries;
+    forEachDirectoryEntry(normalizedPath, [&](const DirectoryEntryRef& entry) {
+        entries.push_back(entry);
+    });
+    
+    // Display the entries
+    TraceSpan outputSpan("output");
+    if (entries.empty()) {
+        sessionOutput() << "No entries in directory: " << normalizedPath << "\n";
+    } else {
+        if (detailed) {
+            // Detailed listing
+            sessionOutput() << "Type\tSize\tCreated\t\tLast Modified\tName\n";
+            for (const auto& entry : entries) {
+                std::string typeStr = entry.entry->type == EntryType::FILE ? "FILE" :
+                                      entry.entry->type == EntryType::DIRECTORY ? "DIR" : "LINK";
+                sessionOutput() << typeStr << "\t" 
+                               << entry.entry->sizeInBytes << "\t"
+                               << entry.entry->creationDate << "\t"
+                               << entry.entry->modificationDate << "\t"
+                               << entry.name();
+                if (entry.entry->type == EntryType::SYMLINK) {
+                    sessionOutput() << " -> " << entry.entry->symlinkTarget;
                 }
+                sessionOutput() << "\n";
             }
-            
-            for (const auto& p : pathsToRemove) {
-                memoryFileSystem.erase(p);
+        } else {
+            // Simple listing
+            for (const auto& entry : entries) {
+                const char* suffix = entry.entry->type == EntryType::DIRECTORY ? "/" :
+                                     entry.entry->type == EntryType::SYMLINK ? "@" : "";
+                sessionOutput() << entry.name() << suffix << "\n";
             }
         }
     }
-    
-    memoryFileSystem.erase(entryIterator);
-    
-    std::string entryType = entryIterator->second.type == EntryType::DIRECTORY ? "Directory" : "File";
-    std::cout << entryType << " deleted successfully: " << normalizedPath << "\n";
-    return true;
 }
 
 /**
- * Thread-safe wrapper for removing a file
- * @param path The path of the file to remove
- * @return True if successful, false otherwise
+ * Displays a detailed list of all files and directories in the current directory
  */
-bool removeFile(const std::string& path) {
-    std::lock_guard<std::mutex> lock(fileSystemMutex);
-    return removeEntryInternal(path, false);
+void displayFileListDetailed() {
+    listDirectory(activeSession->currentDirectory, true);
 }
 
 /**
- * Thread-safe wrapper for removing a directory
- * @param path The path of the directory to remove
- * @param recursive Whether to remove recursively
- * @return True if successful, false otherwise
+ * Displays a simple list of all filenames in the current directory
  */
-bool removeDirectory(const std::string& path, bool recursive) {
-    std::lock_guard<std::mutex> lock(fileSystemMutex);
-    return removeEntryInternal(path, recursive);
+void displayFileList() {
+    listDirectory(activeSession->currentDirectory, false);
 }
 
 /**
- * Deletes multiple files in parallel using threads
- * @param paths Vector of file paths to delete
+ * Writes to multiple files under a single lock acquisition. Every item
+ * shares the one namespace lock, so taking it once for the whole batch
+ * replaces a lock handoff per file.
+ * @param paths Vector of file paths to write to
+ * @param contents Vector of contents to write
  */
-void deleteMultipleFiles(const std::vector<std::string>& paths) {
-    std::vector<std::thread> threads;
-    std::vector<std::string> missingFiles;
-    
-    // Create a thread for each file deletion
-    for (const auto& path : paths) {
-        threads.emplace_back([&missingFiles, path]() {
-            if (!removeFile(path)) {
-                fileSystemMutex.lock();
-                missingFiles.push_back(path);
-                fileSystemMutex.unlock();
-            }
-        });
+void writeToFileBatch(const std::vector<std::string_view>& paths,
+                      const std::vector<std::string_view>& contents) {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::WRITE_TO_FILE_BATCH);
+    for (size_t i = 0; i < paths.size(); ++i) {
+        writeContentToFileInternal(std::string(paths[i]), contents[i]);
     }
+}
+
+// Size of the buffers content of unknown length is streamed into
+const size_t kIngestChunkBytes = 4 << 20;
+
+/**
+ * Streams content into private file storage. Bytes are read straight into
+ * the buffers that become the file's extents: one buffer of the final size
+ * when the length is known, otherwise a sequence of large chunks.
+ * @param readSome Called as readSome(buffer, capacity), returns bytes read, 0 at end of input
+ * @param knownLength Exact length to read, or UINT64_MAX to read until the end
+ * @return The content read
+ */
+template <typename Reader>
+FileContent ingestContent(Reader readSome, uint64_t knownLength) {
+    TraceSpan span("ingest");
+    FileContent content;
+    size_t chunkBytes = knownLength == UINT64_MAX ? kIngestChunkBytes : static_cast<size_t>(knownLength);
     
-    // Wait for all threads to complete
-    for (auto& thread : threads) {
-        thread.join();
+    while (chunkBytes > 0) {
+        std::string chunk(chunkBytes, '\0');
+        size_t filled = 0;
+        size_t received;
+        while (filled < chunk.size() && (received = readSome(&chunk[filled], chunk.size() - filled)) > 0) {
+            filled += received;
+        }
+        bool finished = filled < chunk.size() || knownLength != UINT64_MAX;
+        chunk.resize(filled);
+        content.append(std::move(chunk));
+        if (finished) {
+            break;
+        }
     }
+    return content;
+}
+
+/**
+ * Replaces a file's content with content streamed from a host file or stdin.
+ * The input is read without holding the lock and published in one step.
+ * @param source Host file path, or "-" for standard input
+ * @param path The file system path to create or replace
+ * @param length Bytes to read from standard input, UINT64_MAX to read until its end
+ * @return True if successful, false otherwise
+ */
+bool ingestFile(const std::string& source, const std::string& path, uint64_t length) {
+    auto start = std::chrono::steady_clock::now();
+    FileContent content;
     
-    // Report results
-    if (missingFiles.empty()) {
-        std::cout << "Files deleted successfully\n";
+    if (source == "-") {
+        std::istream* input = activeSession->input;
+        if (!input) {
+            sessionErrors() << "Error: write - needs standard input, which this session does not have\n";
+            return false;
+        }
+        content = ingestContent([input](char* buffer, size_t capacity) -> size_t {
+            input->read(buffer, capacity);
+            return static_cast<size_t>(input->gcount());
+        }, length);
+        if (length != UINT64_MAX && content.size() != length) {
+            sessionErrors() << "Error: Standard input ended after " << content.size() << " of " << length << " bytes\n";
+            return false;
+        }
     } else {
-        std::cout << "Some files were not found: ";
-        for (const auto& file : missingFiles) {
-            std::cout << file << " ";
+        int fd = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat status;
+        if (fd < 0 || fstat(fd, &status) != 0) {
+            sessionErrors() << "Error: Cannot read " << source << ": " << std::strerror(errno) << "\n";
+            if (fd >= 0) {
+                close(fd);
+            }
+            return false;
+        }
+        
+        // Regular files are read into one buffer of their size, anything else in chunks
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        bool readFailed = false;
+        content = ingestContent([&](char* buffer, size_t capacity) -> size_t {
+            ssize_t received;
+            do {
+                received = read(fd, buffer, capacity);
+            } while (received < 0 && errno == EINTR);
+            readFailed |= received < 0;
+            return received > 0 ? static_cast<size_t>(received) : 0;
+        }, S_ISREG(status.st_mode) ? static_cast<uint64_t>(status.st_size) : UINT64_MAX);
+        int readError = errno;
+        close(fd);
+        if (readFailed) {
+            sessionErrors() << "Error: Cannot read " << source << ": " << std::strerror(readError) << "\n";
+            return false;
+        }
+    }
+    
+    std::string normalizedPath;
+    uint64_t size = content.size();
+    {
+        ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::INGEST_FILE);
+        FSEntry* file = openFileForReplace(path, normalizedPath);
+        if (!file) {
+            return false;
         }
-        std::cout << "\nRemaining files deleted successfully\n";
+        file->data = std::move(content);
+        file->sizeInBytes = static_cast<size_t>(size);
+        recordVersion(normalizedPath, *file);
     }
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sessionOutput() << "Successfully written " << size << " bytes to " << normalizedPath << " in " << seconds
+                    << " s (" << (seconds > 0 ? size / seconds / (1 << 20) : 0) << " MiB/s)\n";
+    return true;
 }
 
 /**
- * Parses and executes the delete command
+ * Parses and executes the write command
  * @param command The full command string to parse
  */
-void parseDeleteCommand(const std::string& command) {
-    auto args = tokenize(command);
-    if (args.size() < 2) {
-        std::cerr << "Usage: delete [-n <count>] <filename1> [<filename2> ...]\n";
+void parseWriteCommand(const std::string& command) {
+    // Tokens are views into the command, so the payload is only copied into the file
+    auto args = tokenizeView(command);
+    if (args.size() < 3) {
+        sessionErrors() << "Usage: write [-n <count> | -o <offset>] <filename> <\"text to write\">\n";
+        return;
+    }
+    
+    // Streamed write from a host file or from standard input
+    if (args[1] == "-f" || args[1] == "-") {
+        uint64_t length = UINT64_MAX;
+        bool valid = args[1] == "-f" ? args.size() == 4
+                                     : args.size() == 3 || (args.size() == 4 && parseByteCount(args[3], length));
+        if (!valid) {
+            sessionErrors() << "Usage: write -f <host_file> <filename> | write - <filename> [<bytes>]\n";
+            return;
+        }
+        if (args[1] == "-f") {
+            ingestFile(std::string(args[2]), std::string(args[3]), length);
+        } else {
+            ingestFile("-", std::string(args[2]), length);
+        }
+        return;
+    }
+    
+    // Positional write into a single file with -o flag
+    if (args[1] == "-o") {
+        uint64_t offset = 0;
+        if (args.size() != 5 || !parseByteCount(args[2], offset)) {
+            sessionErrors() << "Usage: write -o <offset> <filename> <\"text to write\">\n";
+            return;
+        }
+        if (args[4].size() > UINT64_MAX - offset) {
+            sessionErrors() << "Error: Offset " << offset << " leaves no room for " << args[4].size() << " bytes\n";
+            return;
+        }
+        writeContentAtOffset(std::string(args[3]), offset, args[4]);
         return;
     }
     
@@ -715,262 +1668,2705 @@ void parseDeleteCommand(const std::string& command) {
     
     // Check if multiple files are specified with -n flag
     if (args[1] == "-n") {
-        fileCount = std::stoi(args[2]);
+        uint64_t count = 0;
+        if (!parseByteCount(args[2], count)) {
+            sessionErrors() << "Usage: write [-n <count> | -o <offset>] <filename> <\"text to write\">\n";
+            return;
+        }
+        fileCount = static_cast<size_t>(count);
         startIndex = 3;
     }
     
-    // Validate argument count
-    if (args.size() - startIndex != fileCount) {
-        std::cerr << "Error: Number of filenames doesn't match specified count\n";
+    // Validate arguments for single file write
+    if (fileCount == 1 && args.size() != startIndex + 2) {
+        sessionErrors() << "Error: Invalid arguments for write command\n";
         return;
     }
     
-    std::vector<std::string> paths(args.begin() + startIndex, args.end());
-    deleteMultipleFiles(paths);
+    // Validate arguments for multiple file write
+    if (fileCount != 1 && ((args.size() - startIndex) % 2 != 0 || (args.size() - startIndex) / 2 != fileCount)) {
+        sessionErrors() << "Error: Invalid arguments for write command\n";
+        return;
+    }
+    
+    // Prepare filenames and contents for batch processing
+    std::vector<std::string_view> paths;
+    std::vector<std::string_view> contents;
+    paths.reserve(fileCount);
+    contents.reserve(fileCount);
+    for (size_t i = startIndex; i < args.size(); i += 2) {
+        paths.push_back(args[i]);
+        contents.push_back(args[i + 1]);
+    }
+    
+    writeToFileBatch(paths, contents);
 }
 
 /**
- * Parses and executes the rmdir command
- * @param command The full command string to parse
+ * Writes a range of file content to a stream without materializing it,
+ * emitting holes as zeros
+ * @param out The stream to write to
+ * @param content The file content
+ * @param offset Byte offset of the first byte to write
+ * @param length Maximum number of bytes to write
  */
-void parseRmdirCommand(const std::string& command) {
-    auto args = tokenize(command);
-    if (args.size() < 2 || args.size() > 3) {
-        std::cerr << "Usage: rmdir [-r] <directory_path>\n";
+void printFileContent(std::ostream& out, const FileContent& content, uint64_t offset, uint64_t length) {
+    static const std::string zeros(64 * 1024, '\0');
+    uint64_t end = offset + std::min(length, content.size() - std::min(offset, content.size()));
+    
+    content.forEachRun([&](uint64_t runOffset, const char* data, uint64_t runLength) {
+        uint64_t begin = std::max(offset, runOffset);
+        uint64_t stop = std::min(end, runOffset + runLength);
+        if (begin >= stop) {
+            return;
+        }
+        if (data != nullptr) {
+            out.write(data + (begin - runOffset), static_cast<std::streamsize>(stop - begin));
+            return;
+        }
+        for (uint64_t remaining = stop - begin; remaining > 0;) {
+            size_t chunk = static_cast<size_t>(std::min<uint64_t>(remaining, zeros.size()));
+            out.write(zeros.data(), chunk);
+            remaining -= chunk;
+        }
+    });
+}
+
+/**
+ * Reads and displays the content of a file
+ * @param path The path of the file to read
+ * @param offset Byte offset of the first byte to display
+ * @param length Maximum number of bytes to display
+ * @param version How many versions back to read, 0 for the current content
+ */
+void readContentFromFile(const std::string& path, uint64_t offset = 0, uint64_t length = UINT64_MAX,
+                         size_t version = 0) {
+    // Frozen files never change, so they are read without the lock
+    std::string requestedPath = normalizePath(path);
+    FileContent frozen;
+    if (version == 0 && frozenFileContent(requestedPath, frozen)) {
+        TraceSpan span("output");
+        sessionOutput() << "Content of " << requestedPath << ": ";
+        printFileContent(sessionOutput(), frozen, offset, length);
+        sessionOutput() << "\n";
         return;
     }
     
-    bool recursive = false;
-    std::string dirPath;
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::READ_CONTENT_FROM_FILE);
     
-    if (args.size() == 3 && args[1] == "-r") {
-        recursive = true;
-        dirPath = args[2];
-    } else {
-        dirPath = args[1];
+    std::string normalizedPath;
+    if (!resolvePath(requestedPath, true, normalizedPath)) {
+        return;
+    }
+    const FSEntry* file;
+    const FileContent* data = nullptr;
+    {
+        TraceSpan span("index lookup");
+        file = findEntry(normalizedPath);
+        if (file && file->type == EntryType::FILE) {
+            data = &file->data;
+        } else if (!file && frozenFileContent(normalizedPath, frozen)) {
+            // A frozen file reached through a symlink
+            data = &frozen;
+        }
     }
     
-    removeDirectory(dirPath, recursive);
+    if (!data) {
+        sessionErrors() << "Error: " << normalizedPath << " does not exist or is not a file\n";
+    } else if (version != 0) {
+        std::string content;
+        if (!file || !reconstructVersion(*file, version, content)) {
+            sessionErrors() << "Error: " << normalizedPath << " has no version " << version << "\n";
+            return;
+        }
+        TraceSpan span("output");
+        sessionOutput() << "Content of " << normalizedPath << " (version " << version << "): ";
+        printFileContent(sessionOutput(), FileContent(std::move(content)), offset, length);
+        sessionOutput() << "\n";
+    } else {
+        TraceSpan span("output");
+        sessionOutput() << "Content of " << normalizedPath << ": ";
+        printFileContent(sessionOutput(), *data, offset, length);
+        sessionOutput() << "\n";
+    }
 }
 
 /**
- * Moves or renames a file or directory
+ * Parses the arguments shared by read and cat: -o <offset> and -l <length>
+ * in any order, followed by the filename
+ * @param args The tokenized command
+ * @param offset Set to the offset, 0 if not given
+ * @param length Set to the length, UINT64_MAX if not given
+ * @return Index of the filename argument, or 0 if the arguments are malformed
+ */
+size_t parseRangeArguments(const std::vector<std::string>& args, uint64_t& offset, uint64_t& length) {
+    offset = 0;
+    length = UINT64_MAX;
+    size_t index = 1;
+    while (index + 1 < args.size() && (args[index] == "-o" || args[index] == "-l")) {
+        uint64_t& target = args[index] == "-o" ? offset : length;
+        if (!parseByteCount(args[index + 1], target)) {
+            break;
+        }
+        index += 2;
+    }
+    return index + 1 == args.size() ? index : 0;
+}
+
+/**
+ * Parses and executes the read command
  * @param command The full command string to parse
  */
-void parseMoveCommand(const std::string& command) {
+void parseReadCommand(const std::string& command) {
     auto args = tokenize(command);
-    if (args.size() != 3) {
-        std::cerr << "Usage: mv <source_path> <destination_path>\n";
-        return;
+    uint64_t version = 0;
+    if (args.size() > 2 && args[1] == "--version") {
+        if (!parseByteCount(args[2], version)) {
+            args.clear();
+        } else {
+            args.erase(args.begin() + 1, args.begin() + 3);
+        }
     }
     
-    std::string sourcePath = normalizePath(args[1]);
-    std::string destPath = normalizePath(args[2]);
-    
-    std::lock_guard<std::mutex> lock(fileSystemMutex);
-    
-    // Check if source exists
-    auto sourceIter = memoryFileSystem.find(sourcePath);
-    if (sourceIter == memoryFileSystem.end()) {
-        std::cerr << "Error: Source does not exist: " << sourcePath << "\n";
+    uint64_t offset;
+    uint64_t length;
+    size_t index = parseRangeArguments(args, offset, length);
+    if (index == 0) {
+        sessionErrors() << "Usage: read [--version <k>] [-o <offset>] [-l <length>] <filename>\n";
         return;
     }
     
-    // Check if destination exists
-    if (memoryFileSystem.find(destPath) != memoryFileSystem.end()) {
-        std::cerr << "Error: Destination already exists: " << destPath << "\n";
-        return;
+    readContentFromFile(args[index], offset, length, static_cast<size_t>(version));
+}
+
+bool prepareCat(const std::string& command, FileContent& content, uint64_t& offset, uint64_t& length) {
+    auto args = tokenize(command);
+    size_t index = parseRangeArguments(args, offset, length);
+    if (index == 0) {
+        sessionErrors() << "Usage: cat [-o <offset>] [-l <length>] <filename>\n";
+        return false;
     }
     
-    // If source is a directory, need to handle all contents
-    if (sourceIter->second.type == EntryType::DIRECTORY) {
-        // Create destination directory
-        if (!addNewEntryInternal(destPath, true)) {
-            return;
-        }
-        
-        // Move all contents
-        std::string sourcePrefix = sourcePath == "/" ? "/" : sourcePath + "/";
-        std::string destPrefix = destPath == "/" ? "/" : destPath + "/";
-        
-        std::vector<std::pair<std::string, FSEntry>> entriesToMove;
-        
-        // Collect all entries to move
-        for (const auto& entry : memoryFileSystem) {
-            if (entry.first != sourcePath && entry.first.find(sourcePrefix) == 0) {
-                std::string relativePath = entry.first.substr(sourcePrefix.length());
-                std::string newPath = destPrefix + relativePath;
-                entriesToMove.emplace_back(newPath, entry.second);
-            }
-        }
-        
-        // Add all entries to the destination
-        for (const auto& entry : entriesToMove) {
-            memoryFileSystem[entry.first] = entry.second;
-        }
-        
-        // Remove source entries
-        std::vector<std::string> pathsToRemove;
-        for (const auto& entry : memoryFileSystem) {
-            if (entry.first.find(sourcePrefix) == 0) {
-                pathsToRemove.push_back(entry.first);
-            }
+    // Frozen files never change, so they are looked up without the lock
+    std::string requestedPath = normalizePath(args[index]);
+    if (!frozenFileContent(requestedPath, content)) {
+        // Copying the content only copies extent references; the bytes are written after the lock is released
+        ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::PREPARE_CAT);
+        std::string normalizedPath;
+        if (!resolvePath(requestedPath, true, normalizedPath)) {
+            return false;
         }
-        
-        for (const auto& path : pathsToRemove) {
-            memoryFileSystem.erase(path);
+        const FSEntry* file = findEntry(normalizedPath);
+        if (file && file->type == EntryType::FILE) {
+            content = file->data;
+        } else if (file || !frozenFileContent(normalizedPath, content)) {
+            sessionErrors() << "Error: " << normalizedPath << " does not exist or is not a file\n";
+            return false;
         }
-    } else {
-        // For files, just move the entry
-        memoryFileSystem[destPath] = sourceIter->second;
     }
-    
-    // Remove the source entry
-    memoryFileSystem.erase(sourcePath);
-    
-    std::cout << "Successfully moved " << sourcePath << " to " << destPath << "\n";
+    offset = std::min(offset, content.size());
+    length = std::min(length, content.size() - offset);
+    return true;
 }
 
 /**
- * Copies a file or directory
+ * Parses and executes the cat command: writes the raw bytes of a file to
+ * standard output, without iostream formatting or a trailing newline
  * @param command The full command string to parse
  */
-void parseCopyCommand(const std::string& command) {
-    auto args = tokenize(command);
-    if (args.size() != 3) {
-        std::cerr << "Usage: cp <source_path> <destination_path>\n";
+void parseCatCommand(const std::string& command) {
+    FileContent content;
+    uint64_t offset;
+    uint64_t length;
+    if (!prepareCat(command, content, offset, length)) {
         return;
     }
     
-    std::string sourcePath = normalizePath(args[1]);
-    std::string destPath = normalizePath(args[2]);
+    TraceSpan span("output");
+    if (activeSession->output != &std::cout) {
+        sessionOutput() << content.read(offset, length);
+        return;
+    }
+    std::cout.flush();
+    if (!content.writeTo(STDOUT_FILENO, offset, length)) {
+        sessionErrors() << "Error: Could not write to standard output: " << std::strerror(errno) << "\n";
+    }
+}
+
+/**
+ * Sets how many earlier versions of a file are kept. History starts from
+ * the current content; a limit of 0 turns it off and drops the versions.
+ * @param path The file
+ * @param limit Maximum number of earlier versions to keep
+ * @return True if successful, false otherwise
+ */
+bool setHistoryLimit(const std::string& path, size_t limit) {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::PARSE_HISTORY_COMMAND);
     
-    std::lock_guard<std::mutex> lock(fileSystemMutex);
+    std::string normalizedPath;
+    if (!resolvePath(normalizePath(path), true, normalizedPath)) {
+        return false;
+    }
+    auto fileIterator = memoryFileSystem.find(normalizedPath);
+    if (fileIterator == memoryFileSystem.end() || fileIterator->second->type != EntryType::FILE) {
+        sessionErrors() << "Error: " << normalizedPath << " does not exist or is not a file\n";
+        return false;
+    }
     
-    // Check if source exists
-    auto sourceIter = memoryFileSystem.find(sourcePath);
-    if (sourceIter == memoryFileSystem.end()) {
-        std::cerr << "Error: Source does not exist: " << sourcePath << "\n";
-        return;
+    FSEntry& file = *fileIterator->second;
+    if (limit == 0) {
+        file.history.reset();
+        sessionOutput() << "History disabled for " << normalizedPath << "\n";
+        return true;
+    }
+    if (const char* reason = historyRefusal(file)) {
+        sessionErrors() << "Error: Cannot keep history of " << normalizedPath << " because " << reason << "\n";
+        return false;
+    }
+    if (!file.history) {
+        file.history.reset(new FileHistory());
+        file.history->latest = file.data;
+        file.history->latestDate = file.modificationDate;
     }
+    file.history->limit = limit;
+    while (file.history->versions.size() > limit) {
+        file.history->versions.pop_back();
+    }
+    sessionOutput() << "Keeping up to " << limit << " earlier versions of " << normalizedPath << "\n";
+    return true;
+}
+
+/**
+ * Lists the versions a file keeps, newest first
+ * @param path The file
+ */
+void listVersions(const std::string& path) {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::PARSE_HISTORY_COMMAND);
     
-    // Check if destination exists
-    if (memoryFileSystem.find(destPath) != memoryFileSystem.end()) {
-        std::cerr << "Error: Destination already exists: " << destPath << "\n";
+    std::string normalizedPath;
+    if (!resolvePath(normalizePath(path), true, normalizedPath)) {
+        return;
+    }
+    const FSEntry* file = findEntry(normalizedPath);
+    if (!file || file->type != EntryType::FILE) {
+        sessionErrors() << "Error: " << normalizedPath << " does not exist or is not a file\n";
+        return;
+    }
+    if (!file->history) {
+        sessionOutput() << "No history kept for " << normalizedPath << "\n";
         return;
     }
     
-    // Create destination with current date
-    FSEntry destEntry = sourceIter->second;
-    destEntry.creationDate = getCurrentDateString();
-    destEntry.modificationDate = getCurrentDateString();
-    
-    // If source is a directory, need to handle all contents
-    if (sourceIter->second.type == EntryType::DIRECTORY) {
-        // Create destination directory
-        if (!addNewEntryInternal(destPath, true)) {
+    sessionOutput() << "Version\tSize\tDelta\tModified\n";
+    sessionOutput() << "0\t" << file->sizeInBytes << "\t-\t" << file->modificationDate << "\n";
+    for (size_t i = 0; i < file->history->versions.size(); ++i) {
+        const FileVersion& version = file->history->versions[i];
+        sessionOutput() << i + 1 << "\t" << version.size << "\t" << version.delta.size() << "\t"
+                        << version.modificationDate << "\n";
+    }
+}
+
+/**
+ * Parses and executes the history command
+ * @param command The full command string to parse
+ */
+void parseHistoryCommand(const std::string& command) {
+    auto args = tokenize(command);
+    uint64_t limit = 0;
+    if (args.size() == 2) {
+        listVersions(args[1]);
+    } else if (args.size() == 3 && parseByteCount(args[2], limit)) {
+        setHistoryLimit(args[1], static_cast<size_t>(limit));
+    } else {
+        sessionErrors() << "Usage: history <filename> [<versions>]\n";
+    }
+}
+
+/**
+ * Adds a new file or directory to the system (internal implementation without mutex)
+ * @param path The path of the file or directory to create
+ * @param isDirectory Whether to create a directory or a file
+ * @return True if successful, false otherwise
+ */
+bool addNewEntryInternal(const std::string& path, bool isDirectory) {
+    std::string normalizedPath;
+    if (!resolvePath(normalizePath(path), false, normalizedPath)) {
+        return false;
+    }
+    
+    // Check if the entry already exists
+    if (memoryFileSystem.find(normalizedPath) != memoryFileSystem.end()) {
+        sessionErrors() << "Error: Entry with the same path already exists: " << normalizedPath << "\n";
+        return false;
+    }
+    
+    if (isReadOnlyPath(normalizedPath)) {
+        return false;
+    }
+    
+    // Ensure parent directories exist
+    if (!ensureParentDirectoriesExist(normalizedPath)) {
+        sessionErrors() << "Error: Failed to create parent directories for " << normalizedPath << "\n";
+        return false;
+    }
+    
+    // Create a new entry and add it to the memoryFileSystem
+    preserveForSnapshots(normalizedPath);
+    memoryFileSystem[normalizedPath] = createEntry(isDirectory ? EntryType::DIRECTORY : EntryType::FILE);
+    invalidateHashes(normalizedPath);
+    
+    std::string entryType = isDirectory ? "Directory" : "File";
+    sessionOutput() << entryType << " created successfully: " << normalizedPath << "\n";
+    return true;
+}
+
+/**
+ * Thread-safe wrapper for adding a new file
+ * @param path The path of the file to create
+ * @return True if successful, false otherwise
+ */
+bool addNewFile(const std::string& path) {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::ADD_NEW_FILE);
+    return addNewEntryInternal(path, false);
+}
+
+/**
+ * Thread-safe wrapper for adding a new directory
+ * @param path The path of the directory to create
+ * @return True if successful, false otherwise
+ */
+bool addNewDirectory(const std::string& path) {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::ADD_NEW_DIRECTORY);
+    return addNewEntryInternal(path, true);
+}
+
+/**
+ * Creates multiple files under a single lock acquisition
+ * @param paths Vector of file paths to create
+ */
+void createMultipleFiles(const std::vector<std::string>& paths) {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::CREATE_MULTIPLE_FILES);
+    for (const auto& path : paths) {
+        addNewEntryInternal(path, false);
+    }
+}
+
+/**
+ * Parses and executes the create command
+ * @param command The full command string to parse
+ */
+void parseCreateCommand(const std::string& command) {
+    auto args = tokenize(command);
+    if (args.size() < 2) {
+        sessionErrors() << "Usage: create [-n <count>] <filename1> [<filename2> ...]\n";
+        return;
+    }
+    
+    size_t fileCount = 1;
+    size_t startIndex = 1;
+    
+    // Check if multiple files are specified with -n flag
+    if (args[1] == "-n") {
+        uint64_t count = 0;
+        if (args.size() < 3 || !parseByteCount(args[2], count)) {
+            sessionErrors() << "Usage: create [-n <count>] <filename1> [<filename2> ...]\n";
             return;
         }
+        fileCount = static_cast<size_t>(count);
+        startIndex = 3;
+    }
+    
+    // Validate argument count
+    if (args.size() - startIndex != fileCount) {
+        sessionErrors() << "Error: Number of filenames doesn't match specified count\n";
+        return;
+    }
+    
+    std::vector<std::string> paths(args.begin() + startIndex, args.end());
+    createMultipleFiles(paths);
+}
+
+/**
+ * Creates a new directory
+ * @param command The full command string to parse
+ */
+void parseMkdirCommand(const std::string& command) {
+    auto args = tokenize(command);
+    if (args.size() != 2) {
+        sessionErrors() << "Usage: mkdir <directory_path>\n";
+        return;
+    }
+    
+    addNewDirectory(args[1]);
+}
+
+/**
+ * Changes the current working directory
+ * @param command The full command string to parse
+ */
+void parseCdCommand(const std::string& command) {
+    auto args = tokenize(command);
+    if (args.size() != 2) {
+        sessionErrors() << "Usage: cd <directory_path>\n";
+        return;
+    }
+    
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::PARSE_CD_COMMAND);
+    
+    // The working directory is kept as the resolved path
+    std::string targetDir;
+    if (!resolvePath(normalizePath(args[1]), true, targetDir)) {
+        return;
+    }
+    
+    // Handle special case for root directory
+    if (targetDir == "/") {
+        activeSession->currentDirectory = "/";
+        sessionOutput() << "Changed directory to: " << activeSession->currentDirectory << "\n";
+        return;
+    }
+    
+    // Check if the directory exists, live, in a snapshot or frozen
+    const FSEntry* directory = findEntry(targetDir);
+    FrozenRef frozen;
+    if ((!directory || directory->type != EntryType::DIRECTORY) &&
+        !(findFrozen(targetDir, frozen) && frozen.type() == EntryType::DIRECTORY)) {
+        sessionErrors() << "Error: Directory does not exist: " << targetDir << "\n";
+        return;
+    }
+    
+    // Change current directory
+    activeSession->currentDirectory = targetDir;
+    sessionOutput() << "Changed directory to: " << activeSession->currentDirectory << "\n";
+}
+
+/**
+ * Prints the current working directory
+ */
+void printWorkingDirectory() {
+    sessionOutput() << "Current directory: " << activeSession->currentDirectory << "\n";
+}
+
+/**
+ * Adds or removes one path's attributes in the xattr index (caller must
+ * hold fileSystemMutex). Does nothing while the index is disabled.
+ * @param path The path carrying the attributes
+ * @param entry The inode the path refers to
+ * @param add True to add the path, false to remove it
+ */
+void updateXattrIndex(const std::string& path, const FSEntry& entry, bool add) {
+    if (!xattrIndexEnabled || !entry.xattrs) {
+        return;
+    }
+    
+    for (const auto& attribute : *entry.xattrs) {
+        std::string indexKey = attribute.first + "=" + attribute.second;
+        if (add) {
+            xattrIndex[indexKey].insert(path);
+            continue;
+        }
+        auto indexIter = xattrIndex.find(indexKey);
+        if (indexIter != xattrIndex.end()) {
+            indexIter->second.erase(path);
+            if (indexIter->second.empty()) {
+                xattrIndex.erase(indexIter);
+            }
+        }
+    }
+}
+
+/**
+ * Removes a path from the index and drops its link to the inode
+ * (caller must hold fileSystemMutex). The inode is freed with its last link.
+ * @param entryIterator Index entry of the path to remove
+ */
+void unlinkPath(std::unordered_map<std::string, std::shared_ptr<FSEntry>>::iterator entryIterator) {
+    preserveForSnapshots(entryIterator->first);
+    updateXattrIndex(entryIterator->first, *entryIterator->second, false);
+    if (entryIterator->second->type == EntryType::SYMLINK) {
+        symlinkCount--;
+        symlinkGeneration++;
+    }
+    entryIterator->second->linkCount--;
+    invalidateHashes(entryIterator->first);
+    memoryFileSystem.erase(entryIterator);
+}
+
+/**
+ * Gives a published inode its inode number and registers a path of it with
+ * the symlink and xattr bookkeeping (caller must hold fileSystemMutex)
+ * @param path The live path of the entry
+ * @param entry The inode
+ */
+void registerPublishedEntry(const std::string& path, FSEntry& entry) {
+    // Hard-linked inodes are reached once per path but numbered once
+    if (entry.inodeNumber == 0) {
+        entry.inodeNumber = nextInodeNumber++;
+    }
+    if (entry.type == EntryType::SYMLINK) {
+        symlinkCount++;
+    }
+    updateXattrIndex(path, entry, true);
+}
+
+/**
+ * Detaches every path below a directory from the index in one pass and
+ * hands the nodes to the reclaimer (caller must hold fileSystemMutex).
+ * Extraction only relinks the nodes; their keys, inodes and payloads are
+ * freed on the reclaimer thread.
+ * @param prefix The directory path followed by a slash
+ */
+void detachSubtree(const std::string& prefix) {
+    TraceSpan span("detach");
+    std::vector<DetachedNode> detached;
+    size_t detachedBytes = 0;
+    
+    for (auto entryIterator = memoryFileSystem.begin(); entryIterator != memoryFileSystem.end();) {
+        if (entryIterator->first.compare(0, prefix.size(), prefix) != 0 || entryIterator->first == "/") {
+            ++entryIterator;
+            continue;
+        }
+        
+        FSEntry& entry = *entryIterator->second;
+        preserveForSnapshots(entryIterator->first);
+        updateXattrIndex(entryIterator->first, entry, false);
+        if (entry.type == EntryType::SYMLINK) {
+            symlinkCount--;
+            symlinkGeneration++;
+        }
+        
+        // Inodes still linked elsewhere stay alive; only the path is released
+        detachedBytes += sizeof(void*) + sizeof(*entryIterator) + sizeof(size_t) + entryIterator->first.capacity();
+        if (--entry.linkCount == 0) {
+            detachedBytes += sizeof(FSEntry) + entry.data.allocatedBytes() + entry.symlinkTarget.capacity();
+        }
+        
+        auto next = std::next(entryIterator);
+        detached.push_back(memoryFileSystem.extract(entryIterator));
+        entryIterator = next;
+    }
+    
+    invalidateHashes(prefix.size() > 1 ? prefix.substr(0, prefix.size() - 1) : prefix);
+    reclaimer.enqueue(std::move(detached), detachedBytes);
+}
+
+/**
+ * Removes a file or directory from the system (internal implementation without mutex)
+ * @param path The path of the entry to remove
+ * @param recursive Whether to remove directories recursively
+ * @return True if successful, false otherwise
+ */
+bool removeEntryInternal(const std::string& path, bool recursive) {
+    // Removing a symlink removes the link itself, not its target
+    std::string normalizedPath;
+    if (!resolvePath(normalizePath(path), false, normalizedPath) || touchesFrozenTree(normalizedPath)) {
+        return false;
+    }
+    
+    auto entryIterator = memoryFileSystem.find(normalizedPath);
+    if (entryIterator == memoryFileSystem.end()) {
+        sessionErrors() << "Error: " << normalizedPath << " does not exist\n";
+        return false;
+    }
+    
+    if (entryIterator->second->type == EntryType::DIRECTORY) {
+        // Check for contents in the directory
+        std::string prefix = normalizedPath == "/" ? "/" : normalizedPath + "/";
+        
+        if (recursive) {
+            // Remove all entries inside the directory
+            detachSubtree(prefix);
+        } else {
+            // Check for contents in the directory
+            for (const auto& entry : memoryFileSystem) {
+                if (entry.first != normalizedPath && entry.first.find(prefix) == 0) {
+                    sessionErrors() << "Error: Directory not empty, use 'rmdir -r' for recursive deletion\n";
+                    return false;
+                }
+            }
+        }
+    }
+    
+    // Read the type before erasing, the iterator is invalid afterwards
+    std::string entryType = entryTypeName(entryIterator->second->type);
+    unlinkPath(entryIterator);
+    
+    sessionOutput() << entryType << " deleted successfully: " << normalizedPath << "\n";
+    return true;
+}
+
+/**
+ * Thread-safe wrapper for removing a file
+ * @param path The path of the file to remove
+ * @return True if successful, false otherwise
+ */
+bool removeFile(const std::string& path) {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::REMOVE_FILE);
+    return removeEntryInternal(path, false);
+}
+
+/**
+ * Thread-safe wrapper for removing a directory
+ * @param path The path of the directory to remove
+ * @param recursive Whether to remove recursively
+ * @return True if successful, false otherwise
+ */
+bool removeDirectory(const std::string& path, bool recursive) {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::REMOVE_DIRECTORY);
+    return removeEntryInternal(path, recursive);
+}
+
+/**
+ * Deletes multiple files under a single lock acquisition
+ * @param paths Vector of file paths to delete
+ */
+void deleteMultipleFiles(const std::vector<std::string>& paths) {
+    std::vector<std::string> missingFiles;
+    {
+        ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::DELETE_MULTIPLE_FILES);
+        for (const auto& path : paths) {
+            if (!removeEntryInternal(path, false)) {
+                missingFiles.push_back(path);
+            }
+        }
+    }
+    
+    // Report results
+    if (missingFiles.empty()) {
+        sessionOutput() << "Files deleted successfully\n";
+    } else {
+        sessionOutput() << "Some files were not found: ";
+        for (const auto& file : missingFiles) {
+            sessionOutput() << file << " ";
+        }
+        sessionOutput() << "\nRemaining files deleted successfully\n";
+    }
+}
+
+/**
+ * Parses and executes the delete command
+ * @param command The full command string to parse
+ */
+void parseDeleteCommand(const std::string& command) {
+    auto args = tokenize(command);
+    if (args.size() < 2) {
+        sessionErrors() << "Usage: delete [-n <count>] <filename1> [<filename2> ...]\n";
+        return;
+    }
+    
+    size_t fileCount = 1;
+    size_t startIndex = 1;
+    
+    // Check if multiple files are specified with -n flag
+    if (args[1] == "-n") {
+        uint64_t count = 0;
+        if (args.size() < 3 || !parseByteCount(args[2], count)) {
+            sessionErrors() << "Usage: delete [-n <count>] <filename1> [<filename2> ...]\n";
+            return;
+        }
+        fileCount = static_cast<size_t>(count);
+        startIndex = 3;
+    }
+    
+    // Validate argument count
+    if (args.size() - startIndex != fileCount) {
+        sessionErrors() << "Error: Number of filenames doesn't match specified count\n";
+        return;
+    }
+    
+    std::vector<std::string> paths(args.begin() + startIndex, args.end());
+    deleteMultipleFiles(paths);
+}
+
+/**
+ * Parses and executes the rmdir command
+ * @param command The full command string to parse
+ */
+void parseRmdirCommand(const std::string& command) {
+    auto args = tokenize(command);
+    if (args.size() < 2 || args.size() > 3) {
+        sessionErrors() << "Usage: rmdir [-r] <directory_path>\n";
+        return;
+    }
+    
+    bool recursive = false;
+    std::string dirPath;
+    
+    if (args.size() == 3 && args[1] == "-r") {
+        recursive = true;
+        dirPath = args[2];
+    } else {
+        dirPath = args[1];
+    }
+    
+    removeDirectory(dirPath, recursive);
+}
+
+// Subtrees with fewer entries than this are copied on the calling thread
+const size_t kParallelCopyThreshold = 4096;
+
+// Source entries a copy worker claims at a time
+const size_t kCopyChunk = 256;
+
+/**
+ * Threads that help the thread running cp build a recursive copy. They are
+ * started once, before cp takes fileSystemMutex, and sleep between copies,
+ * so no thread is ever created while the lock is held.
+ */
+class CopyWorkerPool {
+public:
+    ~CopyWorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(poolMutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    
+    /**
+     * Starts one thread per core beyond the caller's; does nothing once started
+     */
+    void start() {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        if (started) {
+            return;
+        }
+        started = true;
+        for (size_t index = 1; index < std::thread::hardware_concurrency(); ++index) {
+            threads.emplace_back(&CopyWorkerPool::run, this, index);
+        }
+    }
+    
+    /**
+     * @return Number of threads that can help, 0 before start
+     */
+    size_t size() {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        return threads.size();
+    }
+    
+    /**
+     * Runs a task on the caller as worker 0 and on pool threads as workers
+     * 1 to helpers, and returns when all of them are done. Only one task
+     * runs at a time; cp calls this under fileSystemMutex.
+     * @param helpers Number of pool threads to use, at most size()
+     * @param task Called with the worker index
+     */
+    void runTask(size_t helpers, const std::function<void(size_t)>& task) {
+        {
+            std::lock_guard<std::mutex> lock(poolMutex);
+            currentTask = &task;
+            activeHelpers = std::min(helpers, threads.size());
+            running = activeHelpers;
+            generation++;
+        }
+        wakeup.notify_all();
+        task(0);
+        
+        std::unique_lock<std::mutex> lock(poolMutex);
+        finished.wait(lock, [this]() { return running == 0; });
+        currentTask = nullptr;
+    }
+    
+private:
+    void run(size_t index) {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(poolMutex);
+        for (;;) {
+            wakeup.wait(lock, [&]() { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+            if (index > activeHelpers) {
+                continue;
+            }
+            
+            const std::function<void(size_t)>& task = *currentTask;
+            lock.unlock();
+            task(index);
+            lock.lock();
+            if (--running == 0) {
+                finished.notify_one();
+            }
+        }
+    }
+    
+    std::mutex poolMutex;
+    std::condition_variable wakeup;
+    std::condition_variable finished;
+    std::vector<std::thread> threads;
+    const std::function<void(size_t)>* currentTask = nullptr;
+    size_t activeHelpers = 0;   // Pool threads taking part in the current task
+    size_t running = 0;         // Of those, the ones not done yet
+    uint64_t generation = 0;    // Bumped for every task
+    bool started = false;
+    bool stopping = false;
+};
+
+CopyWorkerPool copyWorkers;
+
+/**
+ * Copies inodes into private indexes, one per worker thread. Workers claim
+ * chunks of the source list from a shared cursor, so a worker that runs
+ * ahead keeps taking over work the others have not reached. The copies
+ * get inode numbers when they are published with registerPublishedEntry.
+ * The caller holds fileSystemMutex for the whole copy, which keeps the
+ * sources stable; the workers only read them.
+ * @param sources Paths and inodes to copy
+ * @param sourcePrefixLength Length of the prefix each source path loses
+ * @param destPrefix Prefix each copied path gains
+ * @return The private indexes holding the copies
+ */
+std::vector<std::unordered_map<std::string, std::shared_ptr<FSEntry>>> copyEntries(
+        const std::vector<std::pair<const std::string*, const FSEntry*>>& sources,
+        size_t sourcePrefixLength, const std::string& destPrefix) {
+    TraceSpan span("copy");
+    size_t workerCount = 1;
+    if (sources.size() >= kParallelCopyThreshold) {
+        workerCount = std::max<size_t>(1, std::min<size_t>(copyWorkers.size() + 1, sources.size() / kCopyChunk));
+    }
+    
+    std::vector<std::unordered_map<std::string, std::shared_ptr<FSEntry>>> copies(workerCount);
+    std::atomic<size_t> nextChunk(0);
+    std::string date = getCurrentDateString();
+    
+    auto work = [&](size_t worker) {
+        auto& copy = copies[worker];
+        copy.reserve(sources.size() / workerCount + kCopyChunk);
+        size_t begin;
+        while ((begin = nextChunk.fetch_add(kCopyChunk, std::memory_order_relaxed)) < sources.size()) {
+            size_t end = std::min(begin + kCopyChunk, sources.size());
+            for (size_t i = begin; i < end; ++i) {
+                const std::string& sourcePath = *sources[i].first;
+                const FSEntry& source = *sources[i].second;
+                
+                std::string newPath;
+                newPath.reserve(destPrefix.size() + sourcePath.size() - sourcePrefixLength);
+                newPath.append(destPrefix).append(sourcePath, sourcePrefixLength, std::string::npos);
+                
+                // File buffers are shared copy-on-write, so this copies metadata only;
+                // hashes leave out dates and inode numbers, so they carry over
+                auto entry = createSubtreeEntry(source.type, date);
+                entry->data = source.data;
+                entry->sizeInBytes = source.sizeInBytes;
+                entry->symlinkTarget = source.symlinkTarget;
+                if (source.xattrs) {
+                    entry->xattrs.reset(new XattrList(*source.xattrs));
+                }
+                entry->treeHash = source.treeHash;
+                entry->hashValid = source.hashValid;
+                copy.emplace(std::move(newPath), std::move(entry));
+            }
+        }
+    };
+    
+    copyWorkers.runTask(workerCount - 1, work);
+    return copies;
+}
+
+/**
+ * Moves or renames a file or directory
+ * @param command The full command string to parse
+ */
+void parseMoveCommand(const std::string& command) {
+    auto args = tokenize(command);
+    if (args.size() != 3) {
+        sessionErrors() << "Usage: mv <source_path> <destination_path>\n";
+        return;
+    }
+    
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::PARSE_MOVE_COMMAND);
+    
+    // Moving a symlink moves the link itself
+    std::string sourcePath, destPath;
+    if (!resolvePath(normalizePath(args[1]), false, sourcePath) ||
+        !resolvePath(normalizePath(args[2]), false, destPath) || touchesFrozenTree(sourcePath)) {
+        return;
+    }
+    
+    // Check if source exists
+    auto sourceIter = memoryFileSystem.find(sourcePath);
+    if (sourceIter == memoryFileSystem.end()) {
+        sessionErrors() << "Error: Source does not exist: " << sourcePath << "\n";
+        return;
+    }
+    
+    // Check if destination exists
+    if (memoryFileSystem.find(destPath) != memoryFileSystem.end()) {
+        sessionErrors() << "Error: Destination already exists: " << destPath << "\n";
+        return;
+    }
+    
+    std::string sourcePrefix = sourcePath == "/" ? "/" : sourcePath + "/";
+    if (destPath.compare(0, sourcePrefix.size(), sourcePrefix) == 0) {
+        sessionErrors() << "Error: Cannot move " << sourcePath << " into itself\n";
+        return;
+    }
+    
+    if (isReadOnlyPath(destPath)) {
+        return;
+    }
+    
+    if (!ensureParentDirectoriesExist(destPath)) {
+        sessionErrors() << "Error: Failed to create parent directories for " << destPath << "\n";
+        return;
+    }
+    
+    // Collect the renames first; moving keeps the inodes, so hard links
+    // and attributes stay intact
+    std::vector<std::pair<std::string, std::string>> renames;
+    renames.emplace_back(sourcePath, destPath);
+    if (memoryFileSystem.at(sourcePath)->type == EntryType::DIRECTORY) {
+        std::string destPrefix = destPath == "/" ? "/" : destPath + "/";
+        for (const auto& entry : memoryFileSystem) {
+            if (entry.first != sourcePath && entry.first.find(sourcePrefix) == 0) {
+                renames.emplace_back(entry.first, destPrefix + entry.first.substr(sourcePrefix.length()));
+            }
+        }
+    }
+    
+    // Moved entries keep their hashes; only the directories on both paths change
+    for (const auto& rename : renames) {
+        preserveForSnapshots(rename.first);
+        preserveForSnapshots(rename.second);
+    }
+    invalidateHashes(sourcePath);
+    for (const auto& rename : renames) {
+        auto entryIter = memoryFileSystem.find(rename.first);
+        std::shared_ptr<FSEntry> inode = entryIter->second;
+        updateXattrIndex(rename.first, *inode, false);
+        memoryFileSystem.erase(entryIter);
+        memoryFileSystem[rename.second] = inode;
+        updateXattrIndex(rename.second, *inode, true);
+    }
+    invalidateHashes(destPath);
+    
+    // Symlinks may have moved with the tree
+    symlinkGeneration++;
+    
+    sessionOutput() << "Successfully moved " << sourcePath << " to " << destPath << "\n";
+}
+
+/**
+ * Copies a file or directory
+ * @param command The full command string to parse
+ */
+void parseCopyCommand(const std::string& command) {
+    auto args = tokenize(command);
+    if (args.size() != 3) {
+        sessionErrors() << "Usage: cp <source_path> <destination_path>\n";
+        return;
+    }
+    
+    // Helper threads are started before the lock is taken, and reused by later copies
+    copyWorkers.start();
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::PARSE_COPY_COMMAND);
+    
+    // Copying a symlink copies what it points to; links inside a copied tree stay links
+    std::string sourcePath, destPath;
+    if (!resolvePath(normalizePath(args[1]), true, sourcePath) ||
+        !resolvePath(normalizePath(args[2]), false, destPath) || touchesFrozenTree(sourcePath)) {
+        return;
+    }
+    
+    // Check if source exists; copying out of a snapshot restores from it
+    const FSEntry* source = sourcePath == kSnapshotsDirectory ? nullptr : findEntry(sourcePath);
+    if (!source) {
+        sessionErrors() << "Error: Source does not exist: " << sourcePath << "\n";
+        return;
+    }
+    
+    // Check if destination exists
+    if (findEntry(destPath)) {
+        sessionErrors() << "Error: Destination already exists: " << destPath << "\n";
+        return;
+    }
+    
+    // Neither a file nor a tree can be copied into a snapshot or a frozen subtree
+    if (isReadOnlyPath(destPath)) {
+        return;
+    }
+    
+    // If source is a directory, need to handle all contents
+    if (source->type == EntryType::DIRECTORY) {
+        // Collect the sources before the destination exists, so copying a
+        // directory into itself doesn't copy the copy
+        std::string liveSource;
+        bool fromSnapshot = snapshotOfPath(sourcePath, liveSource) != nullptr;
+        if (!fromSnapshot) {
+            liveSource = sourcePath;
+        }
+        std::string sourcePrefix = liveSource == "/" ? "/" : liveSource + "/";
+        std::vector<std::pair<const std::string*, const FSEntry*>> sources;
+        if (fromSnapshot) {
+            // Entries of a snapshot are keyed by the live path they were saved from
+            std::vector<std::string> pending = {sourcePath};
+            while (!pending.empty()) {
+                std::string directory = std::move(pending.back());
+                pending.pop_back();
+                forEachDirectoryEntry(directory, [&](const DirectoryEntryRef& child) {
+                    sources.emplace_back(child.path, child.entry);
+                    if (child.entry->type == EntryType::DIRECTORY) {
+                        pending.push_back(directory + "/" + std::string(child.name()));
+                    }
+                });
+            }
+        } else {
+            for (const auto& entry : memoryFileSystem) {
+                if (entry.first != sourcePath && entry.first.compare(0, sourcePrefix.size(), sourcePrefix) == 0) {
+                    sources.emplace_back(&entry.first, entry.second.get());
+                }
+            }
+        }
+        
+        // Create destination directory
+        if (!addNewEntryInternal(destPath, true)) {
+            return;
+        }
+        if (source->xattrs) {
+            FSEntry& root = *memoryFileSystem.find(destPath)->second;
+            root.xattrs.reset(new XattrList(*source->xattrs));
+            updateXattrIndex(destPath, root, true);
+        }
+        
+        // Build the copies in private indexes, then link them all in while still holding the lock
+        std::string destPrefix = destPath == "/" ? "/" : destPath + "/";
+        auto copies = copyEntries(sources, sourcePrefix.size(), destPrefix);
+        TraceSpan span("publish");
+        memoryFileSystem.reserve(memoryFileSystem.size() + sources.size());
+        for (auto& copy : copies) {
+            for (auto& entry : copy) {
+                preserveForSnapshots(entry.first);
+                registerPublishedEntry(entry.first, *entry.second);
+            }
+            memoryFileSystem.merge(copy);
+        }
+        symlinkGeneration++;
+    } else {
+        // For files, copy into a new inode with current dates
+        preserveForSnapshots(destPath);
+        auto copy = copyEntry(*source);
+        updateXattrIndex(destPath, *copy, true);
+        memoryFileSystem.emplace(destPath, std::move(copy));
+        
+        // The copy keeps its source's hash; only the directories above it change
+        invalidateHashes(getDirectoryFromPath(destPath));
+    }
+    
+    sessionOutput() << "Successfully copied " << sourcePath << " to " << destPath << "\n";
+}
+
+/**
+ * Adds a new name for an existing file; both names share one inode, so
+ * writes through either are visible through the other
+ * @param sourcePath The existing file
+ * @param destPath The new name, which must not exist yet
+ * @return True if the link was created
+ */
+bool linkEntry(const std::string& source, const std::string& dest) {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::LINK_ENTRY);
+    
+    // A symlink source links its target, as hard links to symlinks are not supported
+    std::string sourcePath, destPath;
+    if (!resolvePath(source, true, sourcePath) || !resolvePath(dest, false, destPath)) {
+        return false;
+    }
+    
+    auto sourceIter = memoryFileSystem.find(sourcePath);
+    if (sourceIter == memoryFileSystem.end()) {
+        sessionErrors() << "Error: Source does not exist: " << sourcePath << "\n";
+        return false;
+    }
+    if (sourceIter->second->type != EntryType::FILE) {
+        sessionErrors() << "Error: Cannot hard link a directory: " << sourcePath << "\n";
+        return false;
+    }
+    if (memoryFileSystem.find(destPath) != memoryFileSystem.end()) {
+        sessionErrors() << "Error: Destination already exists: " << destPath << "\n";
+        return false;
+    }
+    
+    // Hold the inode before creating parents, which may rehash the index
+    std::shared_ptr<FSEntry> inode = sourceIter->second;
+    if (!ensureParentDirectoriesExist(destPath)) {
+        return false;
+    }
+    
+    // The link count is part of the inode every snapshot sharing it shows
+    preserveForSnapshots(sourcePath);
+    preserveForSnapshots(destPath);
+    inode->linkCount++;
+    memoryFileSystem[destPath] = inode;
+    updateXattrIndex(destPath, *inode, true);
+    invalidateHashes(destPath);
+    return true;
+}
+
+/**
+ * Creates a symbolic link. The target is stored as given and resolved on
+ * every access, so it may be relative, dangling or created later.
+ * @param target The path the link points to
+ * @param linkPath The normalized path of the new link, which must not exist yet
+ * @return True if the link was created
+ */
+bool createSymlink(const std::string& target, const std::string& linkPath) {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::CREATE_SYMLINK);
+    
+    std::string destPath;
+    if (!resolvePath(linkPath, false, destPath)) {
+        return false;
+    }
+    if (memoryFileSystem.find(destPath) != memoryFileSystem.end()) {
+        sessionErrors() << "Error: Destination already exists: " << destPath << "\n";
+        return false;
+    }
+    if (!ensureParentDirectoriesExist(destPath)) {
+        return false;
+    }
+    
+    auto link = createEntry(EntryType::SYMLINK);
+    link->symlinkTarget = target;
+    link->sizeInBytes = target.size();
+    preserveForSnapshots(destPath);
+    memoryFileSystem[destPath] = link;
+    invalidateHashes(destPath);
+    return true;
+}
+
+/**
+ * Parses and executes the ln command
+ * @param command The full command string to parse
+ */
+void parseLinkCommand(const std::string& command) {
+    auto args = tokenize(command);
+    if (args.size() == 4 && args[1] == "-s") {
+        if (createSymlink(args[2], normalizePath(args[3]))) {
+            sessionOutput() << "Linked " << normalizePath(args[3]) << " -> " << args[2] << "\n";
+        }
+        return;
+    }
+    if (args.size() != 3) {
+        sessionErrors() << "Usage: ln [-s] <source_file> <link_path>\n";
+        return;
+    }
+    
+    std::string sourcePath = normalizePath(args[1]);
+    std::string destPath = normalizePath(args[2]);
+    if (linkEntry(sourcePath, destPath)) {
+        sessionOutput() << "Linked " << destPath << " to " << sourcePath << "\n";
+    }
+}
+
+/**
+ * Stores an attribute in an inode's sorted attribute list, without
+ * touching the xattr index
+ * @param entry The inode
+ * @param key The attribute name
+ * @param value The attribute value
+ */
+void storeXattr(FSEntry& entry, const std::string& key, const std::string& value) {
+    if (!entry.xattrs) {
+        entry.xattrs.reset(new XattrList());
+    }
+    auto position = std::lower_bound(entry.xattrs->begin(), entry.xattrs->end(), key,
+        [](const std::pair<std::string, std::string>& attribute, const std::string& name) {
+            return attribute.first < name;
+        });
+    if (position != entry.xattrs->end() && position->first == key) {
+        position->second = value;
+    } else {
+        entry.xattrs->emplace(position, key, value);
+    }
+}
+
+/**
+ * Sets an extended attribute on an inode and updates the xattr index for
+ * all of its paths (caller must hold fileSystemMutex)
+ * @param path One path of the inode
+ * @param entry The inode
+ * @param key The attribute name
+ * @param value The attribute value
+ */
+void setEntryXattr(const std::string& path, FSEntry& entry, const std::string& key, const std::string& value) {
+    preserveForSnapshots(path);
+    std::vector<std::string> paths = pathsOfInode(path, entry);
+    for (const auto& p : paths) {
+        updateXattrIndex(p, entry, false);
+    }
+    
+    storeXattr(entry, key, value);
+    
+    for (const auto& p : paths) {
+        updateXattrIndex(p, entry, true);
+        invalidateHashes(p);
+    }
+}
+
+/**
+ * Looks up an entry for an xattr command, following symlinks
+ * (caller must hold fileSystemMutex)
+ * @param path The path as given by the user
+ * @param resolvedPath Receives the resolved path
+ * @return The entry, or nullptr after printing an error
+ */
+FSEntry* findXattrEntry(const std::string& path, std::string& resolvedPath) {
+    if (!resolvePath(normalizePath(path), true, resolvedPath)) {
+        return nullptr;
+    }
+    auto entryIter = memoryFileSystem.find(resolvedPath);
+    if (entryIter != memoryFileSystem.end()) {
+        return entryIter->second.get();
+    }
+    
+    // Frozen entries have left the index
+    FrozenRef frozen;
+    if (findFrozen(resolvedPath, frozen)) {
+        sessionErrors() << "Error: " << resolvedPath << " is in frozen subtree " << frozen.tree->root
+                        << ", unfreeze it first\n";
+    } else {
+        sessionErrors() << "Error: Entry does not exist: " << resolvedPath << "\n";
+    }
+    return nullptr;
+}
+
+/**
+ * Parses and executes the setxattr command
+ * @param command The full command string to parse
+ */
+void parseSetXattrCommand(const std::string& command) {
+    auto args = tokenize(command);
+    if (args.size() != 4 || args[2].find('=') != std::string::npos) {
+        sessionErrors() << "Usage: setxattr <path> <key> <value> (key must not contain '=')\n";
+        return;
+    }
+    
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::SET_XATTR);
+    std::string resolvedPath;
+    FSEntry* entry = findXattrEntry(args[1], resolvedPath);
+    if (entry == nullptr) {
+        return;
+    }
+    
+    setEntryXattr(resolvedPath, *entry, args[2], args[3]);
+    sessionOutput() << "Set " << args[2] << " on " << resolvedPath << "\n";
+}
+
+/**
+ * Parses and executes the removexattr command
+ * @param command The full command string to parse
+ */
+void parseRemoveXattrCommand(const std::string& command) {
+    auto args = tokenize(command);
+    if (args.size() != 3) {
+        sessionErrors() << "Usage: removexattr <path> <key>\n";
+        return;
+    }
+    
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::REMOVE_XATTR);
+    std::string resolvedPath;
+    FSEntry* entry = findXattrEntry(args[1], resolvedPath);
+    if (entry == nullptr) {
+        return;
+    }
+    
+    auto matchesKey = [&](const std::pair<std::string, std::string>& attribute) {
+        return attribute.first == args[2];
+    };
+    if (!entry->xattrs || std::none_of(entry->xattrs->begin(), entry->xattrs->end(), matchesKey)) {
+        sessionErrors() << "Error: No attribute " << args[2] << " on " << resolvedPath << "\n";
+        return;
+    }
+    
+    preserveForSnapshots(resolvedPath);
+    std::vector<std::string> paths = pathsOfInode(resolvedPath, *entry);
+    for (const auto& p : paths) {
+        updateXattrIndex(p, *entry, false);
+    }
+    entry->xattrs->erase(std::remove_if(entry->xattrs->begin(), entry->xattrs->end(), matchesKey),
+                         entry->xattrs->end());
+    if (entry->xattrs->empty()) {
+        entry->xattrs.reset();
+    }
+    for (const auto& p : paths) {
+        updateXattrIndex(p, *entry, true);
+        invalidateHashes(p);
+    }
+    
+    sessionOutput() << "Removed " << args[2] << " from " << resolvedPath << "\n";
+}
+
+/**
+ * Parses and executes the getxattr command
+ * @param command The full command string to parse
+ */
+void parseGetXattrCommand(const std::string& command) {
+    auto args = tokenize(command);
+    if (args.size() != 3) {
+        sessionErrors() << "Usage: getxattr <path> <key>\n";
+        return;
+    }
+    
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::GET_XATTR);
+    std::string resolvedPath;
+    FSEntry* entry = findXattrEntry(args[1], resolvedPath);
+    if (entry == nullptr) {
+        return;
+    }
+    
+    if (entry->xattrs) {
+        for (const auto& attribute : *entry->xattrs) {
+            if (attribute.first == args[2]) {
+                sessionOutput() << attribute.first << "=" << attribute.second << "\n";
+                return;
+            }
+        }
+    }
+    sessionErrors() << "Error: No attribute " << args[2] << " on " << resolvedPath << "\n";
+}
+
+/**
+ * Parses and executes the listxattr command
+ * @param command The full command string to parse
+ */
+void parseListXattrCommand(const std::string& command) {
+    auto args = tokenize(command);
+    if (args.size() != 2) {
+        sessionErrors() << "Usage: listxattr <path>\n";
+        return;
+    }
+    
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::LIST_XATTR);
+    std::string resolvedPath;
+    FSEntry* entry = findXattrEntry(args[1], resolvedPath);
+    if (entry == nullptr) {
+        return;
+    }
+    
+    if (!entry->xattrs) {
+        sessionOutput() << "No extended attributes on: " << resolvedPath << "\n";
+        return;
+    }
+    for (const auto& attribute : *entry->xattrs) {
+        sessionOutput() << attribute.first << "=" << attribute.second << "\n";
+    }
+}
+
+/**
+ * Finds entries carrying an extended attribute with a given value. Uses
+ * the inverted index when enabled, so the cost is proportional to the
+ * matches; otherwise scans the whole namespace.
+ * @param command The full command string to parse
+ */
+void parseFindCommand(const std::string& command) {
+    auto args = tokenize(command);
+    std::string directory = "/";
+    size_t optionIndex = 1;
+    if (args.size() == 4) {
+        directory = args[1];
+        optionIndex = 2;
+    }
+    
+    size_t separator = args.size() == optionIndex + 2 ? args[optionIndex + 1].find('=') : std::string::npos;
+    if (args.size() < 3 || args.size() > 4 || args[optionIndex] != "-xattr" ||
+        separator == std::string::npos || separator == 0) {
+        sessionErrors() << "Usage: find [<directory>] -xattr <key>=<value>\n";
+        return;
+    }
+    const std::string& attribute = args[optionIndex + 1];
+    std::string key = attribute.substr(0, separator);
+    std::string value = attribute.substr(separator + 1);
+    
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::FIND_BY_XATTR);
+    std::string resolvedDirectory;
+    if (!resolvePath(normalizePath(directory), true, resolvedDirectory)) {
+        return;
+    }
+    std::string prefix = resolvedDirectory == "/" ? "/" : resolvedDirectory + "/";
+    auto underDirectory = [&](const std::string& path) {
+        return path == resolvedDirectory || path.compare(0, prefix.size(), prefix) == 0;
+    };
+    
+    std::vector<std::string> matches;
+    if (xattrIndexEnabled) {
+        TraceSpan span("index lookup");
+        auto indexIter = xattrIndex.find(attribute);
+        if (indexIter != xattrIndex.end()) {
+            for (const auto& path : indexIter->second) {
+                if (underDirectory(path)) {
+                    matches.push_back(path);
+                }
+            }
+        }
+    } else {
+        TraceSpan span("index scan");
+        for (const auto& entry : memoryFileSystem) {
+            if (!entry.second->xattrs || !underDirectory(entry.first)) {
+                continue;
+            }
+            for (const auto& candidate : *entry.second->xattrs) {
+                if (candidate.first == key && candidate.second == value) {
+                    matches.push_back(entry.first);
+                    break;
+                }
+            }
+        }
+    }
+    
+    TraceSpan outputSpan("output");
+    if (matches.empty()) {
+        sessionOutput() << "No entries found with " << attribute << "\n";
+        return;
+    }
+    std::sort(matches.begin(), matches.end());
+    for (const auto& path : matches) {
+        sessionOutput() << path << "\n";
+    }
+}
+
+/**
+ * Enables, disables or reports the inverted xattr index used by find.
+ * Enabling builds the index with one scan of the namespace.
+ * @param command The full command string to parse
+ */
+void parseXattrIndexCommand(const std::string& command) {
+    auto args = tokenize(command);
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::SET_XATTR_INDEX);
+    
+    if (args.size() == 1) {
+        size_t postings = 0;
+        for (const auto& indexEntry : xattrIndex) {
+            postings += indexEntry.second.size();
+        }
+        sessionOutput() << "Xattr index: " << (xattrIndexEnabled ? "on" : "off") << ", "
+                        << xattrIndex.size() << " values, " << postings << " paths\n";
+    } else if (args.size() == 2 && args[1] == "on") {
+        if (!xattrIndexEnabled) {
+            xattrIndexEnabled = true;
+            for (const auto& entry : memoryFileSystem) {
+                updateXattrIndex(entry.first, *entry.second, true);
+            }
+        }
+        sessionOutput() << "Xattr index enabled with " << xattrIndex.size() << " values\n";
+    } else if (args.size() == 2 && args[1] == "off") {
+        xattrIndexEnabled = false;
+        xattrIndex.clear();
+        sessionOutput() << "Xattr index disabled\n";
+    } else {
+        sessionErrors() << "Usage: xattrindex [on|off]\n";
+    }
+}
+
+// Memfd threshold used by 'memfd on' when none is given
+const size_t kDefaultMemfdThreshold = 1 << 20;
+
+/**
+ * Parses and executes the memfd command, which shows or sets the size from
+ * which file buffers are stored in sealed memfds
+ * @param command The full command string to parse
+ */
+void parseMemfdCommand(const std::string& command) {
+    auto args = tokenize(command);
+    uint64_t threshold = kDefaultMemfdThreshold;
+    
+    if (args.size() == 1) {
+        size_t current = FileContent::memfdThreshold();
+        if (current == 0) {
+            sessionOutput() << "Memfd storage: off\n";
+        } else {
+            sessionOutput() << "Memfd storage: on for buffers of " << current << " bytes or more\n";
+        }
+    } else if ((args.size() == 2 || args.size() == 3) && args[1] == "on" &&
+               (args.size() == 2 || (parseByteCount(args[2], threshold) && threshold > 0))) {
+        FileContent::setMemfdThreshold(threshold);
+        sessionOutput() << "Memfd storage enabled for buffers of " << threshold << " bytes or more\n";
+    } else if (args.size() == 2 && args[1] == "off") {
+        FileContent::setMemfdThreshold(0);
+        sessionOutput() << "Memfd storage disabled\n";
+    } else {
+        sessionErrors() << "Usage: memfd [on [<min_bytes>]|off]\n";
+    }
+}
+
+/**
+ * Gets the sealed memfd buffer holding a whole file, moving the file's
+ * content into one first if needed
+ * @param path The file to share
+ * @return The buffer, or null after printing an error
+ */
+std::shared_ptr<const ContentBuffer> sharedBufferOf(const std::string& path) {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::SHARE_FILE);
+    
+    std::string normalizedPath;
+    if (!resolvePath(normalizePath(path), true, normalizedPath)) {
+        return nullptr;
+    }
+    
+    auto entryIterator = memoryFileSystem.find(normalizedPath);
+    if (entryIterator == memoryFileSystem.end() || entryIterator->second->type != EntryType::FILE) {
+        sessionErrors() << "Error: File not found: " << normalizedPath << "\n";
+        return nullptr;
+    }
+    if (entryIterator->second->data.empty()) {
+        sessionErrors() << "Error: Cannot share an empty file: " << normalizedPath << "\n";
+        return nullptr;
+    }
+    
+    auto buffer = entryIterator->second->data.sealedBuffer();
+    if (!buffer) {
+        sessionErrors() << "Error: Could not create a sealed memfd for " << normalizedPath << "\n";
+    } else if (entryIterator->second->history) {
+        // Only the storage changed; keep the history from pinning the old buffers
+        entryIterator->second->history->latest = entryIterator->second->data;
+    }
+    return buffer;
+}
+
+int shareFileDescriptor(const std::string& path, uint64_t& size) {
+    auto buffer = sharedBufferOf(path);
+    if (!buffer) {
+        return -1;
+    }
+    size = buffer->size();
+    return fcntl(buffer->memfd, F_DUPFD_CLOEXEC, 0);
+}
+
+/**
+ * Parses and executes the share command, which moves a file into a sealed
+ * memfd and shows where local processes can open it
+ * @param command The full command string to parse
+ */
+void parseShareCommand(const std::string& command) {
+    auto args = tokenize(command);
+    if (args.size() != 2) {
+        sessionErrors() << "Usage: share <path>\n";
+        return;
+    }
+    
+    auto buffer = sharedBufferOf(args[1]);
+    if (buffer) {
+        sessionOutput() << "Shared " << normalizePath(args[1]) << ": " << buffer->size()
+                        << " bytes in a sealed memfd at /proc/" << getpid() << "/fd/" << buffer->memfd << "\n";
+    }
+}
+
+/**
+ * Exposes a host file in the namespace without copying it. The file is
+ * mapped read-only and reads are served from the page cache; a write puts
+ * the bytes it changes in private memory and leaves the rest mapped.
+ * @param hostPath The host file, which must not change while attached
+ * @param path The file system path to create or replace
+ * @return True if successful, false otherwise
+ */
+bool attachHostFile(const std::string& hostPath, const std::string& path) {
+    // Open and map before taking the lock, this may wait for I/O
+    int fd = open(hostPath.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) != 0 || !S_ISREG(status.st_mode)) {
+        sessionErrors() << "Error: Cannot attach " << hostPath << ": "
+                        << (fd < 0 || S_ISREG(status.st_mode) ? std::strerror(errno) : "not a regular file") << "\n";
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    std::shared_ptr<const ContentBuffer> buffer;
+    if (status.st_size > 0) {
+        buffer = ContentBuffer::mapFile(fd, static_cast<size_t>(status.st_size));
+    }
+    int mapError = errno;
+    close(fd);
+    if (status.st_size > 0 && !buffer) {
+        sessionErrors() << "Error: Cannot map " << hostPath << ": " << std::strerror(mapError) << "\n";
+        return false;
+    }
+    
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::ATTACH_FILE);
+    std::string normalizedPath;
+    FSEntry* file = openFileForReplace(path, normalizedPath);
+    if (!file) {
+        return false;
+    }
+    if (buffer) {
+        file->data.assign(std::move(buffer));
+    } else {
+        file->data.assign(std::string());
+    }
+    file->sizeInBytes = static_cast<size_t>(status.st_size);
+    recordVersion(normalizedPath, *file);
+    
+    sessionOutput() << "Attached " << hostPath << " (" << status.st_size << " bytes) at " << normalizedPath << "\n";
+    return true;
+}
+
+/**
+ * Parses and executes the attach command
+ * @param command The full command string to parse
+ */
+void parseAttachCommand(const std::string& command) {
+    auto args = tokenize(command);
+    if (args.size() != 3) {
+        sessionErrors() << "Usage: attach <host_file> <path>\n";
+        return;
+    }
+    attachHostFile(args[1], args[2]);
+}
+
+// Direct children of directories, keyed by the directory's path
+using ChildIndex = std::unordered_map<std::string_view, std::vector<DirectoryEntryRef>>;
+
+/**
+ * Groups the entries below some directories by parent in one scan of the
+ * index (caller must hold fileSystemMutex)
+ * @param roots Normalized paths of the directories
+ * @return The children of every directory below and including the roots
+ */
+ChildIndex indexChildren(const std::vector<std::string>& roots) {
+    TraceSpan span("index scan");
+    std::vector<std::string> prefixes;
+    for (const auto& root : roots) {
+        prefixes.push_back(root == "/" ? "/" : root + "/");
+    }
+    
+    ChildIndex children;
+    for (const auto& entry : memoryFileSystem) {
+        bool below = entry.first != "/" && std::any_of(prefixes.begin(), prefixes.end(), [&](const std::string& prefix) {
+            return entry.first.compare(0, prefix.size(), prefix) == 0;
+        });
+        if (below) {
+            size_t slash = entry.first.find_last_of('/');
+            std::string_view parent(entry.first.data(), slash == 0 ? 1 : slash);
+            children[parent].push_back(DirectoryEntryRef{&entry.first, slash + 1, entry.second.get()});
+        }
+    }
+    return children;
+}
+
+/**
+ * Groups the entries of a directory tree as a snapshot shows it by parent
+ * (caller must hold fileSystemMutex)
+ * @param snapshot The snapshot
+ * @param liveRoot Live path of the directory within the snapshot
+ * @return The children of every directory below and including the root
+ */
+ChildIndex indexSnapshotChildren(const Snapshot& snapshot, const std::string& liveRoot) {
+    ChildIndex children = indexChildren({liveRoot});
+    for (auto& directory : children) {
+        auto& refs = directory.second;
+        refs.erase(std::remove_if(refs.begin(), refs.end(), [&](const DirectoryEntryRef& child) {
+            return snapshot.preserved.count(*child.path) != 0;
+        }), refs.end());
+    }
+    for (const auto& saved : snapshot.preserved) {
+        if (saved.second && saved.first != liveRoot && isWithin(saved.first, liveRoot)) {
+            size_t slash = saved.first.find_last_of('/');
+            std::string_view parent(saved.first.data(), slash == 0 ? 1 : slash);
+            children[parent].push_back(DirectoryEntryRef{&saved.first, slash + 1, saved.second.get()});
+        }
+    }
+    return children;
+}
+
+/**
+ * Returns the Merkle hash of an entry, recomputing only stale hashes
+ * (caller must hold fileSystemMutex). A file hashes its type, content and
+ * attributes; a directory adds the names and hashes of its children, summed
+ * so their order does not matter. Dates and inode numbers are left out, so
+ * a copy hashes like its source.
+ * @param path Normalized path of the entry
+ * @param entry The entry
+ * @param children Children of the directories below path
+ * @return The hash
+ */
+uint64_t treeHashOf(const std::string& path, const FSEntry& entry, const ChildIndex& children) {
+    if (entry.hashValid) {
+        return entry.treeHash;
+    }
+    
+    std::hash<std::string_view> hashString;
+    uint64_t hash = mixHash(static_cast<uint64_t>(entry.type) + 1);
+    if (entry.type == EntryType::FILE) {
+        hash = mixHash(hash ^ entry.data.contentHash());
+    } else if (entry.type == EntryType::SYMLINK) {
+        hash = mixHash(hash ^ hashString(entry.symlinkTarget));
+    } else {
+        auto childIterator = children.find(path);
+        uint64_t sum = 0;
+        if (childIterator != children.end()) {
+            for (const auto& child : childIterator->second) {
+                sum += mixHash(hashString(child.name()) ^ treeHashOf(*child.path, *child.entry, children));
+            }
+        }
+        hash = mixHash(hash ^ sum);
+    }
+    if (entry.xattrs) {
+        for (const auto& attribute : *entry.xattrs) {
+            hash = mixHash(hash ^ hashString(attribute.first));
+            hash = mixHash(hash ^ hashString(attribute.second));
+        }
+    }
+    
+    entry.treeHash = hash;
+    entry.hashValid = true;
+    return hash;
+}
+
+/**
+ * Prints the differences between two entries, descending only into
+ * directories whose hashes differ (caller must hold fileSystemMutex)
+ * @param pathA Normalized path of the first entry
+ * @param entryA The first entry
+ * @param pathB Normalized path of the second entry
+ * @param entryB The second entry
+ * @param relative Path of both entries relative to the compared roots, or
+ *                 the path to print when the roots are not both directories
+ * @param childrenA Children of the directories below the first root
+ * @param childrenB Children of the directories below the second root
+ * @param compared Incremented for every pair of entries compared
+ * @return Number of differences printed
+ */
+size_t diffEntries(const std::string& pathA, const FSEntry& entryA, const std::string& pathB, const FSEntry& entryB,
+                   const std::string& relative, const ChildIndex& childrenA, const ChildIndex& childrenB,
+                   size_t& compared) {
+    compared++;
+    if (treeHashOf(pathA, entryA, childrenA) == treeHashOf(pathB, entryB, childrenB)) {
+        return 0;
+    }
+    if (entryA.type != EntryType::DIRECTORY || entryB.type != EntryType::DIRECTORY) {
+        sessionOutput() << "M " << relative << "\n";
+        return 1;
+    }
+    
+    // Pair the children by name, in name order
+    std::map<std::string_view, std::pair<const DirectoryEntryRef*, const DirectoryEntryRef*>> pairs;
+    auto listA = childrenA.find(pathA);
+    auto listB = childrenB.find(pathB);
+    if (listA != childrenA.end()) {
+        for (const auto& child : listA->second) {
+            pairs[child.name()].first = &child;
+        }
+    }
+    if (listB != childrenB.end()) {
+        for (const auto& child : listB->second) {
+            pairs[child.name()].second = &child;
+        }
+    }
+    
+    size_t differences = 0;
+    for (const auto& pair : pairs) {
+        std::string childRelative = (relative == "/" ? "/" : relative + "/") + std::string(pair.first);
+        const DirectoryEntryRef* childA = pair.second.first;
+        const DirectoryEntryRef* childB = pair.second.second;
+        if (childA && childB) {
+            differences += diffEntries(*childA->path, *childA->entry, *childB->path, *childB->entry,
+                                       childRelative, childrenA, childrenB, compared);
+        } else {
+            const DirectoryEntryRef* only = childA ? childA : childB;
+            sessionOutput() << (childA ? "- " : "+ ") << childRelative
+                            << (only->entry->type == EntryType::DIRECTORY ? "/" : "") << "\n";
+            differences++;
+        }
+    }
+    return differences;
+}
+
+/**
+ * Compares two files or directory trees and prints what differs: "- path"
+ * only in the first, "+ path" only in the second, "M path" changed. Subtrees
+ * with equal Merkle hashes are skipped without being visited. Either path
+ * may be inside a snapshot.
+ * @param first The first path
+ * @param second The second path
+ */
+void diffTrees(const std::string& first, const std::string& second) {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::DIFF_TREES);
+    
+    std::string pathA, pathB;
+    if (!resolvePath(normalizePath(first), true, pathA) || !resolvePath(normalizePath(second), true, pathB) ||
+        touchesFrozenTree(pathA) || touchesFrozenTree(pathB)) {
+        return;
+    }
+    const FSEntry* entryA = pathA == kSnapshotsDirectory ? nullptr : findEntry(pathA);
+    const FSEntry* entryB = pathB == kSnapshotsDirectory ? nullptr : findEntry(pathB);
+    if (!entryA || !entryB) {
+        sessionErrors() << "Error: Path does not exist: " << (entryA ? pathB : pathA) << "\n";
+        return;
+    }
+    
+    // Snapshot entries are keyed by their live paths, with children of their own
+    std::string liveA, liveB;
+    const Snapshot* snapshotA = snapshotOfPath(pathA, liveA);
+    const Snapshot* snapshotB = snapshotOfPath(pathB, liveB);
+    if (!snapshotA) {
+        liveA = pathA;
+    }
+    if (!snapshotB) {
+        liveB = pathB;
+    }
+    
+    // Up-to-date equal hashes answer without looking at the trees at all
+    const FSEntry& a = *entryA;
+    const FSEntry& b = *entryB;
+    size_t compared = 0;
+    size_t differences = 0;
+    if (!(a.hashValid && b.hashValid && a.treeHash == b.treeHash)) {
+        bool directories = a.type == EntryType::DIRECTORY && b.type == EntryType::DIRECTORY;
+        if (!snapshotA && !snapshotB) {
+            ChildIndex children = indexChildren({liveA, liveB});
+            differences = diffEntries(liveA, a, liveB, b, directories ? "/" : pathA, children, children, compared);
+        } else {
+            ChildIndex childrenA = snapshotA ? indexSnapshotChildren(*snapshotA, liveA) : indexChildren({liveA});
+            ChildIndex childrenB = snapshotB ? indexSnapshotChildren(*snapshotB, liveB) : indexChildren({liveB});
+            differences = diffEntries(liveA, a, liveB, b, directories ? "/" : pathA, childrenA, childrenB, compared);
+        }
+    }
+    
+    if (differences == 0) {
+        sessionOutput() << "No differences between " << pathA << " and " << pathB << "\n";
+    } else {
+        sessionOutput() << differences << " difference(s) between " << pathA << " and " << pathB
+                        << ", " << compared << " entries compared\n";
+    }
+}
+
+/**
+ * Parses and executes the diff command
+ * @param command The full command string to parse
+ */
+void parseDiffCommand(const std::string& command) {
+    auto args = tokenize(command);
+    if (args.size() != 3) {
+        sessionErrors() << "Usage: diff <path1> <path2>\n";
+        return;
+    }
+    diffTrees(args[1], args[2]);
+}
+
+/**
+ * Takes a snapshot of a directory tree. Nothing is copied: the snapshot
+ * records its root and later changes preserve what they replace.
+ * @param name Name of the snapshot, shown as /.snapshots/<name>
+ * @param path The directory to snapshot
+ * @return True if the snapshot was taken
+ */
+bool createSnapshot(const std::string& name, const std::string& path) {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::PARSE_SNAPSHOT_COMMAND);
+    
+    if (name.empty() || name == "." || name == ".." || name.find('/') != std::string::npos) {
+        sessionErrors() << "Error: Invalid snapshot name: " << name << "\n";
+        return false;
+    }
+    if (snapshots.count(name) != 0) {
+        sessionErrors() << "Error: Snapshot already exists: " << name << "\n";
+        return false;
+    }
+    
+    std::string root;
+    if (!resolvePath(normalizePath(path), true, root)) {
+        return false;
+    }
+    if (isWithin(root, kSnapshotsDirectory)) {
+        sessionErrors() << "Error: Cannot snapshot a snapshot: " << root << "\n";
+        return false;
+    }
+    if (touchesFrozenTree(root)) {
+        return false;
+    }
+    if (!directoryExists(root)) {
+        sessionErrors() << "Error: Directory does not exist: " << root << "\n";
+        return false;
+    }
+    
+    if (!snapshotsDirectoryEntry) {
+        snapshotsDirectoryEntry = createEntry(EntryType::DIRECTORY);
+    }
+    Snapshot& snapshot = snapshots[name];
+    snapshot.root = root;
+    snapshot.viewPath = kSnapshotsDirectory + "/" + name;
+    snapshot.creationDate = getCurrentDateString();
+    
+    sessionOutput() << "Created snapshot " << name << " of " << root << " at " << snapshot.viewPath << "\n";
+    return true;
+}
+
+/**
+ * Deletes a snapshot, handing the entries it preserved to the reclaimer
+ * @param name Name of the snapshot
+ * @return True if the snapshot was deleted
+ */
+bool deleteSnapshot(const std::string& name) {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::PARSE_SNAPSHOT_COMMAND);
+    
+    auto snapshotIterator = snapshots.find(name);
+    if (snapshotIterator == snapshots.end()) {
+        sessionErrors() << "Error: Snapshot does not exist: " << name << "\n";
+        return false;
+    }
+    
+    // Content buffers may still be shared with the live tree, so only the
+    // nodes and entries are counted
+    auto& preserved = snapshotIterator->second.preserved;
+    std::vector<DetachedNode> detached;
+    size_t detachedBytes = 0;
+    detached.reserve(preserved.size());
+    while (!preserved.empty()) {
+        auto node = preserved.extract(preserved.begin());
+        detachedBytes += sizeof(void*) + sizeof(node.key()) + sizeof(node.mapped()) + node.key().capacity();
+        if (node.mapped()) {
+            detachedBytes += sizeof(FSEntry) + node.mapped()->symlinkTarget.capacity();
+        }
+        detached.push_back(std::move(node));
+    }
+    snapshots.erase(snapshotIterator);
+    reclaimer.enqueue(std::move(detached), detachedBytes);
+    
+    sessionOutput() << "Deleted snapshot " << name << "\n";
+    return true;
+}
+
+/**
+ * Lists the snapshots with their roots and the entries they preserve
+ */
+void listSnapshots() {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::PARSE_SNAPSHOT_COMMAND);
+    
+    if (snapshots.empty()) {
+        sessionOutput() << "No snapshots\n";
+        return;
+    }
+    sessionOutput() << "Name\tRoot\tCreated\t\tPreserved\n";
+    for (const auto& named : snapshots) {
+        sessionOutput() << named.first << "\t" << named.second.root << "\t" << named.second.creationDate << "\t"
+                        << named.second.preserved.size() << "\n";
+    }
+}
+
+/**
+ * Parses and executes the snapshot command
+ * @param command The full command string to parse
+ */
+void parseSnapshotCommand(const std::string& command) {
+    auto args = tokenize(command);
+    if (args.size() == 4 && args[1] == "create") {
+        createSnapshot(args[2], args[3]);
+    } else if (args.size() == 3 && args[1] == "delete") {
+        deleteSnapshot(args[2]);
+    } else if (args.size() == 2 && args[1] == "list") {
+        listSnapshots();
+    } else {
+        sessionErrors() << "Usage: snapshot create <name> <directory> | snapshot delete <name> | snapshot list\n";
+    }
+}
+
+/**
+ * Orders paths so that every directory is directly followed by everything
+ * below it: compared bytewise, with the separator before any other byte
+ */
+bool frozenPathLess(std::string_view a, std::string_view b) {
+    auto rank = [](char c) {
+        return c == '/' ? 0 : static_cast<unsigned char>(c) + 1;
+    };
+    return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(), [&](char x, char y) {
+        return rank(x) < rank(y);
+    });
+}
+
+/**
+ * Builds the frozen form of the entries below a directory
+ * @param root The directory
+ * @param members Paths relative to the root with their entries, sorted by frozenPathLess
+ * @return The tree, or null if no perfect hash could be built
+ */
+std::shared_ptr<FrozenTree> buildFrozenTree(const std::string& root,
+                                            const std::vector<std::pair<std::string_view, const FSEntry*>>& members) {
+    TraceSpan span("freeze");
+    auto tree = std::make_shared<FrozenTree>();
+    tree->root = root;
+    
+    std::vector<std::string_view> names;
+    names.reserve(members.size());
+    uint64_t payloadSize = 0;
+    for (const auto& member : members) {
+        names.push_back(member.first);
+        payloadSize += member.second->type == EntryType::SYMLINK ? member.second->symlinkTarget.size()
+                                                                  : member.second->data.size();
+    }
+    if (!tree->names.build(names)) {
+        return nullptr;
+    }
+    
+    // Content goes into one buffer in name order, so a directory's files are adjacent
+    std::string payload;
+    payload.reserve(payloadSize);
+    std::unordered_map<std::string, uint32_t> dateIndex;
+    auto internDate = [&](const std::string& date) {
+        auto inserted = dateIndex.emplace(date, static_cast<uint32_t>(tree->dates.size()));
+        if (inserted.second) {
+            tree->dates.push_back(date);
+        }
+        return inserted.first->second;
+    };
+    
+    std::vector<size_t> openDirectories;
+    tree->entries.reserve(members.size());
+    for (size_t position = 0; position < members.size(); ++position) {
+        const FSEntry& source = *members[position].second;
+        
+        // Directories that do not contain this path end just before it
+        while (!openDirectories.empty() && !isWithin(std::string(members[position].first),
+                                                     std::string(members[openDirectories.back()].first))) {
+            tree->entries[openDirectories.back()].subtreeEnd = static_cast<uint32_t>(position);
+            openDirectories.pop_back();
+        }
+        
+        FrozenEntry entry;
+        entry.payloadOffset = payload.size();
+        entry.inodeNumber = source.inodeNumber;
+        entry.subtreeEnd = static_cast<uint32_t>(position + 1);
+        entry.creationDate = internDate(source.creationDate);
+        entry.modificationDate = internDate(source.modificationDate);
+        entry.type = source.type;
+        if (source.type == EntryType::SYMLINK) {
+            payload.append(source.symlinkTarget);
+        } else if (source.type == EntryType::FILE) {
+            source.data.forEachRun([&](uint64_t, const char* data, uint64_t length) {
+                payload.append(data, length);
+            });
+        }
+        entry.size = payload.size() - entry.payloadOffset;
+        tree->entries.push_back(entry);
+        if (source.type == EntryType::DIRECTORY) {
+            openDirectories.push_back(position);
+        }
+        if (source.xattrs && !source.xattrs->empty()) {
+            tree->xattrs.emplace(static_cast<uint32_t>(position), *source.xattrs);
+        }
+    }
+    for (size_t directory : openDirectories) {
+        tree->entries[directory].subtreeEnd = static_cast<uint32_t>(members.size());
+    }
+    
+    size_t threshold = FileContent::memfdThreshold();
+    if (threshold != 0 && payload.size() >= threshold) {
+        tree->payload = ContentBuffer::createSealed(payload.data(), payload.size());
+    }
+    if (!tree->payload) {
+        tree->payload = std::make_shared<const ContentBuffer>(std::move(payload));
+    }
+    return tree;
+}
+
+/**
+ * Converts the tree below a directory into its frozen form. The entries
+ * leave the live index, which frees their nodes and inodes; from then on
+ * the tree is read-only and read without locks.
+ * @param path The directory to freeze, which stays a live directory
+ * @return True if the tree was frozen
+ */
+bool freezeSubtree(const std::string& path) {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::FREEZE_SUBTREE);
+    
+    std::string root;
+    if (!resolvePath(normalizePath(path), true, root) || touchesFrozenTree(root)) {
+        return false;
+    }
+    if (isWithin(root, kSnapshotsDirectory) || !directoryExists(root)) {
+        sessionErrors() << "Error: Directory does not exist: " << root << "\n";
+        return false;
+    }
+    for (const auto& named : snapshots) {
+        if (isWithin(root, named.second.root) || isWithin(named.second.root, root)) {
+            sessionErrors() << "Error: " << root << " overlaps snapshot " << named.first << "\n";
+            return false;
+        }
+    }
+    
+    // Hard links, holes and history have no frozen form
+    std::string prefix = root == "/" ? "/" : root + "/";
+    std::vector<std::pair<std::string_view, const FSEntry*>> members;
+    for (const auto& entry : memoryFileSystem) {
+        if (entry.first == root || entry.first.compare(0, prefix.size(), prefix) != 0) {
+            continue;
+        }
+        const FSEntry& inode = *entry.second;
+        if (inode.linkCount > 1 || inode.history || inode.data.hasHoles()) {
+            const char* reason = inode.linkCount > 1 ? "it has hard links" :
+                                 inode.history ? "it keeps history" : "it is sparse";
+            sessionErrors() << "Error: Cannot freeze " << entry.first << ": " << reason << "\n";
+            return false;
+        }
+        members.emplace_back(std::string_view(entry.first).substr(prefix.size()), &inode);
+    }
+    std::sort(members.begin(), members.end(), [](const auto& a, const auto& b) {
+        return frozenPathLess(a.first, b.first);
+    });
+    
+    std::shared_ptr<FrozenTree> tree = buildFrozenTree(root, members);
+    if (!tree) {
+        sessionErrors() << "Error: Could not build the lookup table for " << root << "\n";
+        return false;
+    }
+    
+    // The frozen tree is complete, so the live entries can go
+    std::vector<DetachedNode> detached;
+    size_t detachedBytes = 0;
+    detached.reserve(members.size());
+    for (const auto& member : members) {
+        auto node = memoryFileSystem.extract(prefix + std::string(member.first));
+        updateXattrIndex(node.key(), *node.mapped(), false);
+        if (node.mapped()->type == EntryType::SYMLINK) {
+            symlinkCount--;
+            frozenSymlinkCount++;
+        }
+        detachedBytes += sizeof(void*) + sizeof(node.key()) + sizeof(node.mapped()) + node.key().capacity() +
+                         sizeof(FSEntry) + node.mapped()->data.allocatedBytes() + node.mapped()->symlinkTarget.capacity();
+        detached.push_back(std::move(node));
+    }
+    symlinkGeneration++;
+    invalidateHashes(root);
+    reclaimer.enqueue(std::move(detached), detachedBytes);
+    
+    auto trees = std::make_shared<FrozenTreeList>(*frozenTrees);
+    trees->push_back(tree);
+    std::atomic_store(&frozenTrees, std::shared_ptr<const FrozenTreeList>(std::move(trees)));
+    
+    sessionOutput() << "Froze " << root << ": " << tree->entries.size() << " entries, " << tree->payload->size()
+                    << " payload bytes, " << tree->indexBytes() << " index bytes\n";
+    return true;
+}
+
+/**
+ * Converts a frozen tree back into live entries. File contents become
+ * slices of the frozen payload, so nothing is copied.
+ * @param path The root of the frozen tree
+ * @return True if the tree was unfrozen
+ */
+bool unfreezeSubtree(const std::string& path) {
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::UNFREEZE_SUBTREE);
+    
+    std::string root;
+    if (!resolvePath(normalizePath(path), true, root)) {
+        return false;
+    }
+    auto trees = std::make_shared<FrozenTreeList>(*frozenTrees);
+    auto treeIterator = std::find_if(trees->begin(), trees->end(), [&](const std::shared_ptr<const FrozenTree>& tree) {
+        return tree->root == root;
+    });
+    if (treeIterator == trees->end()) {
+        sessionErrors() << "Error: " << root << " is not frozen\n";
+        return false;
+    }
+    
+    const FrozenTree& tree = **treeIterator;
+    std::string prefix = root == "/" ? "/" : root + "/";
+    memoryFileSystem.reserve(memoryFileSystem.size() + tree.entries.size());
+    for (size_t position = 0; position < tree.entries.size(); ++position) {
+        const FrozenEntry& frozen = tree.entries[position];
+        auto entry = std::make_shared<FSEntry>();
+        entry->sizeInBytes = static_cast<size_t>(frozen.size);
+        entry->creationDate = tree.dates[frozen.creationDate];
+        entry->modificationDate = tree.dates[frozen.modificationDate];
+        entry->type = frozen.type;
+        if (frozen.type == EntryType::FILE) {
+            entry->data = tree.content(position);
+        } else if (frozen.type == EntryType::SYMLINK) {
+            entry->symlinkTarget = tree.symlinkTarget(position);
+            frozenSymlinkCount--;
+        }
+        auto attributes = tree.xattrs.find(static_cast<uint32_t>(position));
+        if (attributes != tree.xattrs.end()) {
+            entry->xattrs.reset(new XattrList(attributes->second));
+        }
+        entry->inodeNumber = frozen.inodeNumber;
+        entry->linkCount = 1;
+        entry->treeHash = 0;
+        entry->hashValid = false;
+        
+        std::string livePath = prefix + tree.names.name(position);
+        registerPublishedEntry(livePath, *entry);
+        memoryFileSystem.emplace(std::move(livePath), std::move(entry));
+    }
+    symlinkGeneration++;
+    invalidateHashes(root);
+    
+    size_t entryCount = tree.entries.size();
+    trees->erase(treeIterator);
+    std::atomic_store(&frozenTrees, std::shared_ptr<const FrozenTreeList>(std::move(trees)));
+    
+    sessionOutput() << "Unfroze " << root << ": " << entryCount << " entries\n";
+    return true;
+}
+
+/**
+ * Parses and executes the freeze and unfreeze commands; freeze without a
+ * path lists the frozen subtrees
+ * @param command The full command string to parse
+ */
+void parseFreezeCommand(const std::string& command) {
+    auto args = tokenize(command);
+    bool freeze = args[0] == "freeze";
+    if (args.size() == 2) {
+        if (freeze) {
+            freezeSubtree(args[1]);
+        } else {
+            unfreezeSubtree(args[1]);
+        }
+    } else if (args.size() == 1 && freeze) {
+        auto trees = std::atomic_load(&frozenTrees);
+        if (trees->empty()) {
+            sessionOutput() << "No frozen subtrees\n";
+        }
+        for (const auto& tree : *trees) {
+            sessionOutput() << tree->root << ": " << tree->entries.size() << " entries, " << tree->payload->size()
+                            << " payload bytes, " << tree->indexBytes() << " index bytes\n";
+        }
+    } else {
+        sessionErrors() << "Usage: freeze [<directory>] | unfreeze <directory>\n";
+    }
+}
+
+/**
+ * Searches for files or directories matching a pattern
+ * @param command The full command string to parse
+ */
+void parseSearchCommand(const std::string& command) {
+    auto args = tokenize(command);
+    if (args.size() != 2) {
+        sessionErrors() << "Usage: search <pattern>\n";
+        return;
+    }
+    
+    std::string pattern = args[1];
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::PARSE_SEARCH_COMMAND);
+    
+    bool found = false;
+    sessionOutput() << "Search results for pattern: " << pattern << "\n";
+    
+    TraceSpan span("index scan");
+    for (const auto& entry : memoryFileSystem) {
+        std::string filename = getFilenameFromPath(entry.first);
+        if (filename.find(pattern) != std::string::npos) {
+            std::string typeStr = entry.second->type == EntryType::FILE ? "FILE" :
+                                  entry.second->type == EntryType::DIRECTORY ? "DIR" : "LINK";
+            sessionOutput() << typeStr << "\t" << entry.first << "\n";
+            found = true;
+        }
+    }
+    
+    if (!found) {
+        sessionOutput() << "No matching entries found.\n";
+    }
+}
+
+/**
+ * Displays information about an entry of a frozen subtree
+ * @param path Normalized path of the entry
+ * @param found The entry in its frozen tree
+ */
+void displayFrozenInfo(const std::string& path, const FrozenRef& found) {
+    const FrozenTree& tree = *found.tree;
+    const FrozenEntry& entry = tree.entries[found.position];
+    sessionOutput() << "Information for: " << path << "\n";
+    sessionOutput() << "Type: " << entryTypeName(entry.type) << "\n";
+    sessionOutput() << "Size: " << entry.size << " bytes\n";
+    if (entry.type == EntryType::SYMLINK) {
+        sessionOutput() << "Target: " << tree.symlinkTarget(found.position) << "\n";
+    }
+    sessionOutput() << "Inode: " << entry.inodeNumber << "\n";
+    sessionOutput() << "Links: 1\n";
+    sessionOutput() << "Created: " << tree.dates[entry.creationDate] << "\n";
+    sessionOutput() << "Modified: " << tree.dates[entry.modificationDate] << "\n";
+    sessionOutput() << "Frozen in: " << tree.root << "\n";
+    
+    if (entry.type == EntryType::DIRECTORY) {
+        size_t childCount = 0;
+        tree.forEachChild(found.position, [&](size_t) {
+            childCount++;
+        });
+        sessionOutput() << "Direct children: " << childCount << "\n";
+    }
+}
+
+/**
+ * Displays detailed information about a file or directory
+ * @param command The full command string to parse
+ */
+void parseInfoCommand(const std::string& command) {
+    auto args = tokenize(command);
+    if (args.size() != 2) {
+        sessionErrors() << "Usage: info <path>\n";
+        return;
+    }
+    
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::PARSE_INFO_COMMAND);
+    
+    // Like lstat, a symlink in the last component is described itself
+    std::string normalizedPath;
+    if (!resolvePath(normalizePath(args[1]), false, normalizedPath)) {
+        return;
+    }
+    
+    FrozenRef frozen;
+    bool isFrozen = findFrozen(normalizedPath, frozen);
+    if (isFrozen && !frozen.isRoot()) {
+        displayFrozenInfo(normalizedPath, frozen);
+        return;
+    }
+    
+    const FSEntry* found = findEntry(normalizedPath);
+    if (!found) {
+        sessionErrors() << "Error: Entry does not exist: " << normalizedPath << "\n";
+        return;
+    }
+    const FSEntry& entry = *found;
+    
+    sessionOutput() << "Information for: " << normalizedPath << "\n";
+    sessionOutput() << "Type: " << entryTypeName(entry.type) << "\n";
+    sessionOutput() << "Size: " << entry.sizeInBytes << " bytes\n";
+    if (entry.type == EntryType::FILE) {
+        sessionOutput() << "Allocated: " << entry.data.allocatedBytes() << " bytes\n";
+        uint64_t attachedBytes = 0;
+        std::unordered_set<const ContentBuffer*> seenBuffers;
+        entry.data.forEachBuffer([&](const ContentBuffer& buffer) {
+            if (buffer.hostMapped() && seenBuffers.insert(&buffer).second) {
+                attachedBytes += buffer.size();
+            }
+        });
+        if (attachedBytes != 0) {
+            sessionOutput() << "Mapped from host: " << attachedBytes << " bytes\n";
+        }
+        if (entry.history) {
+            sessionOutput() << "Versions: " << entry.history->versions.size() << " of " << entry.history->limit << " kept\n";
+        }
+    } else if (entry.type == EntryType::SYMLINK) {
+        sessionOutput() << "Target: " << entry.symlinkTarget << "\n";
+    }
+    sessionOutput() << "Inode: " << entry.inodeNumber << "\n";
+    sessionOutput() << "Links: " << entry.linkCount << "\n";
+    sessionOutput() << "Created: " << entry.creationDate << "\n";
+    sessionOutput() << "Modified: " << entry.modificationDate << "\n";
+    
+    if (entry.type == EntryType::DIRECTORY) {
+        // Count number of direct children
+        size_t childCount = 0;
+        if (isFrozen) {
+            frozen.tree->forEachChild(frozen.position, [&](size_t) {
+                childCount++;
+            });
+            sessionOutput() << "Frozen: yes\n";
+        } else {
+            forEachDirectoryEntry(normalizedPath, [&](const DirectoryEntryRef&) {
+                childCount++;
+            });
+        }
+        
+        sessionOutput() << "Direct children: " << childCount << "\n";
+    }
+}
+
+/**
+ * Private index of a SubtreeBuilder. Keys are paths within the subtree
+ * written as absolute paths, "/" being the subtree root.
+ */
+struct SubtreeIndex {
+    std::unordered_map<std::string, std::shared_ptr<FSEntry>> entries;
+    std::string date;           // Timestamp given to entries the builder creates
+    std::string lastParent;     // Most recent parent directory known to exist
+};
+
+/**
+ * Converts a builder path to the form used as key in a SubtreeIndex
+ * @param path Path relative to the subtree root, with or without a leading slash
+ * @return The path with a leading slash and no trailing slash
+ */
+std::string subtreeKey(const std::string& path) {
+    std::string key = path.empty() || path[0] != '/' ? "/" + path : path;
+    while (key.size() > 1 && key.back() == '/') {
+        key.pop_back();
+    }
+    return key;
+}
+
+/**
+ * Adds an entry to a subtree, creating missing parent directories. Entries
+ * are usually added directory by directory, so the last parent found is
+ * remembered and the walk up the tree is skipped for its siblings.
+ * @param index The subtree index
+ * @param key Path of the entry within the subtree
+ * @param entry The inode to add
+ */
+void addSubtreeEntry(SubtreeIndex& index, const std::string& key, std::shared_ptr<FSEntry> entry) {
+    std::string parent = getDirectoryFromPath(key);
+    if (parent != index.lastParent) {
+        std::vector<std::string> missing;
+        for (std::string directory = parent; index.entries.find(directory) == index.entries.end();
+             directory = getDirectoryFromPath(directory)) {
+            missing.push_back(directory);
+        }
+        for (auto it = missing.rbegin(); it != missing.rend(); ++it) {
+            index.entries.emplace(*it, createSubtreeEntry(EntryType::DIRECTORY, index.date));
+        }
+        index.lastParent = parent;
+    }
+    index.entries[key] = std::move(entry);
+}
+
+SubtreeBuilder::SubtreeBuilder(size_t expectedEntries) : index(new SubtreeIndex()) {
+    index->date = getCurrentDateString();
+    index->entries.reserve(expectedEntries + 1);
+    index->entries.emplace("/", createSubtreeEntry(EntryType::DIRECTORY, index->date));
+    index->lastParent = "/";
+}
+
+SubtreeBuilder::~SubtreeBuilder() = default;
+
+void SubtreeBuilder::addDirectory(const std::string& path) {
+    std::string key = subtreeKey(path);
+    if (index->entries.find(key) == index->entries.end()) {
+        addSubtreeEntry(*index, key, createSubtreeEntry(EntryType::DIRECTORY, index->date));
+    }
+}
+
+void SubtreeBuilder::addFile(const std::string& path, std::string content) {
+    auto file = createSubtreeEntry(EntryType::FILE, index->date);
+    file->sizeInBytes = content.size();
+    file->data.assign(std::move(content));
+    addSubtreeEntry(*index, subtreeKey(path), std::move(file));
+}
+
+void SubtreeBuilder::addSymlink(const std::string& path, const std::string& target) {
+    auto link = createSubtreeEntry(EntryType::SYMLINK, index->date);
+    link->symlinkTarget = target;
+    link->sizeInBytes = target.size();
+    addSubtreeEntry(*index, subtreeKey(path), std::move(link));
+}
+
+/**
+ * Completes a dump payload that getline cut short at a newline of its own.
+ * The newline is put back and the missing bytes are read as they are, then
+ * the rest of the line after them is appended.
+ * @param in The dump, positioned after the newline that ended the line
+ * @param data The payload read so far
+ * @param needed Number of payload bytes that must be present
+ * @return False if the dump ends inside the payload
+ */
+bool completeDumpPayload(std::istream& in, std::string& data, size_t needed) {
+    if (data.size() >= needed) {
+        return true;
+    }
+    
+    data.push_back('\n');
+    char buffer[64 * 1024];
+    while (data.size() < needed) {
+        in.read(buffer, static_cast<std::streamsize>(std::min(sizeof(buffer), needed - data.size())));
+        data.append(buffer, static_cast<size_t>(in.gcount()));
+        if (!in) {
+            return false;
+        }
+    }
+    
+    std::string rest;
+    std::getline(in, rest);
+    data += rest;
+    return true;
+}
+
+void SubtreeBuilder::addFromDump(std::istream& in) {
+    auto& entries = index->entries;
+    std::string line;
+    size_t lineNum = 0;
+    
+    // Skip header lines starting with #
+    while (std::getline(in, line)) {
+        lineNum++;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        
+        // Attribute lines: XATTR|<path>|<key>|<value>
+        if (line.compare(0, 6, "XATTR|") == 0) {
+            size_t keyStart = line.find('|', 6);
+            size_t valueStart = keyStart == std::string::npos ? keyStart : line.find('|', keyStart + 1);
+            auto entryIter = valueStart == std::string::npos ? entries.end() :
+                             entries.find(line.substr(6, keyStart - 6));
+            if (entryIter == entries.end()) {
+                sessionErrors() << "Warning: Invalid attribute at line " << lineNum << ", skipping\n";
+                continue;
+            }
+            storeXattr(*entryIter->second, line.substr(keyStart + 1, valueStart - keyStart - 1),
+                       line.substr(valueStart + 1));
+            continue;
+        }
+        
+        // Parse entry line
+        std::stringstream ss(line);
+        std::string typeStr, path, sizeStr, created, modified, data;
+        
+        // Split by | delimiter
+        if (!std::getline(ss, typeStr, '|') ||
+            !std::getline(ss, path, '|') ||
+            !std::getline(ss, sizeStr, '|') ||
+            !std::getline(ss, created, '|') ||
+            !std::getline(ss, modified, '|')) {
+            
+            sessionErrors() << "Warning: Invalid format at line " << lineNum << ", skipping\n";
+            continue;
+        }
+        
+        // Dumps from older versions may hold a spurious entry with an empty path
+        if (path.empty()) {
+            continue;
+        }
+        
+        // Get remaining part as data
+        std::getline(ss, data);
+        
+        if (typeStr == "LINK") {
+            // Hard link to an inode loaded from an earlier line
+            auto target = entries.find(data);
+            if (target == entries.end() || target->second->type != EntryType::FILE) {
+                sessionErrors() << "Warning: Link target not found at line " << lineNum << ", skipping\n";
+                continue;
+            }
+            target->second->linkCount++;
+            addSubtreeEntry(*index, path, target->second);
+            continue;
+        }
         
-        // Copy all contents
-        std::string sourcePrefix = sourcePath == "/" ? "/" : sourcePath + "/";
-        std::string destPrefix = destPath == "/" ? "/" : destPath + "/";
+        // Create entry
+        auto entryPointer = createSubtreeEntry(typeStr == "DIR" ? EntryType::DIRECTORY :
+                                               typeStr == "SYMLINK" ? EntryType::SYMLINK : EntryType::FILE,
+                                               created);
+        FSEntry& entry = *entryPointer;
+        uint64_t size = 0;
+        if (!parseByteCount(sizeStr, size)) {
+            sessionErrors() << "Warning: Invalid size at line " << lineNum << ", skipping\n";
+            continue;
+        }
+        entry.sizeInBytes = static_cast<size_t>(size);
+        entry.modificationDate = modified;
         
-        // Collect and copy all entries
-        for (const auto& entry : memoryFileSystem) {
-            if (entry.first != sourcePath && entry.first.find(sourcePrefix) == 0) {
-                std::string relativePath = entry.first.substr(sourcePrefix.length());
-                std::string newPath = destPrefix + relativePath;
-                
-                // Create a new entry with updated timestamps
-                FSEntry newEntry = entry.second;
-                newEntry.creationDate = getCurrentDateString();
-                newEntry.modificationDate = getCurrentDateString();
-                
-                memoryFileSystem[newPath] = newEntry;
+        if (typeStr == "SPARSE") {
+            // Rebuild the allocated extents; everything else stays a hole
+            size_t position = 0;
+            while (position < data.size()) {
+                size_t firstColon = data.find(':', position);
+                size_t secondColon = firstColon == std::string::npos ? firstColon : data.find(':', firstColon + 1);
+                if (secondColon == std::string::npos) {
+                    sessionErrors() << "Warning: Invalid sparse extent at line " << lineNum << "\n";
+                    break;
+                }
+                uint64_t offset = 0, length = 0;
+                if (!parseByteCount(std::string_view(data).substr(position, firstColon - position), offset) ||
+                    !parseByteCount(std::string_view(data).substr(firstColon + 1, secondColon - firstColon - 1),
+                                    length) ||
+                    !completeDumpPayload(in, data, secondColon + 1 + std::min<uint64_t>(length, SIZE_MAX / 2))) {
+                    sessionErrors() << "Warning: Invalid sparse extent at line " << lineNum << "\n";
+                    break;
+                }
+                length = std::min<uint64_t>(length, data.size() - (secondColon + 1));
+                if (!entry.data.write(offset, data.data() + secondColon + 1, length)) {
+                    sessionErrors() << "Warning: Invalid sparse extent at line " << lineNum << "\n";
+                    break;
+                }
+                position = secondColon + 1 + length;
             }
+            entry.data.truncate(entry.sizeInBytes);
+        } else if (typeStr == "SYMLINK") {
+            entry.symlinkTarget = data;
+        } else if (typeStr != "DIR") {
+            if (!completeDumpPayload(in, data, entry.sizeInBytes)) {
+                sessionErrors() << "Warning: Truncated content at line " << lineNum << "\n";
+            }
+            entry.data.assign(std::move(data));
+        }
+        
+        if (path == "/") {
+            entries["/"] = entryPointer;
+        } else {
+            addSubtreeEntry(*index, path, entryPointer);
         }
-    } else {
-        // For files, just copy the entry
-        memoryFileSystem[destPath] = destEntry;
     }
-    
-    std::cout << "Successfully copied " << sourcePath << " to " << destPath << "\n";
 }
 
-/**
- * Searches for files or directories matching a pattern
- * @param command The full command string to parse
- */
-void parseSearchCommand(const std::string& command) {
-    auto args = tokenize(command);
-    if (args.size() != 2) {
-        std::cerr << "Usage: search <pattern>\n";
-        return;
-    }
-    
-    std::string pattern = args[1];
-    std::lock_guard<std::mutex> lock(fileSystemMutex);
-    
-    bool found = false;
-    std::cout << "Search results for pattern: " << pattern << "\n";
-    
-    for (const auto& entry : memoryFileSystem) {
-        std::string filename = getFilenameFromPath(entry.first);
-        if (filename.find(pattern) != std::string::npos) {
-            std::string typeStr = entry.second.type == EntryType::FILE ? "FILE" : "DIR";
-            std::cout << typeStr << "\t" << entry.first << "\n";
-            found = true;
+size_t SubtreeBuilder::size() const {
+    return index->entries.size();
+}
+
+bool SubtreeBuilder::spliceInto(const std::string& mountPath) {
+    // The private index is freed after the lock is released
+    std::unordered_map<std::string, std::shared_ptr<FSEntry>> published;
+    {
+        ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::SPLICE_SUBTREE);
+        TraceSpan span("splice");
+        
+        std::string mount;
+        if (!resolvePath(normalizePath(mountPath), false, mount)) {
+            return false;
+        }
+        if (memoryFileSystem.find(mount) != memoryFileSystem.end()) {
+            sessionErrors() << "Error: Destination already exists: " << mount << "\n";
+            return false;
+        }
+        if (isReadOnlyPath(mount)) {
+            return false;
+        }
+        if (!ensureParentDirectoriesExist(mount)) {
+            sessionErrors() << "Error: Failed to create parent directories for " << mount << "\n";
+            return false;
+        }
+        
+        // Size the live index once so the splice never rehashes midway
+        memoryFileSystem.reserve(memoryFileSystem.size() + index->entries.size());
+        for (auto& entry : index->entries) {
+            std::string livePath = entry.first == "/" ? mount : mount + entry.first;
+            preserveForSnapshots(livePath);
+            registerPublishedEntry(livePath, *entry.second);
+            memoryFileSystem.emplace(std::move(livePath), entry.second);
         }
+        invalidateHashes(mount);
+        symlinkGeneration++;
+        published.swap(index->entries);
     }
     
-    if (!found) {
-        std::cout << "No matching entries found.\n";
-    }
+    index->lastParent.clear();
+    return true;
 }
 
-/**
- * Displays detailed information about a file or directory
- * @param command The full command string to parse
- */
-void parseInfoCommand(const std::string& command) {
-    auto args = tokenize(command);
-    if (args.size() != 2) {
-        std::cerr << "Usage: info <path>\n";
-        return;
-    }
-    
-    std::string normalizedPath = normalizePath(args[1]);
-    std::lock_guard<std::mutex> lock(fileSystemMutex);
-    
-    auto entryIter = memoryFileSystem.find(normalizedPath);
-    if (entryIter == memoryFileSystem.end()) {
-        std::cerr << "Error: Entry does not exist: " << normalizedPath << "\n";
-        return;
-    }
-    
-    std::cout << "Information for: " << normalizedPath << "\n";
-    std::cout << "Type: " << (entryIter->second.type == EntryType::FILE ? "File" : "Directory") << "\n";
-    std::cout << "Size: " << entryIter->second.sizeInBytes << " bytes\n";
-    std::cout << "Created: " << entryIter->second.creationDate << "\n";
-    std::cout << "Modified: " << entryIter->second.modificationDate << "\n";
-    
-    if (entryIter->second.type == EntryType::DIRECTORY) {
-        // Count number of direct children
-        size_t childCount = 0;
-        std::string prefix = normalizedPath == "/" ? "/" : normalizedPath + "/";
+void SubtreeBuilder::replaceNamespace() {
+    // The old namespace is freed after the lock is released
+    std::unordered_map<std::string, std::shared_ptr<FSEntry>> previous;
+    {
+        ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::REPLACE_NAMESPACE);
+        TraceSpan span("splice");
         
-        for (const auto& entry : memoryFileSystem) {
-            if (entry.first != normalizedPath && entry.first.find(prefix) == 0) {
-                std::string relativePath = entry.first.substr(prefix.length());
-                if (relativePath.find('/') == std::string::npos) {
-                    childCount++;
-                }
+        // Snapshots keep showing the namespace being replaced
+        if (!snapshots.empty()) {
+            for (const auto& entry : memoryFileSystem) {
+                preserveForSnapshots(entry.first);
+            }
+            for (const auto& entry : index->entries) {
+                preserveForSnapshots(entry.first);
             }
         }
         
-        std::cout << "Direct children: " << childCount << "\n";
+        previous.swap(memoryFileSystem);
+        memoryFileSystem.swap(index->entries);
+        std::atomic_store(&frozenTrees, std::make_shared<const FrozenTreeList>());
+        
+        symlinkCount = 0;
+        frozenSymlinkCount = 0;
+        symlinkGeneration++;
+        xattrIndex.clear();
+        for (auto& entry : memoryFileSystem) {
+            registerPublishedEntry(entry.first, *entry.second);
+        }
     }
+    
+    index->lastParent.clear();
 }
 
 /**
@@ -980,43 +4376,108 @@ void parseInfoCommand(const std::string& command) {
 void parseSaveCommand(const std::string& command) {
     auto args = tokenize(command);
     if (args.size() != 2) {
-        std::cerr << "Usage: save <filename>\n";
+        sessionErrors() << "Usage: save <filename>\n";
         return;
     }
     
     std::string filename = args[1];
-    std::lock_guard<std::mutex> lock(fileSystemMutex);
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::PARSE_SAVE_COMMAND);
     
     std::ofstream outFile(filename);
     if (!outFile) {
-        std::cerr << "Error: Could not open file for writing: " << filename << "\n";
+        sessionErrors() << "Error: Could not open file for writing: " << filename << "\n";
         return;
     }
     
     // Write header
     outFile << "# Memory File System Dump - " << getCurrentDateString() << "\n";
     outFile << "# Format: <type>|<path>|<size>|<created>|<modified>|<data>\n";
+    outFile << "# FILE data: exactly <size> raw bytes, which may include newlines\n";
+    outFile << "# SPARSE data: <offset>:<length>:<bytes> for each allocated extent\n";
+    outFile << "# LINK data: path of an earlier entry sharing the same inode\n";
+    outFile << "# SYMLINK data: target of the symbolic link\n";
+    outFile << "# XATTR|<path>|<key>|<value> follows the entry it belongs to\n";
     
-    // Write entries
+    // Write entries; each inode's content is written once, further links refer to it
+    std::unordered_map<uint64_t, std::string> writtenInodes;
     for (const auto& entry : memoryFileSystem) {
-        std::string typeStr = entry.second.type == EntryType::FILE ? "FILE" : "DIR";
+        if (entry.second->linkCount > 1) {
+            auto written = writtenInodes.find(entry.second->inodeNumber);
+            if (written != writtenInodes.end()) {
+                outFile << "LINK|" << entry.first << "|"
+                        << entry.second->sizeInBytes << "|"
+                        << entry.second->creationDate << "|"
+                        << entry.second->modificationDate << "|"
+                        << written->second << "\n";
+                continue;
+            }
+            writtenInodes.emplace(entry.second->inodeNumber, entry.first);
+        }
+        
+        std::string typeStr = entry.second->type == EntryType::DIRECTORY ? "DIR" :
+                              entry.second->type == EntryType::SYMLINK ? "SYMLINK" :
+                              entry.second->data.hasHoles() ? "SPARSE" : "FILE";
         
         outFile << typeStr << "|"
                 << entry.first << "|"
-                << entry.second.sizeInBytes << "|"
-                << entry.second.creationDate << "|"
-                << entry.second.modificationDate << "|";
+                << entry.second->sizeInBytes << "|"
+                << entry.second->creationDate << "|"
+                << entry.second->modificationDate << "|";
         
-        // Only write data for files
-        if (entry.second.type == EntryType::FILE) {
-            outFile << entry.second.data;
+        // Only write data for files; sparse files skip their holes
+        if (entry.second->type == EntryType::FILE) {
+            bool sparse = typeStr == "SPARSE";
+            entry.second->data.forEachRun([&](uint64_t offset, const char* data, uint64_t length) {
+                if (data == nullptr) {
+                    return;
+                }
+                if (sparse) {
+                    outFile << offset << ":" << length << ":";
+                }
+                outFile.write(data, static_cast<std::streamsize>(length));
+            });
+        } else if (entry.second->type == EntryType::SYMLINK) {
+            outFile << entry.second->symlinkTarget;
         }
         
         outFile << "\n";
+        
+        // Attributes belong to the inode and are written once with its first path
+        if (entry.second->xattrs) {
+            for (const auto& attribute : *entry.second->xattrs) {
+                outFile << "XATTR|" << entry.first << "|" << attribute.first << "|" << attribute.second << "\n";
+            }
+        }
+    }
+    
+    // Frozen entries are written like live ones, so a load gives a writable tree
+    for (const auto& tree : *frozenTrees) {
+        std::string prefix = tree->root == "/" ? "/" : tree->root + "/";
+        for (size_t position = 0; position < tree->entries.size(); ++position) {
+            const FrozenEntry& frozen = tree->entries[position];
+            std::string path = prefix + tree->names.name(position);
+            outFile << (frozen.type == EntryType::DIRECTORY ? "DIR" :
+                        frozen.type == EntryType::SYMLINK ? "SYMLINK" : "FILE") << "|"
+                    << path << "|"
+                    << frozen.size << "|"
+                    << tree->dates[frozen.creationDate] << "|"
+                    << tree->dates[frozen.modificationDate] << "|";
+            if (frozen.type != EntryType::DIRECTORY) {
+                outFile.write(tree->payload->data() + frozen.payloadOffset, static_cast<std::streamsize>(frozen.size));
+            }
+            outFile << "\n";
+            
+            auto attributes = tree->xattrs.find(static_cast<uint32_t>(position));
+            if (attributes != tree->xattrs.end()) {
+                for (const auto& attribute : attributes->second) {
+                    outFile << "XATTR|" << path << "|" << attribute.first << "|" << attribute.second << "\n";
+                }
+            }
+        }
     }
     
     outFile.close();
-    std::cout << "File system saved to: " << filename << "\n";
+    sessionOutput() << "File system saved to: " << filename << "\n";
 }
 
 /**
@@ -1025,226 +4486,653 @@ void parseSaveCommand(const std::string& command) {
  */
 void parseLoadCommand(const std::string& command) {
     auto args = tokenize(command);
-    if (args.size() != 2) {
-        std::cerr << "Usage: load <filename>\n";
+    if (args.size() != 2 && args.size() != 3) {
+        sessionErrors() << "Usage: load <filename> [<directory>]\n";
         return;
     }
     
     std::string filename = args[1];
-    std::lock_guard<std::mutex> lock(fileSystemMutex);
-    
     std::ifstream inFile(filename);
     if (!inFile) {
-        std::cerr << "Error: Could not open file for reading: " << filename << "\n";
+        sessionErrors() << "Error: Could not open file for reading: " << filename << "\n";
         return;
     }
     
-    // Clear existing file system
-    memoryFileSystem.clear();
-    
-    std::string line;
-    size_t lineNum = 0;
+    // Parse into a private subtree without holding the lock, then publish it in one step
+    SubtreeBuilder builder;
+    builder.addFromDump(inFile);
+    inFile.close();
     
-    // Skip header lines starting with #
-    while (std::getline(inFile, line)) {
-        lineNum++;
-        if (line.empty() || line[0] == '#') {
-            continue;
-        }
-        
-        // Parse entry line
-        std::stringstream ss(line);
-        std::string typeStr, path, sizeStr, created, modified, data;
-        
-        // Split by | delimiter
-        if (!std::getline(ss, typeStr, '|') ||
-            !std::getline(ss, path, '|') ||
-            !std::getline(ss, sizeStr, '|') ||
-            !std::getline(ss, created, '|') ||
-            !std::getline(ss, modified, '|')) {
-            
-            std::cerr << "Warning: Invalid format at line " << lineNum << ", skipping\n";
-            continue;
+    if (args.size() == 2) {
+        builder.replaceNamespace();
+        sessionOutput() << "File system loaded from: " << filename << "\n";
+    } else {
+        size_t entryCount = builder.size();
+        if (builder.spliceInto(args[2])) {
+            sessionOutput() << "Loaded " << entryCount << " entries from " << filename << " into "
+                            << normalizePath(args[2]) << "\n";
         }
-        
-        // Get remaining part as data
-        std::getline(ss, data);
-        
-        // Create entry
-        FSEntry entry;
-        entry.type = (typeStr == "FILE") ? EntryType::FILE : EntryType::DIRECTORY;
-        entry.sizeInBytes = std::stoull(sizeStr);
-        entry.creationDate = created;
-        entry.modificationDate = modified;
-        entry.data = data;
-        
-        memoryFileSystem[path] = entry;
     }
-    
-    inFile.close();
-    std::cout << "File system loaded from: " << filename << "\n";
 }
 
 /**
  * Displays system statistics about the memory file system
  */
 void displaySystemStats() {
-    std::lock_guard<std::mutex> lock(fileSystemMutex);
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::DISPLAY_SYSTEM_STATS);
     
     size_t totalFiles = 0;
     size_t totalDirs = 0;
+    size_t totalSymlinks = 0;
     size_t totalSize = 0;
     
+    // Hard links share an inode, so sizes are counted once per inode
+    std::unordered_set<const FSEntry*> countedInodes;
     for (const auto& entry : memoryFileSystem) {
-        if (entry.second.type == EntryType::FILE) {
+        bool firstLink = countedInodes.insert(entry.second.get()).second;
+        if (entry.second->type == EntryType::FILE) {
             totalFiles++;
-            totalSize += entry.second.sizeInBytes;
+            if (firstLink) {
+                totalSize += entry.second->sizeInBytes;
+            }
+        } else if (entry.second->type == EntryType::SYMLINK) {
+            totalSymlinks++;
         } else {
             totalDirs++;
         }
     }
     
-    std::cout << "System Statistics:\n";
-    std::cout << "Total Entries: " << memoryFileSystem.size() << "\n";
-    std::cout << "Files: " << totalFiles << "\n";
-    std::cout << "Directories: " << totalDirs << "\n";
-    std::cout << "Total File Size: " << totalSize << " bytes\n";
+    // Frozen entries never share an inode
+    size_t frozenEntries = 0;
+    size_t frozenPayload = 0;
+    for (const auto& tree : *frozenTrees) {
+        for (const auto& frozen : tree->entries) {
+            if (frozen.type == EntryType::FILE) {
+                totalFiles++;
+                totalSize += frozen.size;
+            } else if (frozen.type == EntryType::SYMLINK) {
+                totalSymlinks++;
+            } else {
+                totalDirs++;
+            }
+        }
+        frozenEntries += tree->entries.size();
+        frozenPayload += tree->payload->size();
+    }
+    
+    sessionOutput() << "System Statistics:\n";
+    sessionOutput() << "Total Entries: " << memoryFileSystem.size() + frozenEntries << "\n";
+    sessionOutput() << "Files: " << totalFiles << "\n";
+    sessionOutput() << "Directories: " << totalDirs << "\n";
+    sessionOutput() << "Symlinks: " << totalSymlinks << "\n";
+    sessionOutput() << "Inodes: " << countedInodes.size() + frozenEntries << "\n";
+    sessionOutput() << "Total File Size: " << totalSize << " bytes\n";
+    sessionOutput() << "Pending Reclamation: " << reclaimer.pendingBytes() << " bytes\n";
+    
+    size_t preservedEntries = 0;
+    for (const auto& named : snapshots) {
+        preservedEntries += named.second.preserved.size();
+    }
+    sessionOutput() << "Snapshots: " << snapshots.size() << " (" << preservedEntries << " preserved entries)\n";
+    sessionOutput() << "Frozen: " << frozenEntries << " entries in " << frozenTrees->size() << " subtrees ("
+                    << frozenPayload << " payload bytes)\n";
+}
+
+/**
+ * Estimates the heap block glibc malloc hands out for a request
+ * @param requested The number of bytes requested
+ * @return Bytes consumed on the heap, including the chunk header
+ */
+size_t mallocBlockBytes(size_t requested) {
+    // 8-byte chunk header, 16-byte alignment, 32-byte minimum chunk
+    size_t block = (requested + sizeof(size_t) + 15) & ~static_cast<size_t>(15);
+    return std::max<size_t>(block, 32);
+}
+
+/**
+ * Returns the heap bytes owned by a string's buffer
+ * @param value The string to measure
+ * @param usedBytes Receives the bytes actually holding characters
+ * @return Bytes consumed on the heap, 0 if the string uses its inline buffer
+ */
+size_t stringHeapBytes(const std::string& value, size_t& usedBytes) {
+    const char* begin = reinterpret_cast<const char*>(&value);
+    if (value.data() >= begin && value.data() < begin + sizeof(value)) {
+        usedBytes = 0;
+        return 0;
+    }
+    usedBytes = value.size() + 1;
+    return malloc_usable_size(const_cast<char*>(value.data())) + sizeof(size_t);
+}
+
+/**
+ * Displays a breakdown of memory use by component
+ */
+void displayMemoryStats() {
+    size_t indexNodes = 0;      // Hash map nodes holding key and inode pointer
+    size_t inodeBytes = 0;      // FSEntry objects with their shared_ptr control blocks
+    size_t indexBuckets = 0;    // Hash map bucket array
+    size_t pathKeys = 0;        // Heap buffers of path keys
+    size_t metadataStrings = 0; // Heap buffers of date strings and symlink targets
+    size_t xattrBytes = 0;      // Extended attribute lists and their strings, slack included
+    size_t xattrIndexBytes = 0; // Inverted xattr index, slack included
+    size_t historyBytes = 0;    // Version deltas of files that keep history, slack included
+    size_t frozenBytes = 0;     // Names, metadata and attributes of frozen subtrees
+    size_t payloadBytes = 0;    // File content bytes, shared buffers counted once
+    size_t memfdBytes = 0;      // File content held in sealed memfds rather than on the heap
+    size_t attachedBytes = 0;   // File content mapped from host files, held by the page cache
+    size_t extentBytes = 0;     // Extent index nodes and buffer headers of file content
+    size_t slackBytes = 0;      // Capacity and block rounding beyond what is used
+    size_t entryCount = 0;
+    
+    {
+        ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::DISPLAY_MEMORY_STATS);
+        
+        typedef std::unordered_map<std::string, std::shared_ptr<FSEntry>>::value_type MapValue;
+        size_t nodeRequest = sizeof(void*) + sizeof(MapValue) + sizeof(size_t);  // next, value, cached hash
+        size_t nodeBytes = mallocBlockBytes(nodeRequest);
+        
+        entryCount = memoryFileSystem.size();
+        indexNodes = entryCount * nodeRequest;
+        slackBytes += entryCount * (nodeBytes - nodeRequest);
+        indexBuckets = mallocBlockBytes(memoryFileSystem.bucket_count() * sizeof(void*));
+        
+        // Extent map node: red-black links plus key and ContentExtent; buffer:
+        // shared_ptr control block allocated together with the ContentBuffer
+        size_t extentRequest = 4 * sizeof(void*) + sizeof(uint64_t) + sizeof(ContentExtent);
+        size_t bufferRequest = 2 * sizeof(void*) + sizeof(ContentBuffer);
+        std::unordered_set<const ContentBuffer*> seenBuffers;
+        
+        // Inode: make_shared control block allocated together with the FSEntry
+        size_t inodeRequest = 2 * sizeof(void*) + sizeof(FSEntry);
+        std::unordered_set<const FSEntry*> seenInodes;
+        
+        // Xattr index: one hash node per value and per posting, plus bucket arrays
+        size_t postingRequest = 2 * sizeof(void*) + sizeof(std::string);
+        for (const auto& indexEntry : xattrIndex) {
+            size_t used = 0;
+            xattrIndexBytes += mallocBlockBytes(sizeof(void*) + sizeof(indexEntry) + sizeof(size_t)) +
+                               stringHeapBytes(indexEntry.first, used) +
+                               mallocBlockBytes(indexEntry.second.bucket_count() * sizeof(void*));
+            for (const auto& path : indexEntry.second) {
+                xattrIndexBytes += mallocBlockBytes(postingRequest) + stringHeapBytes(path, used);
+            }
+        }
+        xattrIndexBytes += mallocBlockBytes(xattrIndex.bucket_count() * sizeof(void*));
+        
+        for (const auto& entry : memoryFileSystem) {
+            size_t used = 0;
+            size_t heap = stringHeapBytes(entry.first, used);
+            pathKeys += used;
+            slackBytes += heap - used;
+            
+            // Hard links share an inode, so everything below is counted once
+            if (!seenInodes.insert(entry.second.get()).second) {
+                continue;
+            }
+            inodeBytes += inodeRequest;
+            slackBytes += mallocBlockBytes(inodeRequest) - inodeRequest;
+            
+            heap = stringHeapBytes(entry.second->creationDate, used);
+            metadataStrings += used;
+            slackBytes += heap - used;
+            heap = stringHeapBytes(entry.second->modificationDate, used);
+            metadataStrings += used;
+            slackBytes += heap - used;
+            heap = stringHeapBytes(entry.second->symlinkTarget, used);
+            metadataStrings += used;
+            slackBytes += heap - used;
+            if (entry.second->xattrs) {
+                xattrBytes += mallocBlockBytes(sizeof(XattrList)) +
+                              mallocBlockBytes(entry.second->xattrs->capacity() * sizeof(XattrList::value_type));
+                for (const auto& attribute : *entry.second->xattrs) {
+                    xattrBytes += stringHeapBytes(attribute.first, used) + stringHeapBytes(attribute.second, used);
+                }
+            }
+            if (entry.second->history) {
+                // The latest content shares its buffers with the file; only its extent index is extra
+                const FileHistory& history = *entry.second->history;
+                historyBytes += mallocBlockBytes(sizeof(FileHistory)) + stringHeapBytes(history.latestDate, used) +
+                                history.latest.extentCount() * mallocBlockBytes(extentRequest);
+                for (const auto& version : history.versions) {
+                    historyBytes += sizeof(FileVersion) + stringHeapBytes(version.delta, used) +
+                                    stringHeapBytes(version.modificationDate, used);
+                }
+            }
+            
+            extentBytes += entry.second->data.extentCount() * extentRequest;
+            slackBytes += entry.second->data.extentCount() * (mallocBlockBytes(extentRequest) - extentRequest);
+            entry.second->data.forEachBuffer([&](const ContentBuffer& buffer) {
+                if (!seenBuffers.insert(&buffer).second) {
+                    return;
+                }
+                if (buffer.sealed()) {
+                    memfdBytes += buffer.size();
+                } else if (buffer.hostMapped()) {
+                    attachedBytes += buffer.size();
+                }
+                size_t bufferUsed = 0;
+                size_t bufferHeap = stringHeapBytes(buffer.bytes, bufferUsed);
+                payloadBytes += bufferUsed;
+                slackBytes += bufferHeap - bufferUsed;
+                extentBytes += bufferRequest;
+                slackBytes += mallocBlockBytes(bufferRequest) - bufferRequest;
+            });
+        }
+        
+        // Unfrozen files keep slicing a frozen payload, so it is counted once with theirs
+        for (const auto& tree : *frozenTrees) {
+            entryCount += tree->entries.size();
+            frozenBytes += tree->indexBytes();
+            const ContentBuffer& buffer = *tree->payload;
+            if (!seenBuffers.insert(&buffer).second) {
+                continue;
+            }
+            if (buffer.sealed()) {
+                memfdBytes += buffer.size();
+            }
+            size_t bufferUsed = 0;
+            size_t bufferHeap = stringHeapBytes(buffer.bytes, bufferUsed);
+            payloadBytes += bufferUsed;
+            slackBytes += bufferHeap - bufferUsed;
+        }
+    }
+    
+    size_t shardBytes = commandLatencies.memoryUsage() + lockWaitLatencies.memoryUsage() +
+                        lockHoldLatencies.memoryUsage();
+    size_t pendingBytes = reclaimer.pendingBytes();
+    size_t accounted = indexNodes + inodeBytes + indexBuckets + pathKeys + metadataStrings + xattrBytes +
+                       xattrIndexBytes + historyBytes + frozenBytes + extentBytes + payloadBytes + slackBytes + shardBytes + pendingBytes;
+    
+    // Allocator view of the heap, summed over all arenas
+    struct mallinfo2 heapInfo = mallinfo2();
+    size_t heapInUse = heapInfo.uordblks + heapInfo.hblkhd;
+    size_t heapFree = heapInfo.fordblks;
+    
+    // Resident set size from /proc, in pages
+    size_t residentBytes = 0;
+    std::ifstream statm("/proc/self/statm");
+    size_t totalPages = 0, residentPages = 0;
+    if (statm >> totalPages >> residentPages) {
+        residentBytes = residentPages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+    
+    auto printRow = [](const std::string& name, size_t bytes) {
+        sessionOutput() << std::left << std::setw(36) << name << std::right << std::setw(16) << bytes << "\n";
+    };
+    
+    sessionOutput() << "Memory Statistics (" << entryCount << " entries):\n";
+    printRow("Index nodes", indexNodes);
+    printRow("Index buckets", indexBuckets);
+    printRow("Inodes", inodeBytes);
+    printRow("Path keys", pathKeys);
+    printRow("Metadata strings", metadataStrings);
+    printRow("Extended attributes", xattrBytes);
+    printRow("Xattr index", xattrIndexBytes);
+    printRow("File history", historyBytes);
+    printRow("Frozen index", frozenBytes);
+    printRow("Content extents", extentBytes);
+    printRow("File payload", payloadBytes);
+    printRow("Allocator slack", slackBytes);
+    printRow("Per-thread metric shards", shardBytes);
+    printRow("Pending reclamation", pendingBytes);
+    printRow("Accounted total", accounted);
+    printRow("Sealed memfds (not heap)", memfdBytes);
+    printRow("Attached host files (page cache)", attachedBytes);
+    sessionOutput() << "\n";
+    printRow("Heap in use (malloc)", heapInUse);
+    printRow("Unaccounted heap", heapInUse > accounted ? heapInUse - accounted : 0);
+    printRow("Free in allocator arenas/caches", heapFree);
+    printRow("Resident set size", residentBytes);
+}
+
+/**
+ * Appends a command to the open workload trace
+ * @param command The full command string that is about to execute
+ */
+void recordTraceCommand(const std::string& command) {
+    ProfiledLockGuard<std::mutex> lock(traceMutex, LockSite::RECORD_TRACE_COMMAND);
+    if (!traceRecording.load(std::memory_order_relaxed)) {
+        return;
+    }
+    
+    // Replay would reject the record, and every one after it
+    if (command.size() > kMaxTraceCommandBytes) {
+        sessionErrors() << "Warning: Command of " << command.size() << " bytes not recorded in the trace\n";
+        return;
+    }
+    
+    auto now = std::chrono::steady_clock::now();
+    auto delta = std::chrono::duration_cast<std::chrono::microseconds>(now - lastTraceTime).count();
+    lastTraceTime = now;
+    
+    writeTraceRecord(traceFile, static_cast<uint64_t>(delta), command);
+    tracedCommandCount++;
+}
+
+/**
+ * Starts, stops or reports workload trace recording
+ * @param command The full command string to parse
+ */
+void parseRecordCommand(const std::string& command) {
+    auto args = tokenize(command);
+    ProfiledLockGuard<std::mutex> lock(traceMutex, LockSite::PARSE_RECORD_COMMAND);
+    
+    if (args.size() == 3 && args[1] == "start") {
+        if (traceRecording) {
+            sessionErrors() << "Error: Already recording to " << traceFilename << "\n";
+            return;
+        }
+        
+        traceFile.open(args[2], std::ios::binary | std::ios::trunc);
+        if (!traceFile) {
+            sessionErrors() << "Error: Could not open trace file for writing: " << args[2] << "\n";
+            return;
+        }
+        
+        traceFile.write(kTraceMagic, sizeof(kTraceMagic));
+        traceFilename = args[2];
+        tracedCommandCount = 0;
+        lastTraceTime = std::chrono::steady_clock::now();
+        traceRecording = true;
+        sessionOutput() << "Recording commands to: " << traceFilename << "\n";
+    } else if (args.size() == 2 && args[1] == "stop") {
+        if (!traceRecording) {
+            sessionErrors() << "Error: Not recording\n";
+            return;
+        }
+        
+        traceRecording = false;
+        traceFile.close();
+        sessionOutput() << "Recorded " << tracedCommandCount << " commands to: " << traceFilename << "\n";
+    } else if (args.size() == 1) {
+        if (traceRecording) {
+            sessionOutput() << "Recording " << tracedCommandCount << " commands so far to: " << traceFilename << "\n";
+        } else {
+            sessionOutput() << "Not recording\n";
+        }
+    } else {
+        sessionErrors() << "Usage: record [start <tracefile> | stop]\n";
+    }
+}
+
+/**
+ * Displays latency metrics or exports them in Prometheus text format
+ * @param command The full command string to parse
+ */
+void parseMetricsCommand(const std::string& command) {
+    auto args = tokenize(command);
+    
+    if (args.size() == 1) {
+        sessionOutput() << "Command latency:\n";
+        printLatencyTable(sessionOutput(), "Command", commandLatencies.names(), commandLatencies.collect());
+        sessionOutput() << "\nLock contention:\n";
+        printLockTable(sessionOutput());
+    } else if (args.size() == 2 && args[1] == "reset") {
+        commandLatencies.reset();
+        lockWaitLatencies.reset();
+        lockHoldLatencies.reset();
+        for (auto& contentions : lockContentions) {
+            contentions.store(0, std::memory_order_relaxed);
+        }
+        sessionOutput() << "Metrics reset\n";
+    } else if (args.size() == 3 && args[1] == "--prometheus") {
+        std::ofstream outFile(args[2]);
+        if (!outFile) {
+            sessionErrors() << "Error: Could not open file for writing: " << args[2] << "\n";
+            return;
+        }
+        
+        writePrometheusSummary(outFile, "memfs_command_latency_seconds", "Latency of memfs commands",
+                               "command", commandLatencies.names(), commandLatencies.collect());
+        writePrometheusSummary(outFile, "memfs_lock_wait_seconds", "Time spent waiting to acquire a lock",
+                               "site", lockWaitLatencies.names(), lockWaitLatencies.collect());
+        writePrometheusSummary(outFile, "memfs_lock_hold_seconds", "Time a lock was held",
+                               "site", lockHoldLatencies.names(), lockHoldLatencies.collect());
+        writePrometheusCounter(outFile, "memfs_lock_contended_total", "Lock acquisitions that had to wait",
+                               "site", lockWaitLatencies.names(), lockContentions);
+        sessionOutput() << "Metrics written to: " << args[2] << "\n";
+    } else {
+        sessionErrors() << "Usage: metrics [reset | --prometheus <file>]\n";
+    }
+}
+
+// Largest span buffer a thread may get; a span takes 32 bytes
+const uint64_t kMaxTraceSpansPerThread = 1 << 22;
+
+/**
+ * Controls span tracing and writes buffered spans as Chrome trace JSON
+ * @param command The full command string to parse
+ */
+void parseTracingCommand(const std::string& command) {
+    auto args = tokenize(command);
+    uint64_t capacity = 65536;
+    
+    if ((args.size() == 2 || (args.size() == 3 && parseByteCount(args[2], capacity))) && args[1] == "on") {
+        if (capacity == 0 || capacity > kMaxTraceSpansPerThread) {
+            sessionErrors() << "Error: Spans per thread must be between 1 and " << kMaxTraceSpansPerThread << "\n";
+            return;
+        }
+        startTracing(static_cast<size_t>(capacity));
+        sessionOutput() << "Tracing enabled (" << capacity << " spans per thread)\n";
+    } else if (args.size() == 2 && args[1] == "off") {
+        stopTracing();
+        sessionOutput() << "Tracing disabled, " << bufferedTraceSpans() << " spans buffered\n";
+    } else if (args.size() == 3 && args[1] == "flush") {
+        std::ofstream outFile(args[2]);
+        if (!outFile) {
+            sessionErrors() << "Error: Could not open file for writing: " << args[2] << "\n";
+            return;
+        }
+        
+        size_t written = flushTrace(outFile);
+        sessionOutput() << "Wrote " << written << " spans to: " << args[2] << "\n";
+    } else if (args.size() == 1) {
+        sessionOutput() << "Tracing is " << (tracingEnabled ? "on" : "off") << ", "
+                        << bufferedTraceSpans() << " spans buffered\n";
+    } else {
+        sessionErrors() << "Usage: tracing [on [<spans per thread>] | off | flush <file>]\n";
+    }
 }
 
 /**
  * Displays help information about available commands
  */
 void displayHelp() {
-    std::cout << "\nMemory File System Commands:\n";
-    std::cout << "---------------------------\n";
-    std::cout << "ls                    - List files in current directory\n";
-    std::cout << "ls -l                 - List files with details\n";
-    std::cout << "ls <path>             - List files in specified directory\n";
-    std::cout << "cd <path>             - Change directory\n";
-    std::cout << "pwd                   - Print working directory\n";
-    std::cout << "create <filename>     - Create empty file\n";
-    std::cout << "create -n <n> <files> - Create multiple files\n";
-    std::cout << "mkdir <dirname>       - Create directory\n";
-    std::cout << "write <file> <content> - Write content to file\n";
-    std::cout << "read <file>           - Read content from file\n";
-    std::cout << "delete <file>         - Delete file\n";
-    std::cout << "delete -n <n> <files> - Delete multiple files\n";
-    std::cout << "rmdir <dir>           - Remove empty directory\n";
-    std::cout << "rmdir -r <dir>        - Remove directory and contents\n";
-    std::cout << "mv <src> <dest>       - Move/rename file or directory\n";
-    std::cout << "cp <src> <dest>       - Copy file or directory\n";
-    std::cout << "search <pattern>      - Search for files matching pattern\n";
-    std::cout << "info <path>           - Display detailed information about a file or directory\n";
-    std::cout << "save <file>           - Save memory file system to disk\n";
-    std::cout << "load <file>           - Load memory file system from disk\n";
-    std::cout << "stats                 - Display system statistics\n";
-    std::cout << "help                  - Display this help information\n";
-    std::cout << "exit                  - Exit the program\n";
+    sessionOutput() << "\nMemory File System Commands:\n";
+    sessionOutput() << "---------------------------\n";
+    sessionOutput() << "ls                    - List files in current directory\n";
+    sessionOutput() << "ls -l                 - List files with details\n";
+    sessionOutput() << "ls <path>             - List files in specified directory\n";
+    sessionOutput() << "cd <path>             - Change directory\n";
+    sessionOutput() << "pwd                   - Print working directory\n";
+    sessionOutput() << "create <filename>     - Create empty file\n";
+    sessionOutput() << "create -n <n> <files> - Create multiple files\n";
+    sessionOutput() << "mkdir <dirname>       - Create directory\n";
+    sessionOutput() << "write <file> <content> - Write content to file\n";
+    sessionOutput() << "write -o <offset> <file> <content> - Write content at an offset\n";
+    sessionOutput() << "write -f <host_file> <file> - Stream a host file into a file\n";
+    sessionOutput() << "write - <file> [<bytes>] - Stream standard input (or the next <bytes> of it) into a file\n";
+    sessionOutput() << "read <file>           - Read content from file\n";
+    sessionOutput() << "read -o <off> -l <len> <file> - Read part of a file\n";
+    sessionOutput() << "read --version <k> <file> - Read the version of a file k changes back\n";
+    sessionOutput() << "history <file> [<n>]  - List the kept versions of a file, or keep the last n (0 to stop)\n";
+    sessionOutput() << "cat [-o <off>] [-l <len>] <file> - Write the raw bytes of a file to stdout\n";
+    sessionOutput() << "diff <path1> <path2>  - Show what differs between two files or trees\n";
+    sessionOutput() << "truncate <file> <size> - Set file size, growing with a sparse hole\n";
+    sessionOutput() << "delete <file>         - Delete file\n";
+    sessionOutput() << "delete -n <n> <files> - Delete multiple files\n";
+    sessionOutput() << "rmdir <dir>           - Remove empty directory\n";
+    sessionOutput() << "rmdir -r <dir>        - Remove directory and contents\n";
+    sessionOutput() << "mv <src> <dest>       - Move/rename file or directory\n";
+    sessionOutput() << "cp <src> <dest>       - Copy file or directory\n";
+    sessionOutput() << "snapshot create <name> <dir> - Take a read-only snapshot at /.snapshots/<name>\n";
+    sessionOutput() << "snapshot delete <name> - Delete a snapshot\n";
+    sessionOutput() << "snapshot list         - List snapshots\n";
+    sessionOutput() << "freeze [<dir>]        - Make a directory tree read-only in a compact form, or list frozen trees\n";
+    sessionOutput() << "unfreeze <dir>        - Make a frozen directory tree writable again\n";
+    sessionOutput() << "ln [-s] <src> <link>  - Create a hard link to a file, or a symbolic link with -s\n";
+    sessionOutput() << "setxattr <path> <key> <value> - Set an extended attribute\n";
+    sessionOutput() << "getxattr <path> <key> - Show an extended attribute\n";
+    sessionOutput() << "listxattr <path>      - List extended attributes\n";
+    sessionOutput() << "removexattr <path> <key> - Remove an extended attribute\n";
+    sessionOutput() << "find [<dir>] -xattr <key>=<value> - Find entries by attribute\n";
+    sessionOutput() << "xattrindex [on|off]   - Show or toggle the attribute index used by find\n";
+    sessionOutput() << "memfd [on [<bytes>]|off] - Show or set memfd storage for large file buffers\n";
+    sessionOutput() << "share <path>          - Move a file into a sealed memfd that other processes can map\n";
+    sessionOutput() << "attach <host_file> <path> - Map a host file read-only into the file system\n";
+    sessionOutput() << "search <pattern>      - Search for files matching pattern\n";
+    sessionOutput() << "info <path>           - Display detailed information about a file or directory\n";
+    sessionOutput() << "save <file>           - Save memory file system to disk\n";
+    sessionOutput() << "load <file> [<dir>]   - Load memory file system from disk, or import it under <dir>\n";
+    sessionOutput() << "stats                 - Display system statistics\n";
+    sessionOutput() << "memstats              - Display memory usage by component\n";
+    sessionOutput() << "record start <file>   - Record all commands to a workload trace\n";
+    sessionOutput() << "record stop           - Stop recording the workload trace\n";
+    sessionOutput() << "metrics               - Display command latency percentiles\n";
+    sessionOutput() << "metrics reset         - Clear latency histograms and lock contention counters\n";
+    sessionOutput() << "metrics --prometheus <file> - Export metrics in Prometheus text format\n";
+    sessionOutput() << "tracing on|off        - Start or stop span tracing\n";
+    sessionOutput() << "tracing flush <file>  - Write buffered spans as Chrome trace JSON\n";
+    sessionOutput() << "help                  - Display this help information\n";
+    sessionOutput() << "exit                  - Exit the program\n";
 }
 
 /**
  * Initialize the memory file system with root directory
  */
 void initializeFileSystem() {
-    std::lock_guard<std::mutex> lock(fileSystemMutex);
+    ProfiledLockGuard<std::mutex> lock(fileSystemMutex, LockSite::INITIALIZE_FILE_SYSTEM);
     
     // Create root directory if it doesn't exist
     if (memoryFileSystem.find("/") == memoryFileSystem.end()) {
-        FSEntry rootDir;
-        rootDir.data = "";
-        rootDir.sizeInBytes = 0;
-        rootDir.creationDate = getCurrentDateString();
-        rootDir.modificationDate = getCurrentDateString();
-        rootDir.type = EntryType::DIRECTORY;
-        
-        memoryFileSystem["/"] = rootDir;
+        memoryFileSystem["/"] = createEntry(EntryType::DIRECTORY);
     }
 }
 
 /**
- * Main function to run the memory file system
+ * Parses and executes a single command line
+ * @param command The full command string to execute
+ * @return False if the command asks to exit, true otherwise
  */
-int main() {
-    std::string command;
+bool executeCommand(const std::string& command) {
+    // Skip empty commands; tokens are views so payloads are not copied here
+    auto commandParts = tokenizeView(command);
+    if (commandParts.empty()) {
+        return true;
+    }
     
-    // Initialize the file system with root directory
-    initializeFileSystem();
+    // Extract the first word as the command name
+    std::string_view commandName = commandParts[0];
     
-    std::cout << "Memory File System v1.0\n";
-    std::cout << "Type 'help' for available commands, 'exit' to quit.\n";
+    // Record the command for later replay, except for recording control itself
+    if (traceRecording.load(std::memory_order_relaxed) && commandName != "record") {
+        recordTraceCommand(command);
+    }
     
-    while (true) {
-        std::cout << currentDirectory << "> ";
-        std::getline(std::cin, command);
-        
-        // Skip empty commands
-        if (command.empty()) {
-            continue;
-        }
-        
-        // Extract the first word as the command name
-        auto commandParts = tokenize(command);
-        std::string commandName = commandParts[0];
-        
-        // Process the command
-        if (commandName == "exit") {
-            break;
-        } else if (commandName == "help") {
-            displayHelp();
-        } else if (commandName == "ls") {
-            if (commandParts.size() == 1) {
-                displayFileList();
-            } else if (commandParts.size() == 2) {
-                if (commandParts[1] == "-l") {
-                    displayFileListDetailed();
-                } else {
-                    listDirectory(commandParts[1], false);
-                }
-            } else if (commandParts.size() == 3 && commandParts[1] == "-l") {
-                listDirectory(commandParts[2], true);
-            } else {
-                std::cerr << "Usage: ls [-l] [directory]\n";
-            }
-        } else if (commandName == "cd") {
-            parseCdCommand(command);
-        } else if (commandName == "pwd") {
-            printWorkingDirectory();
-        } else if (commandName == "create") {
-            parseCreateCommand(command);
-        } else if (commandName == "mkdir") {
-            parseMkdirCommand(command);
-        } else if (commandName == "write") {
-            parseWriteCommand(command);
-        } else if (commandName == "read") {
-            if (commandParts.size() != 2) {
-                std::cerr << "Usage: read <filename>\n";
+    size_t metricSlot = commandLatencies.slotOf(commandName);
+    auto commandStart = std::chrono::steady_clock::now();
+    TraceSpan span("command", metricSlot != ShardedHistogramSet::npos ?
+                              commandLatencies.names()[metricSlot].c_str() : nullptr);
+    
+    // Process the command
+    if (commandName == "exit") {
+        return false;
+    } else if (commandName == "help") {
+        displayHelp();
+    } else if (commandName == "ls") {
+        if (commandParts.size() == 1) {
+            displayFileList();
+        } else if (commandParts.size() == 2) {
+            if (commandParts[1] == "-l") {
+                displayFileListDetailed();
             } else {
-                readContentFromFile(commandParts[1]);
+                listDirectory(std::string(commandParts[1]), false);
             }
-        } else if (commandName == "delete") {
-            parseDeleteCommand(command);
-        } else if (commandName == "rmdir") {
-            parseRmdirCommand(command);
-        } else if (commandName == "mv") {
-            parseMoveCommand(command);
-        } else if (commandName == "cp") {
-            parseCopyCommand(command);
-        } else if (commandName == "search") {
-            parseSearchCommand(command);
-        } else if (commandName == "info") {
-            parseInfoCommand(command);
-        } else if (commandName == "save") {
-            parseSaveCommand(command);
-        } else if (commandName == "load") {
-            parseLoadCommand(command);
-        } else if (commandName == "stats") {
-            displaySystemStats();
+        } else if (commandParts.size() == 3 && commandParts[1] == "-l") {
+            listDirectory(std::string(commandParts[2]), true);
         } else {
-            std::cerr << "Error: Unknown command: " << commandName << "\n";
-            std::cerr << "Type 'help' for available commands.\n";
+            sessionErrors() << "Usage: ls [-l] [directory]\n";
         }
+    } else if (commandName == "cd") {
+        parseCdCommand(command);
+    } else if (commandName == "pwd") {
+        printWorkingDirectory();
+    } else if (commandName == "create") {
+        parseCreateCommand(command);
+    } else if (commandName == "mkdir") {
+        parseMkdirCommand(command);
+    } else if (commandName == "write") {
+        parseWriteCommand(command);
+    } else if (commandName == "read") {
+        parseReadCommand(command);
+    } else if (commandName == "cat") {
+        parseCatCommand(command);
+    } else if (commandName == "truncate") {
+        parseTruncateCommand(command);
+    } else if (commandName == "delete") {
+        parseDeleteCommand(command);
+    } else if (commandName == "rmdir") {
+        parseRmdirCommand(command);
+    } else if (commandName == "mv") {
+        parseMoveCommand(command);
+    } else if (commandName == "cp") {
+        parseCopyCommand(command);
+    } else if (commandName == "snapshot") {
+        parseSnapshotCommand(command);
+    } else if (commandName == "history") {
+        parseHistoryCommand(command);
+    } else if (commandName == "freeze" || commandName == "unfreeze") {
+        parseFreezeCommand(command);
+    } else if (commandName == "ln") {
+        parseLinkCommand(command);
+    } else if (commandName == "setxattr") {
+        parseSetXattrCommand(command);
+    } else if (commandName == "getxattr") {
+        parseGetXattrCommand(command);
+    } else if (commandName == "listxattr") {
+        parseListXattrCommand(command);
+    } else if (commandName == "removexattr") {
+        parseRemoveXattrCommand(command);
+    } else if (commandName == "find") {
+        parseFindCommand(command);
+    } else if (commandName == "xattrindex") {
+        parseXattrIndexCommand(command);
+    } else if (commandName == "memfd") {
+        parseMemfdCommand(command);
+    } else if (commandName == "share") {
+        parseShareCommand(command);
+    } else if (commandName == "attach") {
+        parseAttachCommand(command);
+    } else if (commandName == "diff") {
+        parseDiffCommand(command);
+    } else if (commandName == "search") {
+        parseSearchCommand(command);
+    } else if (commandName == "info") {
+        parseInfoCommand(command);
+    } else if (commandName == "save") {
+        parseSaveCommand(command);
+    } else if (commandName == "load") {
+        parseLoadCommand(command);
+    } else if (commandName == "stats") {
+        displaySystemStats();
+    } else if (commandName == "memstats") {
+        displayMemoryStats();
+    } else if (commandName == "record") {
+        parseRecordCommand(command);
+    } else if (commandName == "metrics") {
+        parseMetricsCommand(command);
+    } else if (commandName == "tracing") {
+        parseTracingCommand(command);
+    } else {
+        sessionErrors() << "Error: Unknown command: " << commandName << "\n";
+        sessionErrors() << "Type 'help' for available commands.\n";
+    }
+    
+    if (metricSlot != ShardedHistogramSet::npos) {
+        auto elapsed = std::chrono::steady_clock::now() - commandStart;
+        commandLatencies.record(metricSlot, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
     }
     
-    std::cout << "Exiting Memory File System. Goodbye!\n";
-    return 0;
+    return true;
 }
\ No newline at end of file
@@ -0,0 +1,164 @@
+#ifndef MEMFS_H
+#define MEMFS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Public interface of the memory file system, shared by the interactive
+ * shell and the tools built on top of it (benchmarks, trace replay)
+ */
+
+/**
+ * One client of the file system: its working directory and the streams its
+ * commands read from and print to. A thread runs commands for the session made current
+ * with a SessionScope; threads without one share the shell's session, which
+ * prints to std::cout and std::cerr. A session must not be current on two
+ * threads at once.
+ */
+struct Session {
+    std::string currentDirectory = "/";     // Resolves relative paths
+    std::istream* input = &std::cin;        // Data for 'write -', null if the client has none
+    std::ostream* output = &std::cout;      // Output of commands
+    std::ostream* errors = &std::cerr;      // Errors and warnings of commands
+};
+
+/**
+ * Makes a session current on the calling thread while the scope lasts
+ */
+class SessionScope {
+public:
+    explicit SessionScope(Session& session);
+    ~SessionScope();
+    SessionScope(const SessionScope&) = delete;
+    SessionScope& operator=(const SessionScope&) = delete;
+
+private:
+    Session* previous;
+};
+
+/**
+ * @return The session current on the calling thread
+ */
+Session& currentSession();
+
+/**
+ * Initialize the memory file system with root directory
+ */
+void initializeFileSystem();
+
+/**
+ * Splits a command line into arguments the way the shell does
+ * @param input The string to tokenize
+ * @param delimiter The character to use as delimiter (default: space)
+ * @return Vector of tokens
+ */
+std::vector<std::string> tokenize(const std::string& input, char delimiter = ' ');
+
+/**
+ * Parses and executes a single command line
+ * @param command The full command string to execute
+ * @return False if the command asks to exit, true otherwise
+ */
+bool executeCommand(const std::string& command);
+
+/**
+ * Gets a file descriptor for a file's content, to be passed to another
+ * process that maps it. The content is moved into a memfd sealed against
+ * writes and resizing, so the receiver can neither change it nor see it
+ * change; writes to the file afterwards go to new buffers.
+ * @param path The file to share
+ * @param size Set to the file size, which is the size of the memfd
+ * @return A new descriptor the caller must close, or -1 after printing an error
+ */
+int shareFileDescriptor(const std::string& path, uint64_t& size);
+
+// Hole-aware file content, defined in fileContent.h
+class FileContent;
+
+/**
+ * Parses a 'cat' command and takes a copy-on-write snapshot of the file, so
+ * the caller can write the range out with FileContent::writeTo without
+ * holding the file system lock
+ * @param command The full command line
+ * @param content Set to the file's content
+ * @param offset Set to the first byte to write, clamped to the file size
+ * @param length Set to the number of bytes to write, clamped to the file size
+ * @return True if successful, false after printing an error
+ */
+bool prepareCat(const std::string& command, FileContent& content, uint64_t& offset, uint64_t& length);
+
+// Private index of a SubtreeBuilder, defined in memFS.cpp
+struct SubtreeIndex;
+
+/**
+ * Builds a subtree privately and publishes it into the live namespace in
+ * one atomic step. Building takes no locks and touches no shared state, so
+ * a large dataset can be prepared while the file system keeps serving;
+ * other threads see either none of it or all of it. Paths given to the
+ * builder are relative to the subtree root and missing parent directories
+ * are created implicitly.
+ */
+class SubtreeBuilder {
+public:
+    /**
+     * @param expectedEntries Number of entries to preallocate the private index for
+     */
+    explicit SubtreeBuilder(size_t expectedEntries = 0);
+    ~SubtreeBuilder();
+
+    /**
+     * Adds a directory
+     * @param path Path relative to the subtree root
+     */
+    void addDirectory(const std::string& path);
+
+    /**
+     * Adds a file, replacing any entry already at that path
+     * @param path Path relative to the subtree root
+     * @param content File content, moved into the file's storage
+     */
+    void addFile(const std::string& path, std::string content);
+
+    /**
+     * Adds a symbolic link
+     * @param path Path relative to the subtree root
+     * @param target Target of the link, stored as given
+     */
+    void addSymlink(const std::string& path, const std::string& target);
+
+    /**
+     * Adds every entry of a dump written by the save command; the dump's
+     * root becomes the subtree root
+     * @param in Stream positioned at the start of the dump
+     */
+    void addFromDump(std::istream& in);
+
+    /**
+     * @return Number of entries built so far, the subtree root included
+     */
+    size_t size() const;
+
+    /**
+     * Publishes the subtree at a path that must not exist yet, creating its
+     * parent directories. The builder is empty afterwards.
+     * @param mountPath Path at which the subtree root appears
+     * @return True if the subtree was spliced in
+     */
+    bool spliceInto(const std::string& mountPath);
+
+    /**
+     * Replaces the whole namespace with the subtree. The old namespace is
+     * released after the lock is dropped.
+     */
+    void replaceNamespace();
+
+private:
+    std::unique_ptr<SubtreeIndex> index;
+};
+
+#endif // MEMFS_H
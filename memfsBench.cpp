@@ -0,0 +1,596 @@
+// Microbenchmark suite for the memory file system
+#include "memFS.h"
+#include <iostream>     // For input/output operations
+#include <string>       // For string manipulation
+#include <vector>       // For dynamic arrays
+#include <sstream>      // For string stream processing
+#include <fstream>      // For writing the ingest source file
+#include <chrono>       // For time-related functions
+#include <thread>       // For multi-threading support
+#include <random>       // For generating file sizes
+#include <algorithm>    // For standard algorithms
+#include <cstdio>       // For std::remove
+#include <cstdlib>      // For std::exit, std::malloc and std::free
+#include <atomic>       // For the allocation counters
+#include <new>          // For replacing the global allocation functions
+#include <unistd.h>     // For getpid
+
+// Heap allocations made through operator new, counted so every phase can
+// report allocations and bytes allocated per operation
+static std::atomic<uint64_t> allocationCount(0);
+static std::atomic<uint64_t> allocationBytes(0);
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    void* pointer = std::malloc(size != 0 ? size : 1);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+/**
+ * Benchmark configuration, filled from the command line
+ */
+struct BenchConfig {
+    size_t entries = 10000;              // Number of files to create
+    std::string sizeDistribution = "fixed:256";  // File size distribution
+    size_t depth = 2;                    // Directory levels below /bench
+    size_t fanout = 10;                  // Subdirectories per directory level
+    size_t threads = 1;                  // Client threads for per-entry operations
+    size_t iterations = 5;               // Repetitions for whole-tree operations
+    size_t batch = 1000;                 // Files per create -n / write -n / delete -n command
+    std::string format = "json";         // Output format: json or csv
+    std::string savePath = "/tmp/memfs_bench.dat";  // Scratch file for save/load
+    size_t ingestSize = 64 << 20;        // Size of the host file streamed in by ingest
+    std::string operations = "create,write,read,batch-create,batch-write,batch-delete,ls,search,mv,cp,save,load";
+    unsigned long seed = 42;             // Seed for the size distribution
+};
+
+/**
+ * Result of a single benchmarked operation type
+ */
+struct BenchResult {
+    std::string operation;
+    size_t count;                        // Number of timed operations
+    size_t threads;                      // Threads that issued them
+    double totalSeconds;                 // Wall time for the whole phase
+    std::vector<double> latenciesUs;     // Per-operation latency in microseconds
+    uint64_t allocations = 0;            // Heap allocations made during the timed operations
+    uint64_t allocatedBytes = 0;         // Bytes requested by those allocations
+    size_t entriesPerOp = 0;             // Namespace entries each operation processes, 0 if not meaningful
+    size_t bytesPerOp = 0;               // Content bytes each operation moves, 0 if not meaningful
+};
+
+/**
+ * Stream buffer that discards everything, used to silence command output
+ */
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+/**
+ * Prints usage information and exits
+ * @param program Name of the executable
+ */
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --entries <n>        Number of files (default 10000)\n"
+              << "  --sizes <dist>       fixed:<bytes> | uniform:<min>:<max> | exp:<mean> (default fixed:256)\n"
+              << "  --depth <n>          Directory levels below /bench (default 2)\n"
+              << "  --fanout <n>         Subdirectories per level (default 10)\n"
+              << "  --threads <n>        Client threads for per-entry operations (default 1)\n"
+              << "  --iterations <n>     Repetitions for ls/search/mv/cp/save/load (default 5)\n"
+              << "  --batch <n>          Files per batch command (default 1000)\n"
+              << "  --ops <list>         Comma-separated subset of create,write,read,batch-create,\n"
+              << "                       batch-write,batch-delete,ls,search,mv,cp,save,load, and the\n"
+              << "                       opt-in ingest,ingest-baseline\n"
+              << "  --format <json|csv>  Output format (default json)\n"
+              << "  --save-path <file>   Scratch file used by save/load (default /tmp/memfs_bench.dat)\n"
+              << "  --seed <n>           Random seed (default 42)\n"
+              << "  --ingest-size <n>    Bytes of the host file used by ingest (default 64M)\n";
+    std::exit(1);
+}
+
+/**
+ * Parses command line options into a benchmark configuration
+ * @param argc Argument count
+ * @param argv Argument values
+ * @return The parsed configuration
+ */
+BenchConfig parseArguments(int argc, char** argv) {
+    BenchConfig config;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--help" || option == "-h" || i + 1 >= argc) {
+            printUsage(argv[0]);
+        }
+
+        std::string value = argv[++i];
+        if (option == "--entries") {
+            config.entries = std::stoull(value);
+        } else if (option == "--sizes") {
+            config.sizeDistribution = value;
+        } else if (option == "--depth") {
+            config.depth = std::stoull(value);
+        } else if (option == "--fanout") {
+            config.fanout = std::max<size_t>(1, std::stoull(value));
+        } else if (option == "--threads") {
+            config.threads = std::max<size_t>(1, std::stoull(value));
+        } else if (option == "--iterations") {
+            config.iterations = std::max<size_t>(1, std::stoull(value));
+        } else if (option == "--batch") {
+            config.batch = std::max<size_t>(1, std::stoull(value));
+        } else if (option == "--ops") {
+            config.operations = value;
+        } else if (option == "--format") {
+            config.format = value;
+        } else if (option == "--save-path") {
+            config.savePath = value;
+        } else if (option == "--seed") {
+            config.seed = std::stoul(value);
+        } else if (option == "--ingest-size") {
+            config.ingestSize = std::max<size_t>(1, std::stoull(value));
+        } else {
+            printUsage(argv[0]);
+        }
+    }
+
+    if (config.format != "json" && config.format != "csv") {
+        printUsage(argv[0]);
+    }
+    return config;
+}
+
+/**
+ * Generates file sizes following the configured distribution
+ * @param config The benchmark configuration
+ * @return One size per entry
+ */
+std::vector<size_t> generateSizes(const BenchConfig& config) {
+    std::vector<std::string> parts;
+    std::stringstream distStream(config.sizeDistribution);
+    std::string part;
+    while (std::getline(distStream, part, ':')) {
+        parts.push_back(part);
+    }
+
+    std::mt19937_64 generator(config.seed);
+    std::vector<size_t> sizes(config.entries);
+
+    if (parts.size() == 2 && parts[0] == "fixed") {
+        std::fill(sizes.begin(), sizes.end(), std::stoull(parts[1]));
+    } else if (parts.size() == 3 && parts[0] == "uniform") {
+        std::uniform_int_distribution<size_t> dist(std::stoull(parts[1]), std::stoull(parts[2]));
+        for (auto& size : sizes) {
+            size = dist(generator);
+        }
+    } else if (parts.size() == 2 && parts[0] == "exp") {
+        std::exponential_distribution<double> dist(1.0 / std::stod(parts[1]));
+        for (auto& size : sizes) {
+            size = static_cast<size_t>(dist(generator));
+        }
+    } else {
+        std::cerr << "Error: Unknown size distribution: " << config.sizeDistribution << "\n";
+        std::exit(1);
+    }
+
+    // Content is passed as a single command token, so it can never be empty
+    for (auto& size : sizes) {
+        size = std::max<size_t>(1, size);
+    }
+    return sizes;
+}
+
+/**
+ * Builds the directory part of the path for a given entry index
+ * @param config The benchmark configuration
+ * @param index The entry index
+ * @return Absolute directory path, e.g. /bench/d3/d7
+ */
+std::string directoryForEntry(const BenchConfig& config, size_t index) {
+    std::string path = "/bench";
+    size_t remaining = index;
+    for (size_t level = 0; level < config.depth; ++level) {
+        path += "/d" + std::to_string(remaining % config.fanout);
+        remaining /= config.fanout;
+    }
+    return path;
+}
+
+/**
+ * Runs a list of commands split across threads and records per-command latency
+ * @param operation Name of the operation being measured
+ * @param commands The commands to execute
+ * @param threadCount Number of threads issuing commands
+ * @return The benchmark result for this phase
+ */
+BenchResult runCommands(const std::string& operation,
+                        const std::vector<std::string>& commands,
+                        size_t threadCount) {
+    threadCount = std::max<size_t>(1, std::min(threadCount, commands.size()));
+    std::vector<std::vector<double>> perThreadLatencies(threadCount);
+    std::vector<std::thread> threads;
+
+    // Reserve the threads up front so their bookkeeping is not counted
+    threads.reserve(threadCount);
+    uint64_t allocationsBefore = allocationCount.load();
+    uint64_t bytesBefore = allocationBytes.load();
+    auto phaseStart = std::chrono::steady_clock::now();
+
+    // Each thread executes a contiguous slice of the commands
+    for (size_t t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&, t]() {
+            size_t begin = commands.size() * t / threadCount;
+            size_t end = commands.size() * (t + 1) / threadCount;
+            auto& latencies = perThreadLatencies[t];
+            latencies.reserve(end - begin);
+
+            for (size_t i = begin; i < end; ++i) {
+                auto start = std::chrono::steady_clock::now();
+                executeCommand(commands[i]);
+                auto stop = std::chrono::steady_clock::now();
+                latencies.push_back(std::chrono::duration<double, std::micro>(stop - start).count());
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto phaseEnd = std::chrono::steady_clock::now();
+
+    BenchResult result;
+    result.operation = operation;
+    result.count = commands.size();
+    result.threads = threadCount;
+    result.totalSeconds = std::chrono::duration<double>(phaseEnd - phaseStart).count();
+    result.allocations = allocationCount.load() - allocationsBefore;
+    result.allocatedBytes = allocationBytes.load() - bytesBefore;
+    for (const auto& latencies : perThreadLatencies) {
+        result.latenciesUs.insert(result.latenciesUs.end(), latencies.begin(), latencies.end());
+    }
+    return result;
+}
+
+/**
+ * Runs paired setup/measured commands sequentially, timing only the measured one
+ * @param operation Name of the operation being measured
+ * @param measured Commands whose latency is recorded
+ * @param cleanup Commands run untimed after each measured command (may be empty)
+ * @return The benchmark result for this phase
+ */
+BenchResult runSequential(const std::string& operation,
+                          const std::vector<std::string>& measured,
+                          const std::vector<std::string>& cleanup) {
+    BenchResult result;
+    result.operation = operation;
+    result.count = measured.size();
+    result.threads = 1;
+    result.totalSeconds = 0;
+
+    for (size_t i = 0; i < measured.size(); ++i) {
+        uint64_t allocationsBefore = allocationCount.load();
+        uint64_t bytesBefore = allocationBytes.load();
+        auto start = std::chrono::steady_clock::now();
+        executeCommand(measured[i]);
+        auto stop = std::chrono::steady_clock::now();
+        result.allocations += allocationCount.load() - allocationsBefore;
+        result.allocatedBytes += allocationBytes.load() - bytesBefore;
+
+        double elapsed = std::chrono::duration<double>(stop - start).count();
+        result.totalSeconds += elapsed;
+        result.latenciesUs.push_back(elapsed * 1e6);
+
+        if (i < cleanup.size() && !cleanup[i].empty()) {
+            executeCommand(cleanup[i]);
+        }
+    }
+    return result;
+}
+
+/**
+ * Returns the given percentile of a sorted latency vector
+ * @param sorted Latencies sorted in ascending order
+ * @param percentile Percentile in the range [0, 100]
+ * @return The latency at that percentile
+ */
+double percentileOf(const std::vector<double>& sorted, double percentile) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(percentile / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+/**
+ * Writes all results in the configured format
+ * @param out The stream to write to
+ * @param config The benchmark configuration
+ * @param results The results to report
+ */
+void reportResults(std::ostream& out, const BenchConfig& config, std::vector<BenchResult>& results) {
+    if (config.format == "csv") {
+        out << "operation,count,threads,total_s,ops_per_s,mean_us,p50_us,p90_us,p99_us,max_us,"
+            << "allocs_per_op,alloc_bytes_per_op,entries_per_s,bytes_per_s\n";
+    } else {
+        out << "{\n"
+            << "  \"benchmark\": \"memfs\",\n"
+            << "  \"config\": {\"entries\": " << config.entries
+            << ", \"sizes\": \"" << config.sizeDistribution << "\""
+            << ", \"depth\": " << config.depth
+            << ", \"fanout\": " << config.fanout
+            << ", \"threads\": " << config.threads
+            << ", \"iterations\": " << config.iterations
+            << ", \"batch\": " << config.batch
+            << ", \"seed\": " << config.seed << "},\n"
+            << "  \"results\": [\n";
+    }
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto& result = results[i];
+        std::sort(result.latenciesUs.begin(), result.latenciesUs.end());
+
+        double sum = 0;
+        for (double latency : result.latenciesUs) {
+            sum += latency;
+        }
+        double mean = result.latenciesUs.empty() ? 0 : sum / result.latenciesUs.size();
+        double opsPerSecond = result.totalSeconds > 0 ? result.count / result.totalSeconds : 0;
+        double maxLatency = result.latenciesUs.empty() ? 0 : result.latenciesUs.back();
+        double allocationsPerOp = result.count > 0 ? static_cast<double>(result.allocations) / result.count : 0;
+        double bytesPerOp = result.count > 0 ? static_cast<double>(result.allocatedBytes) / result.count : 0;
+        double entriesPerSecond = opsPerSecond * result.entriesPerOp;
+        double contentBytesPerSecond = opsPerSecond * result.bytesPerOp;
+
+        if (config.format == "csv") {
+            out << result.operation << "," << result.count << "," << result.threads << ","
+                << result.totalSeconds << "," << opsPerSecond << "," << mean << ","
+                << percentileOf(result.latenciesUs, 50) << ","
+                << percentileOf(result.latenciesUs, 90) << ","
+                << percentileOf(result.latenciesUs, 99) << ","
+                << maxLatency << ","
+                << allocationsPerOp << "," << bytesPerOp << "," << entriesPerSecond << ","
+                << contentBytesPerSecond << "\n";
+        } else {
+            out << "    {\"operation\": \"" << result.operation << "\""
+                << ", \"count\": " << result.count
+                << ", \"threads\": " << result.threads
+                << ", \"total_s\": " << result.totalSeconds
+                << ", \"ops_per_s\": " << opsPerSecond
+                << ", \"latency_us\": {\"mean\": " << mean
+                << ", \"p50\": " << percentileOf(result.latenciesUs, 50)
+                << ", \"p90\": " << percentileOf(result.latenciesUs, 90)
+                << ", \"p99\": " << percentileOf(result.latenciesUs, 99)
+                << ", \"max\": " << maxLatency << "}"
+                << ", \"allocs_per_op\": " << allocationsPerOp
+                << ", \"alloc_bytes_per_op\": " << bytesPerOp
+                << ", \"entries_per_s\": " << entriesPerSecond
+                << ", \"bytes_per_s\": " << contentBytesPerSecond << "}"
+                << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+    }
+
+    if (config.format == "json") {
+        out << "  ]\n}\n";
+    }
+}
+
+/**
+ * Main function to run the benchmark suite
+ */
+int main(int argc, char** argv) {
+    BenchConfig config = parseArguments(argc, argv);
+    std::vector<size_t> sizes = generateSizes(config);
+
+    // Build the file paths and the set of leaf directories
+    std::vector<std::string> paths(config.entries);
+    std::vector<std::string> leafDirectories;
+    for (size_t i = 0; i < config.entries; ++i) {
+        std::string directory = directoryForEntry(config, i);
+        paths[i] = directory + "/f" + std::to_string(i);
+        if (std::find(leafDirectories.begin(), leafDirectories.end(), directory) == leafDirectories.end()) {
+            leafDirectories.push_back(directory);
+        }
+    }
+
+    // Entries below /bench, which is what a recursive copy of it processes
+    std::vector<std::string> directories;
+    for (const auto& directory : leafDirectories) {
+        for (std::string parent = directory; parent.size() > std::string("/bench").size();
+             parent = parent.substr(0, parent.find_last_of('/'))) {
+            directories.push_back(parent);
+        }
+    }
+    std::sort(directories.begin(), directories.end());
+    size_t treeEntries = paths.size() +
+                         (std::unique(directories.begin(), directories.end()) - directories.begin());
+
+    auto wants = [&](const std::string& operation) {
+        return ("," + config.operations + ",").find("," + operation + ",") != std::string::npos;
+    };
+
+    // Keep the report on the real stdout and silence command output
+    std::ostream report(std::cout.rdbuf());
+    NullBuffer nullBuffer;
+    std::streambuf* savedCout = std::cout.rdbuf(&nullBuffer);
+    std::streambuf* savedCerr = std::cerr.rdbuf(&nullBuffer);
+
+    initializeFileSystem();
+    std::vector<BenchResult> results;
+    std::vector<std::string> commands;
+
+    // Per-entry operations, split across client threads. Files are always
+    // created and written so later phases have something to work on.
+    commands.clear();
+    for (const auto& path : paths) {
+        commands.push_back("create " + path);
+    }
+    BenchResult createResult = runCommands("create", commands, config.threads);
+    if (wants("create")) {
+        results.push_back(createResult);
+    }
+
+    commands.clear();
+    for (size_t i = 0; i < paths.size(); ++i) {
+        commands.push_back("write " + paths[i] + " " + std::string(sizes[i], 'x'));
+    }
+    BenchResult writeResult = runCommands("write", commands, config.threads);
+    if (wants("write")) {
+        results.push_back(writeResult);
+    }
+    commands.clear();
+    commands.shrink_to_fit();
+
+    if (wants("read")) {
+        for (const auto& path : paths) {
+            commands.push_back("read " + path);
+        }
+        results.push_back(runCommands("read", commands, config.threads));
+        commands.clear();
+    }
+
+    // Multi-file commands over a separate tree, config.batch files per command
+    if (wants("batch-create") || wants("batch-write") || wants("batch-delete")) {
+        std::vector<std::string> creates, writes, deletes;
+        for (size_t begin = 0; begin < paths.size(); begin += config.batch) {
+            size_t end = std::min(paths.size(), begin + config.batch);
+            std::string count = std::to_string(end - begin) + " ";
+            std::string create = "create -n " + count;
+            std::string write = "write -n " + count;
+            std::string remove = "delete -n " + count;
+            for (size_t i = begin; i < end; ++i) {
+                std::string path = "/batch/b" + std::to_string(i);
+                create += path + " ";
+                write += path + " " + std::string(sizes[i], 'x') + " ";
+                remove += path + " ";
+            }
+            creates.push_back(create);
+            writes.push_back(write);
+            deletes.push_back(remove);
+        }
+
+        BenchResult createBatch = runCommands("batch-create", creates, config.threads);
+        BenchResult writeBatch = runCommands("batch-write", writes, config.threads);
+        BenchResult deleteBatch = runCommands("batch-delete", deletes, config.threads);
+        executeCommand("rmdir -r /batch");
+        for (BenchResult* result : {&createBatch, &writeBatch, &deleteBatch}) {
+            if (wants(result->operation)) {
+                results.push_back(*result);
+            }
+        }
+    }
+
+    if (wants("ls")) {
+        for (size_t i = 0; i < config.iterations; ++i) {
+            for (const auto& directory : leafDirectories) {
+                commands.push_back("ls -l " + directory);
+            }
+        }
+        results.push_back(runCommands("ls", commands, config.threads));
+        commands.clear();
+    }
+
+    if (wants("search")) {
+        std::mt19937_64 generator(config.seed);
+        for (size_t i = 0; i < config.iterations * config.threads; ++i) {
+            commands.push_back("search f" + std::to_string(generator() % std::max<size_t>(1, config.entries)));
+        }
+        results.push_back(runCommands("search", commands, config.threads));
+        commands.clear();
+    }
+
+    // Whole-tree operations, run sequentially
+    if (wants("mv")) {
+        std::vector<std::string> measured;
+        for (size_t i = 0; i < config.iterations; ++i) {
+            measured.push_back(i % 2 == 0 ? "mv /bench /bench_mv" : "mv /bench_mv /bench");
+        }
+        results.push_back(runSequential("mv", measured, {}));
+        if (config.iterations % 2 == 1) {
+            executeCommand("mv /bench_mv /bench");
+        }
+    }
+
+    if (wants("cp")) {
+        std::vector<std::string> measured(config.iterations, "cp /bench /bench_cp");
+        std::vector<std::string> cleanup(config.iterations, "rmdir -r /bench_cp");
+        BenchResult copyResult = runSequential("cp", measured, cleanup);
+        copyResult.entriesPerOp = treeEntries;
+        results.push_back(copyResult);
+    }
+
+    if (wants("save") || wants("load")) {
+        std::vector<std::string> saves(config.iterations, "save " + config.savePath);
+        BenchResult saveResult = runSequential("save", saves, {});
+        if (wants("save")) {
+            results.push_back(saveResult);
+        }
+        if (wants("load")) {
+            std::vector<std::string> loads(config.iterations, "load " + config.savePath);
+            results.push_back(runSequential("load", loads, {}));
+        }
+        std::remove(config.savePath.c_str());
+    }
+
+    // Streaming a host file in, against cat(1) into tmpfs
+    if (wants("ingest") || wants("ingest-baseline")) {
+        std::string source = config.savePath + ".ingest";
+        {
+            std::ofstream out(source, std::ios::binary);
+            std::string block(1 << 20, 'x');
+            for (size_t written = 0; written < config.ingestSize; written += block.size()) {
+                out.write(block.data(), std::min(block.size(), config.ingestSize - written));
+            }
+        }
+        if (wants("ingest")) {
+            std::vector<std::string> measured(config.iterations, "write -f " + source + " /ingest");
+            std::vector<std::string> cleanup(config.iterations, "delete /ingest");
+            BenchResult ingestResult = runSequential("ingest", measured, cleanup);
+            ingestResult.bytesPerOp = config.ingestSize;
+            results.push_back(ingestResult);
+        }
+        if (wants("ingest-baseline")) {
+            std::string target = "/dev/shm/memfs_bench_ingest." + std::to_string(getpid());
+            BenchResult baseline;
+            baseline.operation = "ingest-baseline";
+            baseline.threads = 1;
+            baseline.totalSeconds = 0;
+            baseline.bytesPerOp = config.ingestSize;
+            for (size_t i = 0; i < config.iterations; ++i) {
+                auto start = std::chrono::steady_clock::now();
+                int status = std::system(("cat " + source + " > " + target).c_str());
+                double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                baseline.totalSeconds += elapsed;
+                baseline.latenciesUs.push_back(elapsed * 1e6);
+                std::remove(target.c_str());
+                if (status != 0) {
+                    break;
+                }
+            }
+            baseline.count = baseline.latenciesUs.size();
+            results.push_back(baseline);
+        }
+        std::remove(source.c_str());
+    }
+
+    // Restore the streams before the null buffer goes out of scope
+    std::cout.rdbuf(savedCout);
+    std::cerr.rdbuf(savedCerr);
+
+    reportResults(report, config, results);
+    return 0;
+}
@@ -0,0 +1,176 @@
+// Command line client for a memory file system served over a Unix socket
+#include "socketProtocol.h"
+#include "shmRing.h"
+#include <iostream>     // For input/output operations
+#include <string>       // For string manipulation
+#include <cstring>      // For strerror
+#include <cerrno>       // For errno
+#include <cstdlib>      // For std::exit
+#include <fcntl.h>      // For reading file seals
+#include <sys/mman.h>   // For mapping shared content
+#include <sys/stat.h>   // For fstat
+#include <unistd.h>     // For write and close
+
+/**
+ * Client configuration, filled from the command line
+ */
+struct ClientConfig {
+    std::string socketPath;              // Socket the server listens on
+    std::string command;                 // Single command to run, empty to read commands from stdin
+    bool cat = false;                    // Write shared content to stdout instead of describing it
+    bool ring = false;                   // Send commands over a shared-memory ring instead of the socket
+};
+
+/**
+ * Prints usage information and exits
+ * @param program Name of the executable
+ */
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " <socket_path> [--cat] [--ring] [<command>]\n"
+              << "  Runs <command>, or each line of stdin, on a server started with 'memfs --serve'.\n"
+              << "  --cat   Write the content received from 'share' to stdout\n"
+              << "  --ring  Send commands over a shared-memory ring (descriptors are not passed)\n";
+    std::exit(1);
+}
+
+/**
+ * Parses command line options into a client configuration
+ * @param argc Argument count
+ * @param argv Argument values
+ * @return The parsed configuration
+ */
+ClientConfig parseArguments(int argc, char** argv) {
+    ClientConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument == "--cat") {
+            config.cat = true;
+        } else if (argument == "--ring") {
+            config.ring = true;
+        } else if (config.socketPath.empty()) {
+            config.socketPath = argument;
+        } else {
+            config.command += (config.command.empty() ? "" : " ") + argument;
+        }
+    }
+    if (config.socketPath.empty()) {
+        printUsage(argv[0]);
+    }
+    return config;
+}
+
+/**
+ * Maps a descriptor received from 'share' and either writes or describes its content
+ * @param descriptor The sealed memfd, closed on return
+ * @param cat Whether to write the content to stdout
+ */
+void consumeSharedContent(int descriptor, bool cat) {
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || status.st_size == 0) {
+        std::cerr << "Error: Received an unusable descriptor\n";
+        close(descriptor);
+        return;
+    }
+    size_t length = static_cast<size_t>(status.st_size);
+    int seals = fcntl(descriptor, F_GET_SEALS);
+    void* mapping = mmap(nullptr, length, PROT_READ, MAP_SHARED, descriptor, 0);
+    close(descriptor);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Error: Could not map shared content: " << std::strerror(errno) << "\n";
+        return;
+    }
+
+    if (cat) {
+        std::cout.flush();
+        const char* data = static_cast<const char*>(mapping);
+        while (length > 0) {
+            ssize_t written = write(STDOUT_FILENO, data, length);
+            if (written <= 0) {
+                break;
+            }
+            data += written;
+            length -= written;
+        }
+    } else {
+        bool sealed = seals >= 0 && (seals & F_SEAL_WRITE) && (seals & F_SEAL_SHRINK);
+        std::cout << "Mapped " << length << " bytes " << (sealed ? "read-only (sealed)" : "(not sealed)") << "\n";
+    }
+    munmap(mapping, static_cast<size_t>(status.st_size));
+}
+
+/**
+ * Sends one command and prints its response
+ * @param socket The connected socket
+ * @param ring The ring to send over instead of the socket, or null
+ * @param command The command line
+ * @param cat Whether shared content is written to stdout
+ * @return False if the connection was lost
+ */
+bool runCommand(int socket, RingEndpoint* ring, const std::string& command, bool cat) {
+    std::string output;
+    int descriptor = -1;
+    if (ring) {
+        if (!ringSend(*ring, command) || !ringReceive(*ring, output)) {
+            return false;
+        }
+    } else {
+        std::string request = command + "\n";
+        if (!sendAll(socket, request.data(), request.size()) || !receiveResponse(socket, output, descriptor)) {
+            return false;
+        }
+    }
+
+    if (!(cat && descriptor >= 0)) {
+        std::cout << output;
+    }
+    if (descriptor >= 0) {
+        consumeSharedContent(descriptor, cat);
+    }
+    return true;
+}
+
+/**
+ * Main function to run the client
+ */
+int main(int argc, char** argv) {
+    ClientConfig config = parseArguments(argc, argv);
+
+    int connection = connectSocket(config.socketPath);
+    if (connection < 0) {
+        std::cerr << "Error: Could not connect to " << config.socketPath << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+
+    RingRegion* region = nullptr;
+    RingEndpoint endpoint;
+    if (config.ring) {
+        region = requestRing(connection);
+        if (!region) {
+            std::cerr << "Error: The server did not provide a ring\n";
+            close(connection);
+            return 1;
+        }
+        endpoint = {&region->submission, &region->completion, &region->closed, kMinSpinIterations};
+    }
+
+    bool connected = true;
+    if (!config.command.empty()) {
+        connected = runCommand(connection, region ? &endpoint : nullptr, config.command, config.cat);
+    } else {
+        std::string line;
+        while (connected && std::getline(std::cin, line)) {
+            connected = runCommand(connection, region ? &endpoint : nullptr, line, config.cat);
+        }
+    }
+
+    if (region) {
+        closeRing(*region);
+        munmap(region, sizeof(RingRegion));
+    }
+    close(connection);
+    if (!connected) {
+        std::cerr << "Error: Connection to the server was lost\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,228 @@
+// Latency benchmark of the socket and shared-memory ring transports
+#include "memFS.h"
+#include "server.h"
+#include "latencyHistogram.h"
+#include "socketProtocol.h"
+#include "shmRing.h"
+#include <iostream>     // For input/output operations
+#include <string>       // For string manipulation
+#include <vector>       // For dynamic arrays
+#include <memory>       // For smart pointers
+#include <chrono>       // For time-related functions
+#include <thread>       // For waiting on the server
+#include <cstring>      // For strerror
+#include <cerrno>       // For errno
+#include <cstdlib>      // For std::exit
+#include <csignal>      // For stopping the forked server
+#include <sys/wait.h>   // For reaping the forked server
+#include <unistd.h>     // For fork and getpid
+
+/**
+ * Benchmark configuration, filled from the command line
+ */
+struct IpcBenchConfig {
+    std::string socketPath;              // Server to connect to, empty to fork one
+    size_t iterations = 100000;          // Timed round trips per transport and command
+    size_t size = 64;                    // Size of the file read by the 'read' command
+    std::string format = "text";         // Output format: text or json
+};
+
+/**
+ * Latencies of one command over one transport
+ */
+struct IpcBenchResult {
+    std::string transport;
+    std::string command;
+    std::unique_ptr<LatencyHistogram> histogram;
+};
+
+/**
+ * Prints usage information and exits
+ * @param program Name of the executable
+ */
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --socket <path>      Connect to a running 'memfs --serve' instead of forking one\n"
+              << "  --iterations <n>     Timed round trips per transport and command (default 100000)\n"
+              << "  --size <bytes>       Size of the file read by 'read' (default 64)\n"
+              << "  --format <text|json> Output format (default text)\n";
+    std::exit(1);
+}
+
+/**
+ * Parses command line options into a benchmark configuration
+ * @param argc Argument count
+ * @param argv Argument values
+ * @return The parsed configuration
+ */
+IpcBenchConfig parseArguments(int argc, char** argv) {
+    IpcBenchConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (i + 1 >= argc) {
+            printUsage(argv[0]);
+        }
+
+        std::string value = argv[++i];
+        if (option == "--socket") {
+            config.socketPath = value;
+        } else if (option == "--iterations") {
+            config.iterations = std::max<size_t>(1, std::stoull(value));
+        } else if (option == "--size") {
+            config.size = std::stoull(value);
+        } else if (option == "--format") {
+            config.format = value;
+        } else {
+            printUsage(argv[0]);
+        }
+    }
+    if (config.format != "text" && config.format != "json") {
+        printUsage(argv[0]);
+    }
+    return config;
+}
+
+/**
+ * Connects to the server, retrying while a forked one starts up
+ * @param path The socket path
+ * @return The connected socket
+ */
+int connectWithRetry(const std::string& path) {
+    for (int attempt = 0; attempt < 200; ++attempt) {
+        int connection = connectSocket(path);
+        if (connection >= 0) {
+            return connection;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::cerr << "Error: Could not connect to " << path << ": " << std::strerror(errno) << "\n";
+    std::exit(1);
+}
+
+/**
+ * Times round trips of one command over one transport
+ * @param roundTrip Sends the command and waits for its response
+ * @param iterations Number of timed round trips, after an untimed warm-up
+ * @return Latencies in nanoseconds
+ */
+template <typename RoundTrip>
+std::unique_ptr<LatencyHistogram> measure(RoundTrip roundTrip, size_t iterations) {
+    std::unique_ptr<LatencyHistogram> histogram(new LatencyHistogram());
+    for (size_t i = 0; i < std::min<size_t>(iterations, 1000); ++i) {
+        roundTrip();
+    }
+    for (size_t i = 0; i < iterations; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        roundTrip();
+        auto stop = std::chrono::steady_clock::now();
+        histogram->record(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+    }
+    return histogram;
+}
+
+/**
+ * Writes the results in the configured format
+ * @param config The benchmark configuration
+ * @param results The results to report
+ */
+void reportResults(const IpcBenchConfig& config, const std::vector<IpcBenchResult>& results) {
+    if (config.format == "json") {
+        std::cout << "{\n"
+                  << "  \"benchmark\": \"memfs_ipc\",\n"
+                  << "  \"config\": {\"iterations\": " << config.iterations << ", \"size\": " << config.size << "},\n"
+                  << "  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const LatencyHistogram& histogram = *results[i].histogram;
+            std::cout << "    {\"transport\": \"" << results[i].transport << "\""
+                      << ", \"command\": \"" << results[i].command << "\""
+                      << ", \"count\": " << histogram.count()
+                      << ", \"latency_us\": {\"mean\": " << histogram.mean() / 1000.0
+                      << ", \"p50\": " << histogram.percentile(50) / 1000.0
+                      << ", \"p90\": " << histogram.percentile(90) / 1000.0
+                      << ", \"p99\": " << histogram.percentile(99) / 1000.0
+                      << ", \"p999\": " << histogram.percentile(99.9) / 1000.0
+                      << ", \"max\": " << histogram.max() / 1000.0 << "}}"
+                      << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        std::cout << "  ]\n}\n";
+        return;
+    }
+
+    std::cout << "Transport\tCommand\tCount\tMean(us)\tp50(us)\tp90(us)\tp99(us)\tp999(us)\tMax(us)\n";
+    for (const auto& result : results) {
+        const LatencyHistogram& histogram = *result.histogram;
+        std::cout << result.transport << "\t" << result.command << "\t" << histogram.count() << "\t"
+                  << histogram.mean() / 1000.0 << "\t"
+                  << histogram.percentile(50) / 1000.0 << "\t"
+                  << histogram.percentile(90) / 1000.0 << "\t"
+                  << histogram.percentile(99) / 1000.0 << "\t"
+                  << histogram.percentile(99.9) / 1000.0 << "\t"
+                  << histogram.max() / 1000.0 << "\n";
+    }
+}
+
+/**
+ * Main function to run the transport benchmark
+ */
+int main(int argc, char** argv) {
+    IpcBenchConfig config = parseArguments(argc, argv);
+
+    // Without a server to connect to, run one in a child process
+    pid_t server = 0;
+    if (config.socketPath.empty()) {
+        config.socketPath = "/tmp/memfs_ipcbench." + std::to_string(getpid()) + ".sock";
+        server = fork();
+        if (server == 0) {
+            std::cout.setstate(std::ios::failbit);
+            initializeFileSystem();
+            std::_Exit(runServer(config.socketPath));
+        }
+    }
+
+    int connection = connectWithRetry(config.socketPath);
+    const std::vector<std::string> commands = {"read /ipcbench/small", "stats"};
+    std::string output;
+    int descriptor = -1;
+
+    auto socketRoundTrip = [&](const std::string& command) {
+        std::string request = command + "\n";
+        if (!sendAll(connection, request.data(), request.size()) ||
+            !receiveResponse(connection, output, descriptor)) {
+            std::cerr << "Error: Connection to the server was lost\n";
+            std::exit(1);
+        }
+    };
+    socketRoundTrip("write /ipcbench/small " + std::string(config.size, 'x'));
+
+    std::vector<IpcBenchResult> results;
+    for (const auto& command : commands) {
+        results.push_back({"socket", command, measure([&]() { socketRoundTrip(command); }, config.iterations)});
+    }
+
+    RingRegion* region = requestRing(connection);
+    if (!region) {
+        std::cerr << "Error: The server did not provide a ring\n";
+        return 1;
+    }
+    RingEndpoint endpoint = {&region->submission, &region->completion, &region->closed, kMinSpinIterations};
+    for (const auto& command : commands) {
+        auto ringRoundTrip = [&]() {
+            if (!ringSend(endpoint, command) || !ringReceive(endpoint, output)) {
+                std::cerr << "Error: The ring was closed\n";
+                std::exit(1);
+            }
+        };
+        results.push_back({"ring", command, measure(ringRoundTrip, config.iterations)});
+    }
+
+    closeRing(*region);
+    close(connection);
+    if (server > 0) {
+        kill(server, SIGTERM);
+        waitpid(server, nullptr, 0);
+        unlink(config.socketPath.c_str());
+    }
+
+    reportResults(config, results);
+    return 0;
+}
@@ -0,0 +1,309 @@
+// Deterministic replay of recorded memory file system workload traces
+#include "memFS.h"
+#include "latencyHistogram.h"
+#include "traceFormat.h"
+#include <iostream>     // For input/output operations
+#include <fstream>      // For reading the trace file
+#include <string>       // For string manipulation
+#include <vector>       // For dynamic arrays
+#include <map>          // For ordered per-command reports
+#include <memory>       // For smart pointers
+#include <chrono>       // For time-related functions
+#include <thread>       // For multi-threading support
+#include <atomic>       // For the shared record cursor
+#include <algorithm>    // For standard algorithms
+#include <cstdlib>      // For std::exit
+
+/**
+ * Replay configuration, filled from the command line
+ */
+struct ReplayConfig {
+    std::string tracePath;               // Trace file to replay
+    double speed = 1.0;                  // Time scale factor, 0 means as fast as possible
+    size_t threads = 1;                  // Client threads issuing commands
+    std::string format = "text";         // Output format: text or json
+};
+
+/**
+ * A recorded command with its offset from the start of the trace
+ */
+struct TraceRecord {
+    uint64_t offsetMicros;
+    std::string command;
+    std::string commandName;
+};
+
+/**
+ * Stream buffer that discards everything, used to silence command output
+ */
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+/**
+ * Prints usage information and exits
+ * @param program Name of the executable
+ */
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " <tracefile> [options]\n"
+              << "  --speed <s>          original | max | <factor> e.g. 4 for 4x (default original)\n"
+              << "  --threads <n>        Client threads issuing commands (default 1)\n"
+              << "  --format <text|json> Output format (default text)\n";
+    std::exit(1);
+}
+
+/**
+ * Parses command line options into a replay configuration
+ * @param argc Argument count
+ * @param argv Argument values
+ * @return The parsed configuration
+ */
+ReplayConfig parseArguments(int argc, char** argv) {
+    ReplayConfig config;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option.compare(0, 2, "--") != 0) {
+            config.tracePath = option;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            printUsage(argv[0]);
+        }
+
+        std::string value = argv[++i];
+        if (option == "--speed") {
+            if (value == "original") {
+                config.speed = 1.0;
+            } else if (value == "max") {
+                config.speed = 0;
+            } else {
+                if (!value.empty() && (value.back() == 'x' || value.back() == 'X')) {
+                    value.pop_back();
+                }
+                config.speed = std::stod(value);
+                if (config.speed <= 0) {
+                    printUsage(argv[0]);
+                }
+            }
+        } else if (option == "--threads") {
+            config.threads = std::max<size_t>(1, std::stoull(value));
+        } else if (option == "--format") {
+            config.format = value;
+        } else {
+            printUsage(argv[0]);
+        }
+    }
+
+    if (config.tracePath.empty() || (config.format != "text" && config.format != "json")) {
+        printUsage(argv[0]);
+    }
+    return config;
+}
+
+/**
+ * Loads every record of a trace file into memory
+ * @param path The trace file path
+ * @return Records with absolute offsets from the start of the trace
+ */
+std::vector<TraceRecord> loadTrace(const std::string& path) {
+    std::ifstream inFile(path, std::ios::binary);
+    if (!inFile) {
+        std::cerr << "Error: Could not open trace file: " << path << "\n";
+        std::exit(1);
+    }
+    if (!readTraceHeader(inFile)) {
+        std::cerr << "Error: Not a memfs trace file: " << path << "\n";
+        std::exit(1);
+    }
+
+    std::vector<TraceRecord> records;
+    uint64_t offset = 0;
+    uint64_t delta = 0;
+    std::string command;
+    while (readTraceRecord(inFile, delta, command)) {
+        offset += delta;
+
+        // The command name is everything up to the first space
+        size_t begin = command.find_first_not_of(' ');
+        size_t end = command.find(' ', begin);
+        std::string commandName = begin == std::string::npos ? "" : command.substr(begin, end - begin);
+        records.push_back({offset, command, commandName});
+    }
+    if (inFile.peek() != std::char_traits<char>::eof()) {
+        std::cerr << "Error: Corrupt record after " << records.size() << " commands in " << path << "\n";
+        std::exit(1);
+    }
+    return records;
+}
+
+/**
+ * Writes the per-command report
+ * @param out The stream to write to
+ * @param config The replay configuration
+ * @param histograms Merged latency histograms in nanoseconds, keyed by command name
+ * @param totalSeconds Wall time of the whole replay
+ */
+void reportResults(std::ostream& out, const ReplayConfig& config,
+                   const std::map<std::string, std::unique_ptr<LatencyHistogram>>& histograms,
+                   double totalSeconds) {
+    uint64_t totalCommands = 0;
+    for (const auto& entry : histograms) {
+        totalCommands += entry.second->count();
+    }
+
+    if (config.format == "json") {
+        out << "{\n"
+            << "  \"trace\": \"" << config.tracePath << "\",\n"
+            << "  \"speed\": " << config.speed << ",\n"
+            << "  \"threads\": " << config.threads << ",\n"
+            << "  \"total_s\": " << totalSeconds << ",\n"
+            << "  \"commands\": " << totalCommands << ",\n"
+            << "  \"ops_per_s\": " << (totalSeconds > 0 ? totalCommands / totalSeconds : 0) << ",\n"
+            << "  \"results\": [\n";
+        size_t index = 0;
+        for (const auto& entry : histograms) {
+            const LatencyHistogram& histogram = *entry.second;
+            out << "    {\"command\": \"" << entry.first << "\""
+                << ", \"count\": " << histogram.count()
+                << ", \"ops_per_s\": " << (totalSeconds > 0 ? histogram.count() / totalSeconds : 0)
+                << ", \"latency_us\": {\"mean\": " << histogram.mean() / 1000.0
+                << ", \"p50\": " << histogram.percentile(50) / 1000.0
+                << ", \"p90\": " << histogram.percentile(90) / 1000.0
+                << ", \"p99\": " << histogram.percentile(99) / 1000.0
+                << ", \"p999\": " << histogram.percentile(99.9) / 1000.0
+                << ", \"max\": " << histogram.max() / 1000.0 << "}"
+                << ", \"histogram\": [";
+
+            // Buckets are reported as [upper bound in us, count] pairs
+            bool first = true;
+            for (size_t i = 0; i < LatencyHistogram::kBucketCount; ++i) {
+                if (histogram.bucketCount(i) != 0) {
+                    out << (first ? "" : ", ") << "[" << LatencyHistogram::bucketUpperBound(i) / 1000.0
+                        << ", " << histogram.bucketCount(i) << "]";
+                    first = false;
+                }
+            }
+            out << "]}" << (++index < histograms.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+        return;
+    }
+
+    out << "Replayed " << totalCommands << " commands from " << config.tracePath
+        << " in " << totalSeconds << " s (" << (totalSeconds > 0 ? totalCommands / totalSeconds : 0)
+        << " ops/s, " << config.threads << " threads)\n\n";
+    out << "Command\tCount\tOps/s\tMean(us)\tp50(us)\tp90(us)\tp99(us)\tp999(us)\tMax(us)\n";
+    for (const auto& entry : histograms) {
+        const LatencyHistogram& histogram = *entry.second;
+        out << entry.first << "\t" << histogram.count() << "\t"
+            << (totalSeconds > 0 ? histogram.count() / totalSeconds : 0) << "\t"
+            << histogram.mean() / 1000.0 << "\t"
+            << histogram.percentile(50) / 1000.0 << "\t"
+            << histogram.percentile(90) / 1000.0 << "\t"
+            << histogram.percentile(99) / 1000.0 << "\t"
+            << histogram.percentile(99.9) / 1000.0 << "\t"
+            << histogram.max() / 1000.0 << "\n";
+    }
+
+    // Coarse histogram per command: one row per power-of-two latency range
+    for (const auto& entry : histograms) {
+        const LatencyHistogram& histogram = *entry.second;
+        out << "\nLatency histogram for " << entry.first << ":\n";
+
+        uint64_t rangeCount = 0;
+        uint64_t rangeLower = 0;
+        for (size_t i = 0; i < LatencyHistogram::kBucketCount; ++i) {
+            uint64_t upper = LatencyHistogram::bucketUpperBound(i);
+            rangeCount += histogram.bucketCount(i);
+
+            // Close a range whenever the next bucket starts a new power of two
+            bool lastBucket = i + 1 == LatencyHistogram::kBucketCount;
+            uint64_t next = lastBucket ? 0 : LatencyHistogram::bucketLowerBound(i + 1);
+            if (lastBucket || (next & (next - 1)) == 0) {
+                if (rangeCount != 0) {
+                    out << "  [" << rangeLower / 1000.0 << ", " << (upper + 1) / 1000.0 << ") us\t"
+                        << rangeCount << "\n";
+                }
+                rangeCount = 0;
+                rangeLower = next;
+            }
+        }
+    }
+}
+
+/**
+ * Main function to replay a workload trace
+ */
+int main(int argc, char** argv) {
+    ReplayConfig config = parseArguments(argc, argv);
+    std::vector<TraceRecord> records = loadTrace(config.tracePath);
+
+    // One histogram set per thread, merged after the replay
+    std::vector<std::map<std::string, std::unique_ptr<LatencyHistogram>>> perThread(config.threads);
+    for (auto& histograms : perThread) {
+        for (const auto& record : records) {
+            if (histograms.find(record.commandName) == histograms.end()) {
+                histograms[record.commandName].reset(new LatencyHistogram());
+            }
+        }
+    }
+
+    initializeFileSystem();
+
+    // Threads pull records in trace order and wait for their scheduled time
+    std::atomic<size_t> nextRecord(0);
+    std::vector<std::thread> threads;
+    auto replayStart = std::chrono::steady_clock::now();
+
+    for (size_t t = 0; t < config.threads; ++t) {
+        threads.emplace_back([&, t]() {
+            // Each client has its own working directory, and its output is discarded
+            NullBuffer nullBuffer;
+            std::ostream silent(&nullBuffer);
+            Session session;
+            session.output = &silent;
+            session.errors = &silent;
+            SessionScope scope(session);
+
+            auto& histograms = perThread[t];
+            size_t index;
+            while ((index = nextRecord.fetch_add(1)) < records.size()) {
+                const TraceRecord& record = records[index];
+                if (config.speed > 0) {
+                    auto scheduled = replayStart + std::chrono::microseconds(
+                        static_cast<uint64_t>(record.offsetMicros / config.speed));
+                    std::this_thread::sleep_until(scheduled);
+                }
+
+                auto start = std::chrono::steady_clock::now();
+                executeCommand(record.command);
+                auto stop = std::chrono::steady_clock::now();
+                histograms[record.commandName]->record(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    double totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - replayStart).count();
+
+    std::map<std::string, std::unique_ptr<LatencyHistogram>> merged;
+    for (const auto& histograms : perThread) {
+        for (const auto& entry : histograms) {
+            auto& target = merged[entry.first];
+            if (!target) {
+                target.reset(new LatencyHistogram());
+            }
+            target->merge(*entry.second);
+        }
+    }
+
+    reportResults(std::cout, config, merged, totalSeconds);
+    return 0;
+}
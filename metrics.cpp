@@ -0,0 +1,337 @@
+// Low-overhead latency metrics for the memory file system
+#include "metrics.h"
+#include <algorithm>    // For standard algorithms
+#include <iomanip>      // For input/output manipulation
+#include <stdexcept>    // For std::length_error
+
+/**
+ * One thread's histograms for a ShardedHistogramSet. Histograms are
+ * allocated on first use so threads that touch a single slot stay small.
+ */
+struct ShardedHistogramSet::Shard {
+    explicit Shard(size_t slotCount) : histograms(slotCount) {
+        for (auto& histogram : histograms) {
+            histogram.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~Shard() {
+        for (auto& histogram : histograms) {
+            delete histogram.load(std::memory_order_relaxed);
+        }
+    }
+
+    LatencyHistogram& at(size_t slot) {
+        LatencyHistogram* histogram = histograms[slot].load(std::memory_order_acquire);
+        if (histogram == nullptr) {
+            histogram = new LatencyHistogram();
+            histograms[slot].store(histogram, std::memory_order_release);
+        }
+        return *histogram;
+    }
+
+    std::vector<std::atomic<LatencyHistogram*>> histograms;
+};
+
+namespace {
+std::atomic<size_t> nextInstanceId(0);
+}
+
+/**
+ * Per-thread table of shards, one per ShardedHistogramSet instance.
+ * Destroyed at thread exit, which hands each shard back to its owner.
+ */
+struct ThreadShards {
+    ShardedHistogramSet* owners[ShardedHistogramSet::kMaxInstances] = {};
+    ShardedHistogramSet::Shard* shards[ShardedHistogramSet::kMaxInstances] = {};
+
+    ~ThreadShards() {
+        for (size_t i = 0; i < ShardedHistogramSet::kMaxInstances; ++i) {
+            if (shards[i] != nullptr) {
+                owners[i]->retireShard(shards[i]);
+            }
+        }
+    }
+};
+
+thread_local ThreadShards threadShards;
+
+ShardedHistogramSet::ShardedHistogramSet(const std::vector<std::string>& names)
+    : instanceId(nextInstanceId.fetch_add(1)), slotNames(names), retired(new Shard(names.size())) {
+    if (instanceId >= kMaxInstances) {
+        delete retired;
+        throw std::length_error("Too many ShardedHistogramSet instances");
+    }
+}
+
+ShardedHistogramSet::~ShardedHistogramSet() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (Shard* shard : liveShards) {
+        delete shard;
+    }
+    liveShards.clear();
+    delete retired;
+}
+
+ShardedHistogramSet::Shard* ShardedHistogramSet::localShard() {
+    Shard*& shard = threadShards.shards[instanceId];
+    if (shard == nullptr) {
+        shard = new Shard(slotNames.size());
+        threadShards.owners[instanceId] = this;
+        std::lock_guard<std::mutex> lock(registryMutex);
+        liveShards.push_back(shard);
+    }
+    return shard;
+}
+
+void ShardedHistogramSet::retireShard(Shard* shard) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (size_t slot = 0; slot < slotNames.size(); ++slot) {
+        LatencyHistogram* histogram = shard->histograms[slot].load(std::memory_order_acquire);
+        if (histogram != nullptr) {
+            retired->at(slot).merge(*histogram);
+        }
+    }
+    liveShards.erase(std::remove(liveShards.begin(), liveShards.end(), shard), liveShards.end());
+    delete shard;
+}
+
+void ShardedHistogramSet::record(size_t slot, uint64_t value) {
+    localShard()->at(slot).record(value);
+}
+
+std::vector<std::unique_ptr<LatencyHistogram>> ShardedHistogramSet::collect() const {
+    std::vector<std::unique_ptr<LatencyHistogram>> merged(slotNames.size());
+    for (auto& histogram : merged) {
+        histogram.reset(new LatencyHistogram());
+    }
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto mergeShard = [&](const Shard* shard) {
+        for (size_t slot = 0; slot < slotNames.size(); ++slot) {
+            LatencyHistogram* histogram = shard->histograms[slot].load(std::memory_order_acquire);
+            if (histogram != nullptr) {
+                merged[slot]->merge(*histogram);
+            }
+        }
+    };
+    for (const Shard* shard : liveShards) {
+        mergeShard(shard);
+    }
+    mergeShard(retired);
+    return merged;
+}
+
+void ShardedHistogramSet::reset() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto resetShard = [&](Shard* shard) {
+        for (size_t slot = 0; slot < slotNames.size(); ++slot) {
+            LatencyHistogram* histogram = shard->histograms[slot].load(std::memory_order_acquire);
+            if (histogram != nullptr) {
+                histogram->reset();
+            }
+        }
+    };
+    for (Shard* shard : liveShards) {
+        resetShard(shard);
+    }
+    resetShard(retired);
+}
+
+size_t ShardedHistogramSet::memoryUsage() const {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    size_t bytes = 0;
+    auto shardBytes = [&](const Shard* shard) {
+        bytes += sizeof(Shard) + shard->histograms.size() * sizeof(std::atomic<LatencyHistogram*>);
+        for (const auto& histogram : shard->histograms) {
+            if (histogram.load(std::memory_order_acquire) != nullptr) {
+                bytes += sizeof(LatencyHistogram);
+            }
+        }
+    };
+    for (const Shard* shard : liveShards) {
+        shardBytes(shard);
+    }
+    shardBytes(retired);
+    return bytes;
+}
+
+size_t ShardedHistogramSet::slotOf(std::string_view name) const {
+    for (size_t slot = 0; slot < slotNames.size(); ++slot) {
+        if (slotNames[slot] == name) {
+            return slot;
+        }
+    }
+    return npos;
+}
+
+// Latency of every REPL command, keyed by command name
+ShardedHistogramSet commandLatencies({
+    "ls", "cd", "create", "mkdir", "write", "read", "delete", "rmdir",
+    "mv", "cp", "ln", "search", "info", "save", "load", "stats", "memstats", "truncate",
+    "setxattr", "getxattr", "listxattr", "removexattr", "find", "xattrindex",
+    "memfd", "share", "attach", "cat", "diff", "snapshot", "history", "freeze", "unfreeze"
+});
+
+// Lock wait and hold time per call site, in LockSite order
+static const std::vector<std::string> lockSiteNames = {
+    "writeContentToFile",
+    "writeToFileBatch",
+    "writeContentAtOffset",
+    "truncateFile",
+    "listDirectory",
+    "readContentFromFile",
+    "addNewFile",
+    "addNewDirectory",
+    "createMultipleFiles",
+    "parseCdCommand",
+    "removeFile",
+    "removeDirectory",
+    "deleteMultipleFiles",
+    "parseMoveCommand",
+    "parseCopyCommand",
+    "linkEntry",
+    "createSymlink",
+    "setXattr",
+    "removeXattr",
+    "getXattr",
+    "listXattr",
+    "findByXattr",
+    "setXattrIndex",
+    "shareFile",
+    "attachFile",
+    "ingestFile",
+    "prepareCat",
+    "diffTrees",
+    "parseSnapshotCommand",
+    "parseHistoryCommand",
+    "freezeSubtree",
+    "unfreezeSubtree",
+    "parseSearchCommand",
+    "parseInfoCommand",
+    "parseSaveCommand",
+    "replaceNamespace",
+    "spliceInto",
+    "displaySystemStats",
+    "displayMemoryStats",
+    "initializeFileSystem",
+    "recordTraceCommand",
+    "parseRecordCommand"
+};
+
+ShardedHistogramSet lockWaitLatencies(lockSiteNames);
+ShardedHistogramSet lockHoldLatencies(lockSiteNames);
+std::atomic<uint64_t> lockContentions[static_cast<size_t>(LockSite::COUNT)];
+
+void printLockTable(std::ostream& out) {
+    auto waits = lockWaitLatencies.collect();
+    auto holds = lockHoldLatencies.collect();
+
+    out << std::left << std::setw(24) << "Lock site" << std::right
+        << std::setw(10) << "Acquired"
+        << std::setw(11) << "Contended"
+        << std::setw(13) << "Wait p50(us)"
+        << std::setw(13) << "Wait p99(us)"
+        << std::setw(13) << "Wait max(us)"
+        << std::setw(13) << "Hold p50(us)"
+        << std::setw(13) << "Hold p99(us)"
+        << std::setw(13) << "Hold max(us)" << "\n";
+
+    bool any = false;
+    for (size_t i = 0; i < lockSiteNames.size(); ++i) {
+        if (waits[i]->count() == 0) {
+            continue;
+        }
+        any = true;
+        out << std::left << std::setw(24) << lockSiteNames[i] << std::right
+            << std::setw(10) << waits[i]->count()
+            << std::setw(11) << lockContentions[i].load(std::memory_order_relaxed)
+            << std::fixed << std::setprecision(1)
+            << std::setw(13) << waits[i]->percentile(50) / 1000.0
+            << std::setw(13) << waits[i]->percentile(99) / 1000.0
+            << std::setw(13) << waits[i]->max() / 1000.0
+            << std::setw(13) << holds[i]->percentile(50) / 1000.0
+            << std::setw(13) << holds[i]->percentile(99) / 1000.0
+            << std::setw(13) << holds[i]->max() / 1000.0 << "\n";
+        out.unsetf(std::ios::fixed);
+        out << std::setprecision(6);
+    }
+
+    if (!any) {
+        out << "(no samples)\n";
+    }
+}
+
+void printLatencyTable(std::ostream& out, const std::string& title,
+                       const std::vector<std::string>& names,
+                       const std::vector<std::unique_ptr<LatencyHistogram>>& histograms) {
+    out << std::left << std::setw(24) << title << std::right
+        << std::setw(10) << "Count"
+        << std::setw(12) << "p50(us)"
+        << std::setw(12) << "p90(us)"
+        << std::setw(12) << "p99(us)"
+        << std::setw(12) << "p999(us)"
+        << std::setw(12) << "Max(us)" << "\n";
+
+    bool any = false;
+    for (size_t i = 0; i < names.size(); ++i) {
+        const LatencyHistogram& histogram = *histograms[i];
+        if (histogram.count() == 0) {
+            continue;
+        }
+        any = true;
+        out << std::left << std::setw(24) << names[i] << std::right
+            << std::setw(10) << histogram.count() << std::fixed << std::setprecision(1)
+            << std::setw(12) << histogram.percentile(50) / 1000.0
+            << std::setw(12) << histogram.percentile(90) / 1000.0
+            << std::setw(12) << histogram.percentile(99) / 1000.0
+            << std::setw(12) << histogram.percentile(99.9) / 1000.0
+            << std::setw(12) << histogram.max() / 1000.0 << "\n";
+        out.unsetf(std::ios::fixed);
+        out << std::setprecision(6);
+    }
+
+    if (!any) {
+        out << "(no samples)\n";
+    }
+}
+
+void writePrometheusSummary(std::ostream& out, const std::string& metric, const std::string& help,
+                            const std::string& label, const std::vector<std::string>& names,
+                            const std::vector<std::unique_ptr<LatencyHistogram>>& histograms) {
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+    out << "# HELP " << metric << " " << help << "\n";
+    out << "# TYPE " << metric << " summary\n";
+    for (size_t i = 0; i < names.size(); ++i) {
+        const LatencyHistogram& histogram = *histograms[i];
+        if (histogram.count() == 0) {
+            continue;
+        }
+        for (double quantile : quantiles) {
+            out << metric << "{" << label << "=\"" << names[i] << "\",quantile=\"" << quantile << "\"} "
+                << histogram.percentile(quantile * 100) / 1e9 << "\n";
+        }
+        out << metric << "_sum{" << label << "=\"" << names[i] << "\"} " << histogram.sumOfValues() / 1e9 << "\n";
+        out << metric << "_count{" << label << "=\"" << names[i] << "\"} " << histogram.count() << "\n";
+    }
+
+    out << "# HELP " << metric << "_max Largest observed value\n";
+    out << "# TYPE " << metric << "_max gauge\n";
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (histograms[i]->count() != 0) {
+            out << metric << "_max{" << label << "=\"" << names[i] << "\"} " << histograms[i]->max() / 1e9 << "\n";
+        }
+    }
+}
+
+void writePrometheusCounter(std::ostream& out, const std::string& metric, const std::string& help,
+                            const std::string& label, const std::vector<std::string>& names,
+                            const std::atomic<uint64_t>* counters) {
+    out << "# HELP " << metric << " " << help << "\n";
+    out << "# TYPE " << metric << " counter\n";
+    for (size_t i = 0; i < names.size(); ++i) {
+        out << metric << "{" << label << "=\"" << names[i] << "\"} "
+            << counters[i].load(std::memory_order_relaxed) << "\n";
+    }
+}
@@ -0,0 +1,220 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "latencyHistogram.h"
+#include "tracing.h"
+#include <atomic>       // For lock-free shard slots
+#include <chrono>       // For timing lock acquisition
+#include <cstdint>      // For fixed-width integers
+#include <memory>       // For smart pointers
+#include <mutex>        // For the shard registry
+#include <ostream>      // For reports
+#include <string>       // For string manipulation
+#include <string_view>  // For slot lookups by token
+#include <vector>       // For dynamic arrays
+
+/**
+ * A fixed set of named latency histograms, sharded per thread.
+ *
+ * Each recording thread writes only to its own shard, so the hot path is
+ * a thread-local lookup plus uncontended relaxed atomic increments. Shards
+ * are merged when a report is requested; a thread's shard is folded into
+ * the retired totals when the thread exits.
+ */
+class ShardedHistogramSet {
+public:
+    static const size_t kMaxInstances = 8;
+
+    explicit ShardedHistogramSet(const std::vector<std::string>& names);
+    ~ShardedHistogramSet();
+
+    ShardedHistogramSet(const ShardedHistogramSet&) = delete;
+    ShardedHistogramSet& operator=(const ShardedHistogramSet&) = delete;
+
+    /**
+     * Records a value into a slot of the calling thread's shard
+     * @param slot Index into names()
+     * @param value The value to record, in nanoseconds
+     */
+    void record(size_t slot, uint64_t value);
+
+    /**
+     * Merges every shard into one histogram per slot
+     * @return One histogram per name, in the same order as names()
+     */
+    std::vector<std::unique_ptr<LatencyHistogram>> collect() const;
+
+    /**
+     * Clears all recorded values in every shard
+     */
+    void reset();
+
+    /**
+     * Returns the index of a name, or npos if it is not part of the set
+     * @param name The name to look up
+     */
+    size_t slotOf(std::string_view name) const;
+
+    /**
+     * Returns the heap bytes held by all shards of this set
+     */
+    size_t memoryUsage() const;
+
+    const std::vector<std::string>& names() const { return slotNames; }
+
+    static const size_t npos = static_cast<size_t>(-1);
+
+private:
+    struct Shard;
+    friend struct ThreadShards;
+
+    Shard* localShard();
+    void retireShard(Shard* shard);
+
+    size_t instanceId;
+    std::vector<std::string> slotNames;
+    mutable std::mutex registryMutex;
+    std::vector<Shard*> liveShards;
+    Shard* retired;
+};
+
+// Latency of every REPL command, keyed by command name
+extern ShardedHistogramSet commandLatencies;
+
+/**
+ * Call sites that take a file system lock, used to attribute wait and hold
+ * time. Keep in sync with the names in metrics.cpp.
+ */
+enum class LockSite : size_t {
+    WRITE_CONTENT_TO_FILE,
+    WRITE_TO_FILE_BATCH,
+    WRITE_CONTENT_AT_OFFSET,
+    TRUNCATE_FILE,
+    LIST_DIRECTORY,
+    READ_CONTENT_FROM_FILE,
+    ADD_NEW_FILE,
+    ADD_NEW_DIRECTORY,
+    CREATE_MULTIPLE_FILES,
+    PARSE_CD_COMMAND,
+    REMOVE_FILE,
+    REMOVE_DIRECTORY,
+    DELETE_MULTIPLE_FILES,
+    PARSE_MOVE_COMMAND,
+    PARSE_COPY_COMMAND,
+    LINK_ENTRY,
+    CREATE_SYMLINK,
+    SET_XATTR,
+    REMOVE_XATTR,
+    GET_XATTR,
+    LIST_XATTR,
+    FIND_BY_XATTR,
+    SET_XATTR_INDEX,
+    SHARE_FILE,
+    ATTACH_FILE,
+    INGEST_FILE,
+    PREPARE_CAT,
+    DIFF_TREES,
+    PARSE_SNAPSHOT_COMMAND,
+    PARSE_HISTORY_COMMAND,
+    FREEZE_SUBTREE,
+    UNFREEZE_SUBTREE,
+    PARSE_SEARCH_COMMAND,
+    PARSE_INFO_COMMAND,
+    PARSE_SAVE_COMMAND,
+    REPLACE_NAMESPACE,
+    SPLICE_SUBTREE,
+    DISPLAY_SYSTEM_STATS,
+    DISPLAY_MEMORY_STATS,
+    INITIALIZE_FILE_SYSTEM,
+    RECORD_TRACE_COMMAND,
+    PARSE_RECORD_COMMAND,
+    COUNT
+};
+
+// Time spent waiting for and holding locks, keyed by LockSite
+extern ShardedHistogramSet lockWaitLatencies;
+extern ShardedHistogramSet lockHoldLatencies;
+
+// Number of acquisitions per LockSite that found the lock already taken
+extern std::atomic<uint64_t> lockContentions[static_cast<size_t>(LockSite::COUNT)];
+
+/**
+ * Scoped lock that records how long the caller waited for the mutex and
+ * how long it held it, attributed to a call site. A try_lock fast path
+ * distinguishes contended acquisitions.
+ */
+template <typename Mutex>
+class ProfiledLockGuard {
+public:
+    ProfiledLockGuard(Mutex& mutex, LockSite site) : mutex(mutex), site(static_cast<size_t>(site)) {
+        auto start = std::chrono::steady_clock::now();
+        {
+            TraceSpan span("lock wait");
+            if (!mutex.try_lock()) {
+                lockContentions[this->site].fetch_add(1, std::memory_order_relaxed);
+                mutex.lock();
+            }
+        }
+        acquired = std::chrono::steady_clock::now();
+        lockWaitLatencies.record(this->site, std::chrono::duration_cast<std::chrono::nanoseconds>(acquired - start).count());
+    }
+
+    ~ProfiledLockGuard() {
+        auto released = std::chrono::steady_clock::now();
+        mutex.unlock();
+        lockHoldLatencies.record(site, std::chrono::duration_cast<std::chrono::nanoseconds>(released - acquired).count());
+    }
+
+    ProfiledLockGuard(const ProfiledLockGuard&) = delete;
+    ProfiledLockGuard& operator=(const ProfiledLockGuard&) = delete;
+
+private:
+    Mutex& mutex;
+    size_t site;
+    std::chrono::steady_clock::time_point acquired;
+};
+
+/**
+ * Prints wait and hold percentiles plus contention counts per lock site
+ * @param out The stream to write to
+ */
+void printLockTable(std::ostream& out);
+
+/**
+ * Prints a latency table with one row per non-empty histogram
+ * @param out The stream to write to
+ * @param title Heading for the name column
+ * @param names Row names
+ * @param histograms Histograms in nanoseconds, parallel to names
+ */
+void printLatencyTable(std::ostream& out, const std::string& title,
+                       const std::vector<std::string>& names,
+                       const std::vector<std::unique_ptr<LatencyHistogram>>& histograms);
+
+/**
+ * Writes histograms as a Prometheus summary in the text exposition format
+ * @param out The stream to write to
+ * @param metric Metric name, e.g. memfs_command_latency_seconds
+ * @param help Help text for the metric
+ * @param label Label name distinguishing the rows, e.g. command
+ * @param names Label values
+ * @param histograms Histograms in nanoseconds, parallel to names
+ */
+void writePrometheusSummary(std::ostream& out, const std::string& metric, const std::string& help,
+                            const std::string& label, const std::vector<std::string>& names,
+                            const std::vector<std::unique_ptr<LatencyHistogram>>& histograms);
+
+/**
+ * Writes per-label counters in the Prometheus text exposition format
+ * @param out The stream to write to
+ * @param metric Metric name, e.g. memfs_lock_contended_total
+ * @param help Help text for the metric
+ * @param label Label name distinguishing the rows
+ * @param names Label values
+ * @param counters Counter values, parallel to names
+ */
+void writePrometheusCounter(std::ostream& out, const std::string& metric, const std::string& help,
+                            const std::string& label, const std::vector<std::string>& names,
+                            const std::atomic<uint64_t>* counters);
+
+#endif // METRICS_H
@@ -0,0 +1,280 @@
+// Unix domain socket server for the memory file system
+#include "server.h"
+#include "memFS.h"
+#include "socketProtocol.h"
+#include "shmRing.h"
+#include "fileContent.h"
+#include <iostream>     // For input/output operations
+#include <sstream>      // For capturing command output
+#include <string>       // For string manipulation
+#include <thread>       // For per-connection threads
+#include <vector>       // For the rings of a connection
+#include <new>          // For placement new
+#include <stdexcept>    // For std::exception
+#include <cstring>      // For strerror
+#include <cerrno>       // For errno
+#include <csignal>      // For ignoring SIGPIPE
+#include <fcntl.h>      // For sealing ring memfds
+#include <sys/mman.h>   // For memfd_create and mmap
+#include <sys/socket.h> // For socket, bind, listen and accept
+#include <sys/un.h>     // For sockaddr_un
+#include <unistd.h>     // For close and unlink
+
+// Rings a single connection may ask for
+static const size_t kMaxRingsPerConnection = 4;
+
+/**
+ * Checks whether a command line starts with the given command name
+ * @param command The command line
+ * @param name The command name
+ * @return True if the first word of the line is name
+ */
+static bool hasCommandName(const std::string& command, const std::string& name) {
+    size_t begin = command.find_first_not_of(' ');
+    return begin != std::string::npos && command.compare(begin, name.size(), name) == 0 &&
+           (command.size() == begin + name.size() || command[begin + name.size()] == ' ');
+}
+
+/**
+ * A client whose commands print into a buffer that is sent back
+ * after each command. Clients run concurrently and each has its own working
+ * directory; the session is current on the thread serving it.
+ */
+struct ClientSession {
+    std::ostringstream output;
+    Session session;
+    SessionScope scope;
+
+    /**
+     * @param directory Working directory the session starts in
+     */
+    explicit ClientSession(const std::string& directory) : scope(session) {
+        session.currentDirectory = directory;
+        session.input = nullptr;
+        session.output = &output;
+        session.errors = &output;
+    }
+
+    /**
+     * Returns what was printed since the last call and empties the buffer
+     */
+    std::string takeOutput() {
+        std::string text = output.str();
+        output.str(std::string());
+        return text;
+    }
+};
+
+/**
+ * Runs one command for the session current on this thread. A command that
+ * throws fails with an error in its output; the server and the other
+ * clients, including rings served through here, carry on.
+ * @param session The client session, which receives the output
+ * @param command The command line
+ * @param descriptor Set to a descriptor to pass back for 'share', -1 otherwise
+ * @param keepOpen Set to false if the command asks to end the session
+ * @return Everything the command printed
+ */
+static std::string runCapturedCommand(ClientSession& session, const std::string& command, int& descriptor,
+                                      bool& keepOpen) {
+    descriptor = -1;
+    keepOpen = true;
+    try {
+        if (hasCommandName(command, "share")) {
+            // The content is returned as a descriptor instead of as text
+            auto args = tokenize(command);
+            uint64_t size = 0;
+            if (args.size() != 2) {
+                session.output << "Usage: share <path>\n";
+            } else if ((descriptor = shareFileDescriptor(args[1], size)) >= 0) {
+                session.output << "Shared " << args[1] << ": " << size << " bytes in a sealed memfd\n";
+            }
+        } else {
+            keepOpen = executeCommand(command);
+        }
+    } catch (const std::exception& error) {
+        session.output << "Error: Command failed: " << error.what() << "\n";
+    }
+    return session.takeOutput();
+}
+
+/**
+ * Creates a ring region in a new memfd, sealed against resizing so the
+ * client cannot truncate it under the server's mapping
+ * @param descriptor Set to the memfd, to be passed to the client
+ * @return The mapped region, or null on failure
+ */
+static RingRegion* createRingRegion(int& descriptor) {
+    descriptor = memfd_create("memfs-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (descriptor < 0) {
+        return nullptr;
+    }
+    void* mapping = MAP_FAILED;
+    if (ftruncate(descriptor, sizeof(RingRegion)) == 0 &&
+        fcntl(descriptor, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == 0) {
+        mapping = mmap(nullptr, sizeof(RingRegion), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    }
+    if (mapping == MAP_FAILED) {
+        close(descriptor);
+        descriptor = -1;
+        return nullptr;
+    }
+    return new (mapping) RingRegion();
+}
+
+/**
+ * Executes commands arriving on a ring until it is closed or sends 'exit'.
+ * Descriptors can't travel over the ring, so 'share' only reports its result.
+ * The ring is a session of its own, starting in the directory its client
+ * session was in when it asked for the ring.
+ * A client that breaks the ring protocol loses its whole connection.
+ * @param region The ring pair of one client
+ * @param directory Working directory of the ring's session
+ * @param client The socket the ring was requested on
+ */
+static void serveRing(RingRegion* region, std::string directory, int client) {
+    ClientSession session(directory);
+    RingEndpoint endpoint = {&region->completion, &region->submission, &region->closed, kMinSpinIterations};
+    endpoint.messageLimit = kMaxRingCommandBytes;
+    std::string command;
+    bool keepOpen = true;
+
+    while (keepOpen && ringReceive(endpoint, command)) {
+        int descriptor;
+        std::string output = runCapturedCommand(session, command, descriptor, keepOpen);
+        if (descriptor >= 0) {
+            close(descriptor);
+        }
+        if (!ringSend(endpoint, output)) {
+            break;
+        }
+    }
+    closeRing(*region);
+    if (endpoint.violated) {
+        shutdown(client, SHUT_RDWR);
+    }
+}
+
+/**
+ * Answers a 'cat' request by writing the file range to the socket straight
+ * from the file's buffers, after the lock is released
+ * @param session The client session, which receives any error
+ * @param client The connected socket
+ * @param command The command line
+ * @return False if the connection was lost
+ */
+static bool streamCatResponse(ClientSession& session, int client, const std::string& command) {
+    FileContent content;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+    if (!prepareCat(command, content, offset, length)) {
+        return sendResponse(client, session.takeOutput());
+    }
+    return sendResponseHeader(client, length) && content.writeTo(client, offset, length);
+}
+
+/**
+ * Serves one client until it disconnects or sends 'exit'
+ * @param client The connected socket, closed on return
+ */
+static void serveConnection(int client) {
+    ClientSession session("/");
+    std::string pending;
+    char buffer[4096];
+    bool keepOpen = true;
+    std::vector<std::pair<RingRegion*, std::thread>> rings;
+
+    while (keepOpen) {
+        ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            break;
+        }
+        pending.append(buffer, received);
+
+        size_t lineEnd;
+        while (keepOpen && (lineEnd = pending.find('\n')) != std::string::npos) {
+            std::string command = pending.substr(0, lineEnd);
+            pending.erase(0, lineEnd + 1);
+
+            if (hasCommandName(command, "cat")) {
+                keepOpen = streamCatResponse(session, client, command);
+                continue;
+            }
+
+            int descriptor;
+            if (command == "ring") {
+                // Hand out a ring pair served by its own thread while this connection lasts
+                RingRegion* region = nullptr;
+                descriptor = -1;
+                if (rings.size() < kMaxRingsPerConnection && (region = createRingRegion(descriptor))) {
+                    rings.emplace_back(region, std::thread(serveRing, region, currentSession().currentDirectory,
+                                                           client));
+                }
+                std::string output = "Ring ready\n";
+                if (!region) {
+                    output = rings.size() >= kMaxRingsPerConnection ? "Error: Too many rings on this connection\n"
+                                                                    : "Error: Could not create ring\n";
+                }
+                keepOpen = sendResponse(client, output, descriptor);
+                if (descriptor >= 0) {
+                    close(descriptor);
+                }
+                continue;
+            }
+
+            std::string output = runCapturedCommand(session, command, descriptor, keepOpen);
+            bool sent = sendResponse(client, output, descriptor);
+            if (descriptor >= 0) {
+                close(descriptor);
+            }
+            if (!sent) {
+                keepOpen = false;
+            }
+        }
+    }
+
+    for (auto& ring : rings) {
+        closeRing(*ring.first);
+        ring.second.join();
+        munmap(ring.first, sizeof(RingRegion));
+    }
+    close(client);
+}
+
+int runServer(const std::string& socketPath) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Error: Socket path too long: " << socketPath << "\n";
+        return 1;
+    }
+    socketPath.copy(address.sun_path, socketPath.size());
+
+    // A client that goes away mid-response must not take the server down
+    signal(SIGPIPE, SIG_IGN);
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(socketPath.c_str());
+    if (listener < 0 ||
+        bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0) {
+        std::cerr << "Error: Could not listen on " << socketPath << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+
+    std::cout << "Memory File System serving on " << socketPath << std::endl;
+    for (;;) {
+        int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            std::cerr << "Error: accept failed: " << std::strerror(errno) << "\n";
+            break;
+        }
+        std::thread(serveConnection, client).detach();
+    }
+
+    close(listener);
+    unlink(socketPath.c_str());
+    return 1;
+}
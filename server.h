@@ -0,0 +1,16 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+
+/**
+ * Serves the memory file system to local processes over a Unix domain
+ * socket, using the protocol in socketProtocol.h. Each connection runs on
+ * its own thread. 'share <path>' responses carry the file's sealed memfd
+ * so the client can map the content instead of receiving it.
+ * @param socketPath Filesystem path to bind; an existing socket there is replaced
+ * @return Process exit status
+ */
+int runServer(const std::string& socketPath);
+
+#endif // SERVER_H
@@ -0,0 +1,244 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include "socketProtocol.h"
+#include <algorithm>    // For std::min and std::max
+#include <atomic>       // For the ring indexes
+#include <climits>      // For INT_MAX
+#include <cstdint>      // For fixed-width integers and SIZE_MAX
+#include <cstring>      // For memcpy
+#include <string>       // For string manipulation
+#include <linux/futex.h> // For FUTEX_WAIT and FUTEX_WAKE
+#include <sys/mman.h>   // For mapping the ring region
+#include <sys/syscall.h> // For SYS_futex
+#include <unistd.h>     // For syscall and close
+
+/**
+ * Shared-memory transport between the server and one client process.
+ *
+ * A client sends 'ring' over its socket and receives a memfd holding a
+ * RingRegion: a submission ring (client to server) and a completion ring
+ * (server to client). Each ring is single-producer, single-consumer, made
+ * of fixed-size slots; a message longer than a slot continues in the next
+ * ones. Both sides spin for a while before sleeping on a futex in the
+ * shared region, and the spin budget adapts to how long waits have been,
+ * so a busy pair exchanges commands with no system calls while an idle one
+ * costs no CPU. The region lives as long as the socket it was requested on.
+ *
+ * The peer can write anything into the shared region, so each side keeps
+ * its own indexes privately and checks what it reads from the other: an
+ * index more than a ring ahead, a slot length past the slot, or a message
+ * longer than the receiver's limit closes the region.
+ */
+static const uint32_t kRingSlots = 64;                      // Power of two
+static const size_t kRingSlotBytes = 4096;
+static const uint32_t kSlotContinued = 1;                   // Message continues in the next slot
+static const uint32_t kMinSpinIterations = 64;
+static const uint32_t kMaxSpinIterations = 1 << 16;
+static const size_t kMaxRingCommandBytes = 1 << 20;         // Longest command the server accepts
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "ring indexes must be lock-free to be shared");
+
+struct RingSlot {
+    uint32_t length;
+    uint32_t flags;
+    char data[kRingSlotBytes - 2 * sizeof(uint32_t)];
+};
+
+struct Ring {
+    alignas(64) std::atomic<uint32_t> head;          // Slots consumed; futex word the producer waits on when full
+    std::atomic<uint32_t> headWaiters;
+    alignas(64) std::atomic<uint32_t> tail;          // Slots produced; futex word the consumer waits on when empty
+    std::atomic<uint32_t> tailWaiters;
+    alignas(64) RingSlot slots[kRingSlots];
+};
+
+struct RingRegion {
+    Ring submission;
+    Ring completion;
+    std::atomic<uint32_t> closed;                     // Set when either side goes away
+};
+
+/**
+ * One side of a ring pair with its adaptive spin budget. The indexes this
+ * side advances are kept here; the copies in the region are only published.
+ */
+struct RingEndpoint {
+    Ring* outgoing;
+    Ring* incoming;
+    std::atomic<uint32_t>* closed;
+    uint32_t spinBudget;
+    uint32_t sent = 0;          // Slots produced on the outgoing ring
+    uint32_t received = 0;      // Slots consumed from the incoming ring
+    size_t messageLimit = SIZE_MAX;  // Longest message accepted from the peer
+    bool violated = false;      // Set when the peer broke the ring protocol
+};
+
+/**
+ * Issues a futex operation on a word in shared memory
+ */
+inline void futexCall(std::atomic<uint32_t>& word, int operation, uint32_t value) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), operation, value, nullptr, nullptr, 0);
+}
+
+/**
+ * Hints the CPU that this is a spin loop
+ */
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/**
+ * Waits until a ring index moves past a seen value, spinning before
+ * sleeping. A wait that ends while spinning doubles the budget, one that
+ * has to sleep halves it.
+ * @param word The index to watch
+ * @param seen The value it had
+ * @param waiters Count of sleepers the other side checks before waking
+ * @param endpoint The waiting side, whose budget is adapted
+ */
+inline void waitForChange(std::atomic<uint32_t>& word, uint32_t seen, std::atomic<uint32_t>& waiters,
+                          RingEndpoint& endpoint) {
+    for (uint32_t i = 0; i < endpoint.spinBudget; ++i) {
+        if (word.load(std::memory_order_acquire) != seen || endpoint.closed->load(std::memory_order_relaxed)) {
+            endpoint.spinBudget = std::min(endpoint.spinBudget * 2, kMaxSpinIterations);
+            return;
+        }
+        cpuRelax();
+    }
+    endpoint.spinBudget = std::max(endpoint.spinBudget / 2, kMinSpinIterations);
+
+    // The kernel re-checks the word, so a change between the load and the wait is not lost
+    waiters.fetch_add(1, std::memory_order_seq_cst);
+    while (word.load(std::memory_order_seq_cst) == seen && !endpoint.closed->load(std::memory_order_seq_cst)) {
+        futexCall(word, FUTEX_WAIT, seen);
+    }
+    waiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/**
+ * Advances a ring index and wakes the other side if it sleeps on it
+ */
+inline void publishIndex(std::atomic<uint32_t>& word, uint32_t value, std::atomic<uint32_t>& waiters) {
+    word.store(value, std::memory_order_seq_cst);
+    if (waiters.load(std::memory_order_seq_cst) != 0) {
+        futexCall(word, FUTEX_WAKE, INT_MAX);
+    }
+}
+
+/**
+ * Marks a ring region closed and wakes anyone waiting on it
+ */
+inline void closeRing(RingRegion& region) {
+    region.closed.store(1, std::memory_order_seq_cst);
+    for (Ring* ring : {&region.submission, &region.completion}) {
+        futexCall(ring->head, FUTEX_WAKE, INT_MAX);
+        futexCall(ring->tail, FUTEX_WAKE, INT_MAX);
+    }
+}
+
+/**
+ * Closes the region because the peer wrote something invalid into it
+ * @return False, for the caller to return
+ */
+inline bool rejectPeer(RingEndpoint& endpoint) {
+    endpoint.violated = true;
+    endpoint.closed->store(1, std::memory_order_seq_cst);
+    return false;
+}
+
+/**
+ * Sends a message on an endpoint's outgoing ring
+ * @param endpoint The sending side
+ * @param message The message, split across slots as needed
+ * @return False if the region was closed or the peer broke the protocol
+ */
+inline bool ringSend(RingEndpoint& endpoint, const std::string& message) {
+    Ring& ring = *endpoint.outgoing;
+    const size_t capacity = sizeof(RingSlot::data);
+    size_t offset = 0;
+    do {
+        uint32_t tail = endpoint.sent;
+        uint32_t head;
+        while (tail - (head = ring.head.load(std::memory_order_acquire)) == kRingSlots) {
+            if (endpoint.closed->load(std::memory_order_relaxed)) {
+                return false;
+            }
+            waitForChange(ring.head, head, ring.headWaiters, endpoint);
+        }
+        if (tail - head > kRingSlots) {
+            return rejectPeer(endpoint);
+        }
+
+        RingSlot& slot = ring.slots[tail & (kRingSlots - 1)];
+        size_t length = std::min(capacity, message.size() - offset);
+        std::memcpy(slot.data, message.data() + offset, length);
+        offset += length;
+        slot.length = static_cast<uint32_t>(length);
+        slot.flags = offset < message.size() ? kSlotContinued : 0;
+        endpoint.sent = tail + 1;
+        publishIndex(ring.tail, tail + 1, ring.tailWaiters);
+    } while (offset < message.size());
+    return true;
+}
+
+/**
+ * Receives a message from an endpoint's incoming ring
+ * @param endpoint The receiving side
+ * @param message Set to the message
+ * @return False if the region was closed or the peer broke the protocol
+ */
+inline bool ringReceive(RingEndpoint& endpoint, std::string& message) {
+    Ring& ring = *endpoint.incoming;
+    message.clear();
+    for (;;) {
+        uint32_t head = endpoint.received;
+        uint32_t tail;
+        while ((tail = ring.tail.load(std::memory_order_acquire)) == head) {
+            if (endpoint.closed->load(std::memory_order_relaxed)) {
+                return false;
+            }
+            waitForChange(ring.tail, tail, ring.tailWaiters, endpoint);
+        }
+        if (tail - head > kRingSlots) {
+            return rejectPeer(endpoint);
+        }
+
+        // Read each field once; the peer may change the slot while it is copied
+        const RingSlot& slot = ring.slots[head & (kRingSlots - 1)];
+        uint32_t length = __atomic_load_n(&slot.length, __ATOMIC_RELAXED);
+        uint32_t flags = __atomic_load_n(&slot.flags, __ATOMIC_RELAXED);
+        if (length > sizeof(slot.data) || length > endpoint.messageLimit - message.size()) {
+            return rejectPeer(endpoint);
+        }
+        message.append(slot.data, length);
+        bool continued = (flags & kSlotContinued) != 0;
+        endpoint.received = head + 1;
+        publishIndex(ring.head, head + 1, ring.headWaiters);
+        if (!continued) {
+            return true;
+        }
+    }
+}
+
+/**
+ * Asks the server for a ring pair on a connected socket and maps it
+ * @param socket The connection; the rings stay valid while it is open
+ * @return The mapped region, or null on failure
+ */
+inline RingRegion* requestRing(int socket) {
+    static const std::string request = "ring\n";
+    std::string output;
+    int descriptor = -1;
+    if (!sendAll(socket, request.data(), request.size()) || !receiveResponse(socket, output, descriptor) ||
+        descriptor < 0) {
+        return nullptr;
+    }
+    void* mapping = mmap(nullptr, sizeof(RingRegion), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    close(descriptor);
+    return mapping == MAP_FAILED ? nullptr : static_cast<RingRegion*>(mapping);
+}
+
+#endif // SHM_RING_H
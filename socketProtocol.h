@@ -0,0 +1,174 @@
+#ifndef SOCKET_PROTOCOL_H
+#define SOCKET_PROTOCOL_H
+
+#include <cstdint>      // For fixed-width integers
+#include <cstring>      // For memcpy
+#include <string>       // For string manipulation
+#include <sys/socket.h> // For sendmsg/recvmsg and SCM_RIGHTS
+#include <sys/types.h>  // For ssize_t
+#include <sys/un.h>     // For sockaddr_un
+#include <unistd.h>     // For close
+#include <cerrno>       // For errno
+
+/**
+ * Unix socket protocol shared by the server in server.cpp and the client.
+ *
+ * A request is one command line terminated by '\n'. Each request gets one
+ * response: a ResponseHeader followed by 'length' bytes of command output.
+ * When the header has kResponseHasDescriptor set, a file descriptor is
+ * attached to it as SCM_RIGHTS ancillary data. The body of a 'cat' response
+ * is the raw file range, written by the server straight from file buffers.
+ */
+static const uint32_t kResponseMagic = 0x5253464D;          // "MFSR"
+static const uint32_t kResponseHasDescriptor = 1;
+
+struct ResponseHeader {
+    uint32_t magic;
+    uint32_t flags;
+    uint64_t length;
+};
+
+/**
+ * Connects to a server socket
+ * @param path Filesystem path of the socket
+ * @return The connected socket, or -1 with errno set
+ */
+inline int connectSocket(const std::string& path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    path.copy(address.sun_path, path.size());
+
+    int connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (connection >= 0 && connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        int error = errno;
+        close(connection);
+        errno = error;
+        return -1;
+    }
+    return connection;
+}
+
+/**
+ * Sends a whole buffer, retrying short writes
+ * @param socket The connected socket
+ * @param data The bytes to send
+ * @param length Number of bytes
+ * @return True if everything was sent
+ */
+inline bool sendAll(int socket, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(socket, data, length, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+/**
+ * Receives exactly the requested number of bytes
+ * @param socket The connected socket
+ * @param data Where to store the bytes
+ * @param length Number of bytes
+ * @return False if the connection closed or failed first
+ */
+inline bool receiveAll(int socket, char* data, size_t length) {
+    while (length > 0) {
+        ssize_t received = recv(socket, data, length, 0);
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        length -= received;
+    }
+    return true;
+}
+
+/**
+ * Sends a response, optionally passing a file descriptor with it
+ * @param socket The connected socket
+ * @param text The command output
+ * @param descriptor Descriptor to pass, or -1
+ * @return True if the response was sent
+ */
+inline bool sendResponse(int socket, const std::string& text, int descriptor = -1) {
+    ResponseHeader header = {kResponseMagic, descriptor >= 0 ? kResponseHasDescriptor : 0, text.size()};
+    iovec vector = {&header, sizeof(header)};
+    msghdr message = {};
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+
+    // The descriptor travels with the first byte of the header
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    if (descriptor >= 0) {
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        cmsghdr* ancillary = CMSG_FIRSTHDR(&message);
+        ancillary->cmsg_level = SOL_SOCKET;
+        ancillary->cmsg_type = SCM_RIGHTS;
+        ancillary->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(ancillary), &descriptor, sizeof(int));
+    }
+
+    ssize_t sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+    if (sent <= 0) {
+        return false;
+    }
+    return sendAll(socket, reinterpret_cast<const char*>(&header) + sent, sizeof(header) - sent) &&
+           sendAll(socket, text.data(), text.size());
+}
+
+/**
+ * Sends the header of a response whose body the caller writes itself
+ * @param socket The connected socket
+ * @param length Number of body bytes that will follow
+ * @return True if the header was sent
+ */
+inline bool sendResponseHeader(int socket, uint64_t length) {
+    ResponseHeader header = {kResponseMagic, 0, length};
+    return sendAll(socket, reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+/**
+ * Receives a response and the descriptor passed with it, if any
+ * @param socket The connected socket
+ * @param text Set to the command output
+ * @param descriptor Set to the received descriptor, or -1
+ * @return False if the connection closed or the response is malformed
+ */
+inline bool receiveResponse(int socket, std::string& text, int& descriptor) {
+    ResponseHeader header;
+    iovec vector = {&header, sizeof(header)};
+    msghdr message = {};
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    descriptor = -1;
+    ssize_t received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+    if (received <= 0) {
+        return false;
+    }
+    for (cmsghdr* ancillary = CMSG_FIRSTHDR(&message); ancillary; ancillary = CMSG_NXTHDR(&message, ancillary)) {
+        if (ancillary->cmsg_level == SOL_SOCKET && ancillary->cmsg_type == SCM_RIGHTS) {
+            std::memcpy(&descriptor, CMSG_DATA(ancillary), sizeof(int));
+        }
+    }
+
+    if (!receiveAll(socket, reinterpret_cast<char*>(&header) + received, sizeof(header) - received) ||
+        header.magic != kResponseMagic) {
+        return false;
+    }
+    text.resize(header.length);
+    return receiveAll(socket, &text[0], text.size());
+}
+
+#endif // SOCKET_PROTOCOL_H
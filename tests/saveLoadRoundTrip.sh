@@ -0,0 +1,38 @@
+#!/bin/sh
+# Saves files with binary and multi-line content and checks that loading the
+# dump gives them back unchanged
+# Usage: tests/saveLoadRoundTrip.sh [<memfs binary>]
+
+MEMFS=${1:-./memfs}
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+printf 'line1\nline2\nline3\n' > "$WORK/multi"
+printf 'a|b\000\r\n\n\377|c' > "$WORK/binary"
+printf '\n\n' > "$WORK/newlines"
+printf 'x\ny\n' > "$WORK/sparse"
+
+OUTPUT=$(printf '%s\n' \
+    "write -f $WORK/multi /d/multi" \
+    "write -f $WORK/binary /d/binary" \
+    "write -f $WORK/newlines /d/newlines" \
+    "write -f $WORK/sparse /d/sparse" \
+    "write -o 1M /d/sparse end" \
+    "truncate /d/sparse 2M" \
+    "setxattr /d/binary kind raw" \
+    "save $WORK/dump" \
+    "load $WORK/dump /restored" \
+    "diff /d /restored/d" \
+    "getxattr /restored/d/binary kind" \
+    "exit" | "$MEMFS" 2>&1)
+
+fail() {
+    echo "FAIL: $1"
+    echo "$OUTPUT"
+    exit 1
+}
+
+echo "$OUTPUT" | grep -q "Warning" && fail "load printed warnings"
+echo "$OUTPUT" | grep -q "No differences between /d and /restored/d" || fail "restored files differ"
+echo "$OUTPUT" | grep -q "kind=raw" || fail "attribute was not restored"
+echo "PASS: save/load round trip"
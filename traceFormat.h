@@ -0,0 +1,104 @@
+#ifndef TRACE_FORMAT_H
+#define TRACE_FORMAT_H
+
+#include <cstdint>      // For fixed-width integers
+#include <cstring>      // For memcmp
+#include <istream>      // For reading traces
+#include <ostream>      // For writing traces
+#include <string>       // For string manipulation
+
+/**
+ * Workload trace file format shared by the recorder in memFS.cpp and the
+ * replay tool.
+ *
+ * A trace starts with the 8-byte magic below, followed by one record per
+ * command:  varint(microseconds since previous record) varint(length) bytes.
+ * Delta timestamps and varints keep typical records to a few bytes of
+ * overhead on top of the command text.
+ */
+static const char kTraceMagic[8] = {'M', 'F', 'S', 'T', 'R', 'C', '1', '\n'};
+
+// Longest command a record may hold; a larger length means the trace is corrupt
+static const uint64_t kMaxTraceCommandBytes = 16 << 20;
+
+/**
+ * Writes an unsigned integer in LEB128 varint encoding
+ * @param out The stream to write to
+ * @param value The value to encode
+ */
+inline void writeVarint(std::ostream& out, uint64_t value) {
+    char buffer[10];
+    size_t length = 0;
+    do {
+        char byte = static_cast<char>(value & 0x7F);
+        value >>= 7;
+        if (value != 0) {
+            byte |= static_cast<char>(0x80);
+        }
+        buffer[length++] = byte;
+    } while (value != 0);
+    out.write(buffer, length);
+}
+
+/**
+ * Reads an unsigned integer in LEB128 varint encoding
+ * @param in The stream to read from
+ * @param value Receives the decoded value
+ * @return True if a complete value was read, false at end of input
+ */
+inline bool readVarint(std::istream& in, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = in.get();
+        if (byte == std::char_traits<char>::eof()) {
+            return false;
+        }
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Writes one trace record
+ * @param out The stream to write to
+ * @param deltaMicros Microseconds since the previous record
+ * @param command The command text
+ */
+inline void writeTraceRecord(std::ostream& out, uint64_t deltaMicros, const std::string& command) {
+    writeVarint(out, deltaMicros);
+    writeVarint(out, command.size());
+    out.write(command.data(), command.size());
+}
+
+/**
+ * Reads one trace record
+ * @param in The stream to read from
+ * @param deltaMicros Receives the microseconds since the previous record
+ * @param command Receives the command text
+ * @return True if a complete record was read, false at end of input or on a corrupt record
+ */
+inline bool readTraceRecord(std::istream& in, uint64_t& deltaMicros, std::string& command) {
+    uint64_t length = 0;
+    if (!readVarint(in, deltaMicros) || !readVarint(in, length) || length > kMaxTraceCommandBytes) {
+        return false;
+    }
+    command.resize(length);
+    in.read(&command[0], length);
+    return static_cast<uint64_t>(in.gcount()) == length;
+}
+
+/**
+ * Checks that a stream starts with the trace magic
+ * @param in The stream to check
+ * @return True if the header is valid
+ */
+inline bool readTraceHeader(std::istream& in) {
+    char header[sizeof(kTraceMagic)];
+    in.read(header, sizeof(header));
+    return in.gcount() == sizeof(header) && std::memcmp(header, kTraceMagic, sizeof(header)) == 0;
+}
+
+#endif // TRACE_FORMAT_H
@@ -0,0 +1,200 @@
+// Per-thread span buffers and Chrome trace export for the memory file system
+#include "tracing.h"
+#include <algorithm>    // For standard algorithms
+#include <chrono>       // For the tracing clock
+#include <mutex>        // For buffer and registry locks
+#include <vector>       // For dynamic arrays
+
+std::atomic<bool> tracingEnabled(false);
+
+namespace {
+
+/**
+ * A completed span
+ */
+struct TraceEvent {
+    const char* name;
+    const char* detail;
+    uint64_t startNanos;
+    uint64_t durationNanos;
+};
+
+/**
+ * Ring buffer of one thread's spans. The vector grows up to the capacity
+ * and then wraps, so short-lived threads stay cheap.
+ */
+struct TraceBuffer {
+    std::mutex mutex;           // Uncontended except while flushing
+    std::vector<TraceEvent> events;
+    size_t capacity = 0;
+    size_t next = 0;            // Slot to overwrite once the buffer is full
+    uint32_t threadId = 0;
+    bool retired = false;       // Owning thread has exited
+};
+
+std::mutex registryMutex;
+std::vector<TraceBuffer*> buffers;
+std::atomic<size_t> bufferCapacity(65536);
+uint32_t nextThreadId = 1;
+
+/**
+ * Hands the thread's buffer back to the registry when the thread exits
+ */
+struct ThreadTraceBuffer {
+    TraceBuffer* buffer = nullptr;
+
+    ~ThreadTraceBuffer() {
+        if (buffer != nullptr) {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+            buffer->retired = true;
+        }
+    }
+};
+
+thread_local ThreadTraceBuffer threadBuffer;
+
+/**
+ * Returns the calling thread's buffer, registering it on first use
+ */
+TraceBuffer* localBuffer() {
+    if (threadBuffer.buffer == nullptr) {
+        TraceBuffer* buffer = new TraceBuffer();
+        buffer->capacity = bufferCapacity.load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(registryMutex);
+        buffer->threadId = nextThreadId++;
+        buffers.push_back(buffer);
+        threadBuffer.buffer = buffer;
+    }
+    return threadBuffer.buffer;
+}
+
+/**
+ * Writes a string as a JSON string literal
+ * @param out The stream to write to
+ * @param value The string to escape
+ */
+void writeJsonString(std::ostream& out, const char* value) {
+    out << '"';
+    for (const char* c = value; *c != '\0'; ++c) {
+        if (*c == '"' || *c == '\\') {
+            out << '\\' << *c;
+        } else if (static_cast<unsigned char>(*c) < 0x20) {
+            out << ' ';
+        } else {
+            out << *c;
+        }
+    }
+    out << '"';
+}
+
+} // namespace
+
+uint64_t traceClockNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void recordTraceSpan(const char* name, const char* detail, uint64_t startNanos, uint64_t endNanos) {
+    TraceBuffer* buffer = localBuffer();
+    TraceEvent event = {name, detail, startNanos, endNanos - startNanos};
+
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    if (buffer->events.size() < buffer->capacity) {
+        buffer->events.push_back(event);
+    } else if (buffer->capacity != 0) {
+        buffer->events[buffer->next] = event;
+        buffer->next = (buffer->next + 1) % buffer->capacity;
+    }
+}
+
+void startTracing(size_t eventsPerThread) {
+    bufferCapacity.store(std::max<size_t>(1, eventsPerThread), std::memory_order_relaxed);
+
+    // Resize existing buffers; spans recorded so far are dropped
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (TraceBuffer* buffer : buffers) {
+            std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+            buffer->events.clear();
+            buffer->next = 0;
+            buffer->capacity = bufferCapacity.load(std::memory_order_relaxed);
+        }
+    }
+    tracingEnabled.store(true, std::memory_order_relaxed);
+}
+
+void stopTracing() {
+    tracingEnabled.store(false, std::memory_order_relaxed);
+}
+
+size_t bufferedTraceSpans() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    size_t total = 0;
+    for (TraceBuffer* buffer : buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        total += buffer->events.size();
+    }
+    return total;
+}
+
+size_t flushTrace(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    size_t written = 0;
+    uint64_t origin = UINT64_MAX;
+
+    // Timestamps are reported relative to the earliest buffered span
+    for (TraceBuffer* buffer : buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        for (const TraceEvent& event : buffer->events) {
+            origin = std::min(origin, event.startNanos);
+        }
+    }
+
+    out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+    bool first = true;
+    for (TraceBuffer* buffer : buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        if (buffer->events.empty()) {
+            continue;
+        }
+
+        out << (first ? "" : ",\n")
+            << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->threadId
+            << ", \"args\": {\"name\": \"memfs-" << buffer->threadId << "\"}}";
+        first = false;
+
+        // Oldest event first: once wrapped, the oldest sits at 'next'
+        size_t count = buffer->events.size();
+        size_t begin = count < buffer->capacity ? 0 : buffer->next;
+        for (size_t i = 0; i < count; ++i) {
+            const TraceEvent& event = buffer->events[(begin + i) % count];
+            out << ",\n{\"name\": ";
+            writeJsonString(out, event.name);
+            out << ", \"cat\": \"memfs\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->threadId
+                << ", \"ts\": " << (event.startNanos - origin) / 1000.0
+                << ", \"dur\": " << event.durationNanos / 1000.0;
+            if (event.detail != nullptr) {
+                out << ", \"args\": {\"detail\": ";
+                writeJsonString(out, event.detail);
+                out << "}";
+            }
+            out << "}";
+            written++;
+        }
+        buffer->events.clear();
+        buffer->next = 0;
+    }
+    out << "\n]}\n";
+
+    // Buffers of exited threads are released once their spans are written
+    auto retiredEnd = std::remove_if(buffers.begin(), buffers.end(), [](TraceBuffer* buffer) {
+        if (buffer->retired) {
+            delete buffer;
+            return true;
+        }
+        return false;
+    });
+    buffers.erase(retiredEnd, buffers.end());
+    return written;
+}
@@ -0,0 +1,86 @@
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <atomic>       // For the global enable flag
+#include <cstdint>      // For fixed-width integers
+#include <ostream>      // For flushing traces
+#include <string>       // For string manipulation
+
+/**
+ * Low-overhead span tracing in Chrome trace event format.
+ *
+ * Spans are appended to a ring buffer owned by the recording thread and
+ * written out as Chrome trace JSON (chrome://tracing, ui.perfetto.dev) on
+ * demand. When tracing is off, a span costs one relaxed load and a branch
+ * in its constructor and destructor.
+ */
+
+// Whether spans are currently being recorded
+extern std::atomic<bool> tracingEnabled;
+
+/**
+ * Returns the current time on the tracing clock
+ * @return Nanoseconds since an arbitrary fixed epoch
+ */
+uint64_t traceClockNanos();
+
+/**
+ * Appends a completed span to the calling thread's ring buffer
+ * @param name Static span name
+ * @param detail Optional static detail string, may be null
+ * @param startNanos Span start on the tracing clock
+ * @param endNanos Span end on the tracing clock
+ */
+void recordTraceSpan(const char* name, const char* detail, uint64_t startNanos, uint64_t endNanos);
+
+/**
+ * Starts recording spans
+ * @param eventsPerThread Ring buffer capacity of each thread
+ */
+void startTracing(size_t eventsPerThread);
+
+/**
+ * Stops recording spans; buffered spans are kept until flushed
+ */
+void stopTracing();
+
+/**
+ * Writes all buffered spans as Chrome trace JSON and clears the buffers
+ * @param out The stream to write to
+ * @return Number of spans written
+ */
+size_t flushTrace(std::ostream& out);
+
+/**
+ * Returns the number of spans currently buffered across all threads
+ */
+size_t bufferedTraceSpans();
+
+/**
+ * Scoped span: records its lifetime when tracing is enabled
+ */
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name, const char* detail = nullptr)
+        : name(tracingEnabled.load(std::memory_order_relaxed) ? name : nullptr), detail(detail), start(0) {
+        if (this->name != nullptr) {
+            start = traceClockNanos();
+        }
+    }
+
+    ~TraceSpan() {
+        if (name != nullptr) {
+            recordTraceSpan(name, detail, start, traceClockNanos());
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name;
+    const char* detail;
+    uint64_t start;
+};
+
+#endif // TRACING_H